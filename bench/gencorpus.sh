@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# gencorpus.sh - generate the corpora replayed by tibench
+#
+# usage: gencorpus.sh DIR [SCALE]
+#
+# Writes large.c, longline.js and huge.log into DIR. SCALE (default 1)
+# multiplies the size of every file. Output is deterministic so runs on
+# different machines replay the same text.
+
+dir=${1:?usage: gencorpus.sh DIR [SCALE]}
+scale=${2:-1}
+
+mkdir -p "$dir" || exit 1
+
+# ~12MB of C: functions, block comments, strings and numbers
+awk -v n=$((scale * 40000)) 'BEGIN {
+  srand(1)
+  print "#include <stdio.h>\n#include <stdlib.h>\n"
+  for (i = 0; i < n; i++) {
+    if (i % 10 == 0)
+      printf "/*\n * block %d: generated for the ti benchmark\n */\n", i
+    printf "static int func_%d(int a, char *s) {\n", i
+    printf "\tint x = %d; // line comment %d\n", int(rand() * 100000), i
+    printf "\tif (a > %d && s != NULL)\n", int(rand() * 1000)
+    printf "\t\treturn printf(\"%%s %d\\n\", s);\n", i
+    printf "\tfor (unsigned long k = 0; k < %d; k++)\n\t\tx += k * 3.14;\n", i % 97
+    printf "\treturn x;\n}\n\n"
+  }
+}' > "$dir/large.c"
+
+# ~10MB of minified-looking JS: few lines, each hundreds of KB long
+awk -v n=$((scale * 40)) 'BEGIN {
+  srand(2)
+  for (i = 0; i < n; i++) {
+    line = ""
+    for (j = 0; j < 2500; j++)
+      line = line sprintf("function f%d_%d(a){var b=%d;if(a){return \"s%d\"+b}return null};", i, j, int(rand() * 1000), j)
+    print line
+  }
+}' > "$dir/longline.js"
+
+# ~30MB of service log lines with repeated shapes
+awk -v n=$((scale * 300000)) 'BEGIN {
+  srand(3)
+  split("INFO INFO INFO INFO DEBUG WARN ERROR", lvl, " ")
+  split("GET POST GET GET PUT DELETE", verb, " ")
+  for (i = 0; i < n; i++) {
+    printf "2024-01-%02d %02d:%02d:%02d.%03d [%s] worker-%d %s /api/v1/items/%d status=%d dur=%dms\n",
+      1 + int(i / 86400) % 28, int(i / 3600) % 24, int(i / 60) % 60, i % 60,
+      int(rand() * 1000), lvl[1 + int(rand() * 7)], int(rand() * 16),
+      verb[1 + int(rand() * 6)], int(rand() * 100000),
+      (rand() < 0.95) ? 200 : 500, int(rand() * 900)
+  }
+}' > "$dir/huge.log"
@@ -0,0 +1,706 @@
+/*~~~~~~~~~~~~~~~~~~~~ tibench ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * Headless replay benchmark for the editor core.
+ *
+ * ti.c is built without its tty layer (TI_HEADLESS) and driven by a virtual
+ * terminal of fixed size: keys come from a replay script and every byte the
+ * editor writes is counted instead of sent to a terminal.
+ *
+ * usage: tibench [-s ROWSxCOLS] [-d CORPUSDIR] script.tis
+ *
+ * Script lines (blank lines and '#' comments are ignored):
+ *
+ *   open FILE          load FILE (relative to CORPUSDIR), timed as "open"
+ *   view FILE          page through FILE read-only (-R), timed as "view"
+ *   reopen FILE        open FILE and save its session, then time opening
+ *                      it again from the session as "reopen"
+ *   index FILE [N]     time tiIndexNewlines over FILE with 1 and N threads
+ *                      (default one per CPU) and print the throughput
+ *   export FILE...     time --cat and --html over the FILEs into /dev/null
+ *                      with 1 thread and one per CPU, print the throughput
+ *   op NAME            label the keys that follow as operation NAME
+ *   keys TEXT          queue TEXT as keystrokes
+ *   repeat N TEXT      queue TEXT N times
+ *   paste FILE [N]     queue the first N bytes of FILE as typed keys
+ *   idle N             queue N read timeouts, each an idle tick for
+ *                      background work (streams, filters, autosave)
+ *   journal on|off     journal the edits to the files opened next
+ *   verify file        check the buffer, read back through any packed
+ *                      rows, against its file on disk
+ *   verify journal     check the buffer against its file with the journal
+ *                      replayed over it, then drop the journal
+ *
+ * A verify that finds the bytes differ exits with status 1.
+ *
+ * TEXT understands <esc> <cr> <tab> <bs> <del> <up> <down> <left> <right>
+ * <home> <end> <pgup> <pgdn> <lt> and <C-x> for control keys.
+ *
+ * For every key the time from its first byte being read until the next key
+ * is requested is recorded, along with the bytes written to the terminal in
+ * that span. Percentiles per operation and peak RSS are printed on exit.
+ */
+
+#define TI_HEADLESS
+#include "../ti.c"
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#define BENCH_MAX_OPS 32
+#define BENCH_PAUSE -1
+
+struct benchKey {
+  int byte;  /* byte to hand to the editor, or BENCH_PAUSE for a read timeout */
+  int op;    /* operation index, -1 for bytes continuing the previous key */
+};
+
+struct benchOp {
+  char name[32];
+  double *lat;
+  long *bytes;
+  int n, cap;
+};
+
+struct benchState {
+  int rows, cols;
+  const char *corpus;
+  const char *script;
+
+  struct benchKey *keys;
+  int nkeys, capkeys, pos;
+  int exhausted;
+
+  struct benchOp ops[BENCH_MAX_OPS];
+  int nops;
+  int curop;
+
+  int sample_op;
+  struct timespec sample_start;
+  long sample_bytes;
+};
+
+struct benchState B;
+
+/*~~~~~~~~~~~~~~~~~~~~ virtual terminal ~~~~~~~~~~~~~~~~~~~~~~*/
+
+static double benchElapsedUs(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) / 1e3;
+}
+
+static void benchRecord(int op, double us, long bytes) {
+  struct benchOp *o = &B.ops[op];
+  if (o->n == o->cap) {
+    o->cap = o->cap ? o->cap * 2 : 256;
+    o->lat = realloc(o->lat, sizeof(double) * o->cap);
+    o->bytes = realloc(o->bytes, sizeof(long) * o->cap);
+  }
+  o->lat[o->n] = us;
+  o->bytes[o->n] = bytes;
+  o->n++;
+}
+
+static void benchCloseSample() {
+  if (B.sample_op < 0)
+    return;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  benchRecord(B.sample_op, benchElapsedUs(&B.sample_start, &now),
+              B.sample_bytes);
+  B.sample_op = -1;
+}
+
+int termRead(char *c) {
+  if (B.pos >= B.nkeys) {
+    benchCloseSample();
+    B.exhausted = 1;
+    *c = ESC;
+    return 1;
+  }
+
+  struct benchKey *k = &B.keys[B.pos++];
+  if (k->op >= 0) {
+    benchCloseSample();
+    B.sample_op = k->op;
+    B.sample_bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &B.sample_start);
+  }
+  if (k->byte == BENCH_PAUSE)
+    return 0;
+
+  *c = k->byte;
+  return 1;
+}
+
+void termWrite(const char *s, int len) {
+  (void)s;
+  B.sample_bytes += len;
+}
+
+int getWindowSize(int *rows, int *cols) {
+  *rows = B.rows;
+  *cols = B.cols;
+  return 0;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ script ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static void benchPush(int byte, int op) {
+  if (B.nkeys == B.capkeys) {
+    B.capkeys = B.capkeys ? B.capkeys * 2 : 4096;
+    B.keys = realloc(B.keys, sizeof(struct benchKey) * B.capkeys);
+  }
+  B.keys[B.nkeys].byte = byte;
+  B.keys[B.nkeys].op = op;
+  B.nkeys++;
+}
+
+static void benchPushSeq(const char *seq) {
+  benchPush((unsigned char)seq[0], B.curop);
+  for (int i = 1; seq[i]; ++i)
+    benchPush((unsigned char)seq[i], -1);
+}
+
+static int benchOpIndex(const char *name) {
+  for (int i = 0; i < B.nops; ++i)
+    if (!strcmp(B.ops[i].name, name))
+      return i;
+  if (B.nops == BENCH_MAX_OPS) {
+    fprintf(stderr, "tibench: too many operations\n");
+    exit(1);
+  }
+  snprintf(B.ops[B.nops].name, sizeof(B.ops[B.nops].name), "%s", name);
+  return B.nops++;
+}
+
+static void benchQueueText(const char *s) {
+  static const struct {
+    const char *name;
+    const char *seq;
+  } names[] = {
+      {"cr", "\r"},         {"tab", "\t"},        {"bs", "\x7f"},
+      {"del", "\x1b[3~"},   {"up", "\x1b[A"},     {"down", "\x1b[B"},
+      {"right", "\x1b[C"},  {"left", "\x1b[D"},   {"home", "\x1b[H"},
+      {"end", "\x1b[F"},    {"pgup", "\x1b[5~"},  {"pgdn", "\x1b[6~"},
+      {"lt", "<"},
+  };
+
+  while (*s) {
+    const char *close = (*s == '<') ? strchr(s, '>') : NULL;
+    if (close) {
+      int len = close - s - 1;
+      const char *name = s + 1;
+      int done = 1;
+      if (len == 3 && !strncmp(name, "esc", 3)) {
+        benchPush(ESC, B.curop);
+        benchPush(BENCH_PAUSE, -1);
+      } else if (len == 3 && name[0] == 'C' && name[1] == '-') {
+        benchPush(CTRL_KEY(name[2]), B.curop);
+      } else {
+        done = 0;
+        for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+          if ((int)strlen(names[i].name) == len &&
+              !strncmp(name, names[i].name, len)) {
+            benchPushSeq(names[i].seq);
+            done = 1;
+            break;
+          }
+        }
+      }
+      if (done) {
+        s = close + 1;
+        continue;
+      }
+    }
+    benchPush((unsigned char)*s++, B.curop);
+  }
+}
+
+static char *benchPath(const char *file) {
+  static char path[8192];
+  if (file[0] == '/' || B.corpus == NULL)
+    snprintf(path, sizeof(path), "%s", file);
+  else
+    snprintf(path, sizeof(path), "%s/%s", B.corpus, file);
+  return path;
+}
+
+static void benchQueuePaste(const char *arg) {
+  char file[4096];
+  long limit = -1;
+  if (sscanf(arg, "%4095s %ld", file, &limit) < 1)
+    return;
+
+  FILE *fp = fopen(benchPath(file), "r");
+  if (!fp) {
+    fprintf(stderr, "tibench: paste %s: %s\n", file, strerror(errno));
+    exit(1);
+  }
+  int ch;
+  while ((limit < 0 || limit-- > 0) && (ch = fgetc(fp)) != EOF) {
+    if (ch == '\r')
+      continue;
+    benchPush(ch == '\n' ? '\r' : ch, B.curop);
+  }
+  fclose(fp);
+}
+
+static void benchResetBuffer() {
+  if (P.p)
+    editorPagerClose();
+  tiBufferClear(E.buf);
+  E.cx = E.cy = E.rx = 0;
+  E.rowoff = E.coloff = 0;
+}
+
+/* Replay whatever has been queued so far through the regular main loop. */
+static void benchDrain() {
+  while (B.pos < B.nkeys && !B.exhausted) {
+    editorProcessKeypress();
+    editorRefreshScreen();
+  }
+  benchCloseSample();
+  B.exhausted = 0;
+}
+
+static void benchOpen(const char *file) {
+  benchDrain();
+  benchResetBuffer();
+
+  int op = benchOpIndex("open");
+  struct timespec start, end;
+  B.sample_bytes = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  editorOpen(benchPath(file));
+  editorRefreshScreen();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  benchRecord(op, benchElapsedUs(&start, &end), B.sample_bytes);
+}
+
+static void benchReopen(const char *file) {
+  benchDrain();
+
+  // the session is kept in a directory of its own while it is used
+  char dir[] = "/tmp/tibench.XXXXXX";
+  char *cache = getenv("XDG_CACHE_HOME");
+  cache = cache ? strdup(cache) : NULL;
+  if (mkdtemp(dir) == NULL || setenv("XDG_CACHE_HOME", dir, 1) == -1) {
+    fprintf(stderr, "tibench: reopen: %s\n", strerror(errno));
+    exit(1);
+  }
+  E.session = 1;
+  benchResetBuffer();
+  editorOpen(benchPath(file));
+  editorSessionSave(E.curbuf);
+  benchResetBuffer();
+
+  int op = benchOpIndex("reopen");
+  struct timespec start, end;
+  B.sample_bytes = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  editorOpen(benchPath(file));
+  editorRefreshScreen();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  benchRecord(op, benchElapsedUs(&start, &end), B.sample_bytes);
+
+  char *spath = tiSessionPath(benchPath(file));
+  if (spath)
+    unlink(spath);
+  free(spath);
+  char sub[sizeof(dir) + 16];
+  snprintf(sub, sizeof(sub), "%s/ti/sessions", dir);
+  rmdir(sub);
+  snprintf(sub, sizeof(sub), "%s/ti", dir);
+  rmdir(sub);
+  rmdir(dir);
+  if (cache)
+    setenv("XDG_CACHE_HOME", cache, 1);
+  else
+    unsetenv("XDG_CACHE_HOME");
+  free(cache);
+  E.session = 0;
+}
+
+static void benchView(const char *file) {
+  benchDrain();
+  benchResetBuffer();
+
+  int op = benchOpIndex("view");
+  struct timespec start, end;
+  B.sample_bytes = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (editorPagerOpen(benchPath(file)) == -1) {
+    fprintf(stderr, "tibench: %s: %s\n", file, strerror(errno));
+    exit(1);
+  }
+  editorRefreshScreen();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  benchRecord(op, benchElapsedUs(&start, &end), B.sample_bytes);
+}
+
+#define BENCH_INDEX_RUNS 5
+
+static double benchIndexRun(const char *map, size_t len, int threads,
+                            size_t *lines) {
+  double best = 0;
+  for (int i = 0; i < BENCH_INDEX_RUNS; ++i) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t *nl = tiIndexNewlines(map, len, lines, threads);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    memFree(nl);
+    double us = benchElapsedUs(&start, &end);
+    benchRecord(benchOpIndex("index"), us, 0);
+    if (i == 0 || us < best)
+      best = us;
+  }
+  return best;
+}
+
+static void benchIndex(char *arg) {
+  char *file = strtok(arg, " \t");
+  char *n = strtok(NULL, " \t");
+  int threads = n ? atoi(n) : 0;
+  if (file == NULL) {
+    fprintf(stderr, "tibench: index needs a file\n");
+    exit(1);
+  }
+
+  int fd = open(benchPath(file), O_RDONLY);
+  struct stat st;
+  char *map = MAP_FAILED;
+  if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "tibench: %s: %s\n", file, strerror(errno));
+    exit(1);
+  }
+
+  // the first pass also faults the file in, only the best run is reported
+  size_t lines;
+  double one = benchIndexRun(map, st.st_size, 1, &lines);
+  double all = benchIndexRun(map, st.st_size, threads, &lines);
+  if (threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  printf("index %s: %zu lines in %.1f MB, 1 thread %.2f GB/s, %d threads "
+         "%.2f GB/s\n",
+         file, lines, st.st_size / 1e6, st.st_size / one / 1e3, threads,
+         st.st_size / all / 1e3);
+  munmap(map, st.st_size);
+  close(fd);
+}
+
+// the FILEs of an export line, exported once per format and thread count
+static void benchExport(char *arg) {
+  char *files[64];
+  int n = 0;
+  long long bytes = 0;
+  for (char *f = strtok(arg, " \t"); f && n < 64; f = strtok(NULL, " \t")) {
+    struct stat st;
+    files[n] = strdup(benchPath(f));
+    if (stat(files[n], &st) == -1) {
+      fprintf(stderr, "tibench: %s: %s\n", f, strerror(errno));
+      exit(1);
+    }
+    bytes += st.st_size;
+    n++;
+  }
+  if (n == 0) {
+    fprintf(stderr, "tibench: export needs a file\n");
+    exit(1);
+  }
+
+  int out = open("/dev/null", O_WRONLY);
+  int errs[64];
+  int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  static const char *formats[] = {"cat", "html"};
+  for (int format = TI_EXPORT_ANSI; format <= TI_EXPORT_HTML; ++format) {
+    double us[2];
+    for (int k = 0; k < 2; ++k) {
+      struct timespec start, end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      if (tiExport(files, n, format, out, k ? 0 : 1, errs)) {
+        fprintf(stderr, "tibench: export failed\n");
+        exit(1);
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      us[k] = benchElapsedUs(&start, &end);
+      benchRecord(benchOpIndex("export"), us[k], 0);
+    }
+    printf("export --%s: %d files in %.1f MB, 1 thread %.1f MB/s, %d threads "
+           "%.1f MB/s\n",
+           formats[format], n, bytes / 1e6, bytes / us[0], cpus,
+           bytes / us[1]);
+  }
+  close(out);
+  for (int i = 0; i < n; ++i)
+    free(files[i]);
+}
+
+static char *benchReadFile(const char *path, size_t *len) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  char *buf = NULL;
+  *len = 0;
+  if (fd != -1 && fstat(fd, &st) == 0 && (buf = memAlloc(MEM_IO, st.st_size + 1))) {
+    while (*len < (size_t)st.st_size) {
+      ssize_t n = read(fd, buf + *len, st.st_size - *len);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      *len += n;
+    }
+  }
+  if (fd != -1)
+    close(fd);
+  return buf;
+}
+
+// the current buffer against the file it was read from, or that file with
+// the buffer's journal replayed into a buffer of its own
+static void benchVerify(const char *what, const char *script, int lineno) {
+  benchDrain();
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  if (eb->path == NULL) {
+    fprintf(stderr, "tibench: %s:%d: verify needs an open file\n", script,
+            lineno);
+    exit(1);
+  }
+
+  size_t len, want;
+  char *have = tiRowsToString(E.buf, &len);
+  char *expect = NULL;
+  int replayed = 0;
+  if (!strcmp(what, "file")) {
+    expect = benchReadFile(eb->path, &want);
+  } else if (!strcmp(what, "journal")) {
+    if (E.buf->journal == NULL) {
+      fprintf(stderr, "tibench: %s:%d: %s has no journal\n", script, lineno,
+              E.buf->filename);
+      exit(1);
+    }
+    // closed as a crash would leave it, then recovered like on next open
+    tiJournalClose(E.buf->journal, 1);
+    E.buf->journal = NULL;
+    char *jpath = editorJournalPath(eb->path);
+    tiBuffer *b = tiBufferNew();
+    if (tiOpen(b, eb->path) == -1 ||
+        tiJournalOpen(b, jpath, &eb->disk, &replayed) == NULL) {
+      fprintf(stderr, "tibench: %s:%d: can't replay %s: %s\n", script, lineno,
+              jpath, strerror(errno));
+      exit(1);
+    }
+    expect = tiRowsToString(b, &want);
+    tiBufferFree(b);
+    unlink(jpath);
+    free(jpath);
+  } else {
+    fprintf(stderr, "tibench: %s:%d: verify file or verify journal\n", script,
+            lineno);
+    exit(1);
+  }
+  if (have == NULL || expect == NULL) {
+    fprintf(stderr, "tibench: %s:%d: %s\n", script, lineno, strerror(ENOMEM));
+    exit(1);
+  }
+
+  size_t at = 0;
+  while (at < len && at < want && have[at] == expect[at])
+    at++;
+  if (at < len || at < want) {
+    fprintf(stderr,
+            "tibench: %s:%d: verify %s: buffer of %zu bytes differs from "
+            "the %zu expected at byte %zu\n",
+            script, lineno, what, len, want, at);
+    exit(1);
+  }
+  if (replayed)
+    printf("verify journal: %zu bytes match after replaying %d edits\n", len,
+           replayed);
+  else
+    printf("verify %s: %zu bytes match, %zu blocks packed\n", what, len,
+           tiCold.blocks);
+  memFree(have);
+  memFree(expect);
+}
+
+static void benchRunScript(const char *script) {
+  FILE *fp = fopen(script, "r");
+  if (!fp) {
+    fprintf(stderr, "tibench: %s: %s\n", script, strerror(errno));
+    exit(1);
+  }
+
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t linelen;
+  int lineno = 0;
+  while ((linelen = getline(&line, &linecap, fp)) != -1) {
+    lineno++;
+    line[strcspn(line, "\r\n")] = '\0';
+    char *cmd = line + strspn(line, " \t");
+    if (*cmd == '\0' || *cmd == '#')
+      continue;
+
+    char *arg = cmd + strcspn(cmd, " \t");
+    if (*arg)
+      *arg++ = '\0';
+
+    if (!strcmp(cmd, "open")) {
+      benchOpen(arg);
+    } else if (!strcmp(cmd, "reopen")) {
+      benchReopen(arg);
+    } else if (!strcmp(cmd, "view")) {
+      benchView(arg);
+    } else if (!strcmp(cmd, "index")) {
+      benchIndex(arg);
+    } else if (!strcmp(cmd, "export")) {
+      benchExport(arg);
+    } else if (!strcmp(cmd, "op")) {
+      B.curop = benchOpIndex(arg);
+    } else if (!strcmp(cmd, "keys")) {
+      benchQueueText(arg);
+    } else if (!strcmp(cmd, "repeat")) {
+      char *text;
+      long times = strtol(arg, &text, 10);
+      text += strspn(text, " \t");
+      while (times-- > 0)
+        benchQueueText(text);
+    } else if (!strcmp(cmd, "paste")) {
+      benchQueuePaste(arg);
+    } else if (!strcmp(cmd, "journal")) {
+      benchDrain();
+      E.journal = strcmp(arg, "off") != 0;
+    } else if (!strcmp(cmd, "verify")) {
+      benchVerify(arg, script, lineno);
+    } else if (!strcmp(cmd, "idle")) {
+      long times = strtol(arg, NULL, 10);
+      while (times-- > 0)
+        benchPush(BENCH_PAUSE, B.curop);
+    } else {
+      fprintf(stderr, "tibench: %s:%d: unknown command '%s'\n", script,
+              lineno, cmd);
+      exit(1);
+    }
+  }
+
+  free(line);
+  fclose(fp);
+  benchDrain();
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ report ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int benchCmpDouble(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double benchPercentile(double *sorted, int n, double p) {
+  int i = (int)(p / 100.0 * (n - 1) + 0.5);
+  return sorted[i];
+}
+
+static void benchReport() {
+  benchCloseSample();
+
+  printf("%s (%dx%d virtual terminal)\n", B.script, B.rows, B.cols);
+  printf("%-10s %7s %10s %10s %10s %10s %10s %10s\n", "op", "keys",
+         "p50 us", "p90 us", "p99 us", "max us", "bytes/key", "max bytes");
+  for (int i = 0; i < B.nops; ++i) {
+    struct benchOp *o = &B.ops[i];
+    if (o->n == 0)
+      continue;
+
+    long total = 0, maxbytes = 0;
+    for (int j = 0; j < o->n; ++j) {
+      total += o->bytes[j];
+      if (o->bytes[j] > maxbytes)
+        maxbytes = o->bytes[j];
+    }
+    qsort(o->lat, o->n, sizeof(double), benchCmpDouble);
+    printf("%-10s %7d %10.1f %10.1f %10.1f %10.1f %10ld %10ld\n", o->name,
+           o->n, benchPercentile(o->lat, o->n, 50),
+           benchPercentile(o->lat, o->n, 90), benchPercentile(o->lat, o->n, 99),
+           o->lat[o->n - 1], total / o->n, maxbytes);
+  }
+
+  char live[16], peak[16];
+  printf("memory:");
+  for (int i = 0; i < MEM_COUNT; ++i) {
+    memFormat(live, sizeof(live), tiMem.cat[i].live);
+    memFormat(peak, sizeof(peak), tiMem.cat[i].peak);
+    printf(" %s %s/%s", memNames[i], live, peak);
+  }
+  printf(" (live/peak)\n");
+  memFormat(live, sizeof(live), tiHl.shared);
+  printf("hl cache: %.1f%% hits of %llu lookups, %zu entries, %s shared, "
+         "%llu evicted\n",
+         tiHl.lookups ? 100.0 * tiHl.hits / tiHl.lookups : 0.0,
+         (unsigned long long)tiHl.lookups, tiHl.entries, live,
+         (unsigned long long)tiHl.evictions);
+  if (tiIntern.lookups) {
+    memFormat(live, sizeof(live), tiIntern.bytes + tiIntern.overhead);
+    memFormat(peak, sizeof(peak),
+              tiIntern.saved > tiIntern.overhead
+                  ? tiIntern.saved - tiIntern.overhead
+                  : 0);
+    printf("intern: %zu lines in %s, %s saved\n", tiIntern.entries, live,
+           peak);
+  }
+  if (tiCold.blocks) {
+    memFormat(live, sizeof(live), tiCold.raw);
+    memFormat(peak, sizeof(peak), tiCold.packed);
+    printf("cold: %zu blocks, %s packed into %s, %.1f%% cache hits\n",
+           tiCold.blocks, live, peak,
+           tiCold.reads ? 100.0 * tiCold.hits / tiCold.reads : 0.0);
+  }
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  printf("peak RSS: %ld KB\n\n", ru.ru_maxrss);
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  B.rows = 50;
+  B.cols = 160;
+  B.curop = -1;
+  B.sample_op = -1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:d:")) != -1) {
+    switch (opt) {
+    case 's':
+      if (sscanf(optarg, "%dx%d", &B.rows, &B.cols) != 2 || B.rows < 3 ||
+          B.cols < 1) {
+        fprintf(stderr, "tibench: bad size '%s'\n", optarg);
+        return 1;
+      }
+      break;
+    case 'd':
+      B.corpus = optarg;
+      break;
+    default:
+      fprintf(stderr,
+              "usage: tibench [-s ROWSxCOLS] [-d CORPUSDIR] script.tis\n");
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: tibench [-s ROWSxCOLS] [-d CORPUSDIR] script.tis\n");
+    return 1;
+  }
+
+  B.script = argv[optind];
+  B.curop = benchOpIndex("keys");
+
+  /* editorExit() leaves through exit(), so report from an atexit handler */
+  atexit(benchReport);
+  initEditor();
+  editorInitWindows();
+  benchRunScript(B.script);
+  return 0;
+}
@@ -0,0 +1,1071 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ buffers ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+tiBuffer *tiBufferNew(void) {
+  tiBuffer *b = calloc(1, sizeof(tiBuffer));
+  return b;
+}
+
+// bytes a snapshot being written still reads are left to it to free,
+// interned and cold ones are held by the snapshot itself
+static void tiDropChars(tiBuffer *b, erow *row) {
+  if (row->cold)
+    tiColdRelease(row->cold);
+  else if (row->interned)
+    tiInternRelease(row->chars);
+  else if (b->snapshot && row->gen != b->snapgen)
+    tiSnapshotRetire(b->snapshot, row->chars);
+  else
+    memFree(row->chars);
+  row->chars = NULL;
+  row->cold = NULL;
+  row->interned = 0;
+}
+
+// called before a row's bytes are changed in place, unpacks cold rows
+static void tiRowOwn(tiBuffer *b, erow *row) {
+  if (!row->cold && !row->interned &&
+      (b->snapshot == NULL || row->gen == b->snapgen))
+    return;
+  char *chars = memAlloc(MEM_CHARS, row->size + 1);
+  memcpy(chars, tiRowChars(row), row->size + 1);
+  tiDropChars(b, row);
+  row->chars = chars;
+  row->gen = b->snapgen;
+}
+
+// gives a new row its bytes, from the intern pool if the buffer uses it
+static void tiRowSetChars(tiBuffer *b, erow *row, const char *s, size_t len) {
+  row->chars = b->intern ? tiInternAcquire(s, len) : NULL;
+  row->interned = row->chars != NULL;
+  row->cold = NULL;
+  if (row->chars == NULL) {
+    row->chars = memAlloc(MEM_CHARS, len + 1);
+    memcpy(row->chars, s, len);
+    row->chars[len] = '\0';
+  }
+  row->size = len;
+  row->gen = b->snapgen;
+}
+
+static void tiDropRow(tiBuffer *b, erow *row) {
+  tiDropChars(b, row);
+  tiFreeRow(row);
+}
+
+void tiBufferClear(tiBuffer *b) {
+  for (int j = 0; j < b->numrows; ++j)
+    tiDropRow(b, &b->row[j]);
+  memFree(b->row);
+  b->row = NULL;
+  b->numrows = 0;
+  b->rowcap = 0;
+  b->edits++;
+}
+
+static size_t tiRowDropCaches(erow *row) {
+  size_t freed = 0;
+  if (row->render) {
+    freed += row->rsize + 1;
+    memFree(row->render);
+    row->render = NULL;
+  }
+  if (row->hl) {
+    freed += row->rsize;
+    tiHlRelease(row->hl);
+    row->hl = NULL;
+  }
+  return freed;
+}
+
+size_t tiBufferDropCaches(tiBuffer *b) {
+  size_t freed = 0;
+  for (int j = 0; j < b->numrows; ++j)
+    freed += tiRowDropCaches(&b->row[j]);
+  return freed;
+}
+
+size_t tiBufferIntern(tiBuffer *b, int on) {
+  size_t moved = 0;
+  b->intern = on;
+  for (int j = 0; on && j < b->numrows; ++j) {
+    erow *row = &b->row[j];
+    if (row->interned || row->cold)
+      continue;
+    char *chars = tiInternAcquire(row->chars, row->size);
+    if (chars == NULL)
+      break;
+    tiDropChars(b, row);
+    row->chars = chars;
+    row->interned = 1;
+    moved++;
+  }
+  return moved;
+}
+
+// packs rows [from, to) into one block, -1 if out of memory
+static int tiFreezeRows(tiBuffer *b, int from, int to, size_t len) {
+  char *raw = memAlloc(MEM_COLD, len);
+  if (raw == NULL)
+    return -1;
+  size_t off = 0;
+  for (int j = from; j < to; ++j) {
+    memcpy(raw + off, tiRowChars(&b->row[j]), b->row[j].size + 1);
+    off += b->row[j].size + 1;
+  }
+  tiColdBlock *c = tiColdPack(raw, len, to - from);
+  memFree(raw);
+  if (c == NULL)
+    return -1;
+
+  off = 0;
+  for (int j = from; j < to; ++j) {
+    erow *row = &b->row[j];
+    tiDropChars(b, row);
+    row->cold = c;
+    row->coldoff = off;
+    off += row->size + 1;
+  }
+  return 0;
+}
+
+size_t tiBufferFreeze(tiBuffer *b, int from, int to) {
+  size_t frozen = 0;
+  int j = 0;
+  while (j < b->numrows) {
+    if (j >= from && j < to) {
+      j = to;
+      continue;
+    }
+    if (b->row[j].cold && !tiColdSparse(b->row[j].cold)) {
+      tiRowDropCaches(&b->row[j++]);
+      continue;
+    }
+
+    // a run of rows not packed yet, or left over in blocks most of whose
+    // rows were unpacked since, up to the edge of the kept range
+    int end = j < from ? from : b->numrows;
+    int start = j;
+    size_t len = 0;
+    for (; j < end && j - start < TI_COLD_ROWS && len < TI_COLD_BLOCK; ++j) {
+      erow *row = &b->row[j];
+      if (row->cold && !tiColdSparse(row->cold))
+        break;
+      tiRowDropCaches(row);
+      len += row->size + 1;
+    }
+    if (tiFreezeRows(b, start, j, len) == 0)
+      frozen += j - start;
+  }
+  return frozen;
+}
+
+void tiBufferFree(tiBuffer *b) {
+  if (b == NULL)
+    return;
+  tiSnapshotRelease(b, b->snapshot);
+  tiBufferClear(b);
+  tiJournalClose(b->journal, 1);
+  free(b->filename);
+  free(b);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ row operations ~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+const char *tiRowChars(erow *row) {
+  if (row->chars || row->cold == NULL)
+    return row->chars;
+  const char *raw = tiColdRead(row->cold);
+  return raw ? raw + row->coldoff : NULL;
+}
+
+int tiRowCxToRx(erow *row, int cx) {
+  const char *chars = tiRowChars(row);
+  int rx = 0;
+  int j;
+  for (j = 0; j < cx; ++j) {
+    if (chars[j] == '\t')
+      rx += (TI_TAB_STOP - 1) - (rx % TI_TAB_STOP);
+    rx++;
+  }
+
+  return rx;
+}
+
+int tiRowRxToCx(erow *row, int rx) {
+  const char *chars = tiRowChars(row);
+  int cur_rx = 0;
+  int cx;
+  for (cx = 0; cx < row->size; ++cx) {
+    if (chars[cx] == '\t')
+      cur_rx += (TI_TAB_STOP - 1) - (cur_rx % TI_TAB_STOP);
+    cur_rx++;
+    if (cur_rx > rx)
+      return cx;
+  }
+
+  return cx;
+}
+
+static int tiRenderTabs(const char *chars, int size) {
+  int tabs = 0;
+  for (int j = 0; j < size; ++j)
+    if (chars[j] == '\t')
+      tabs++;
+  return tabs;
+}
+
+// expands the tabs of chars into render, which holds size plus
+// (TI_TAB_STOP - 1) per tab bytes and a NUL. Returns the rendered length
+static int tiRenderInto(const char *chars, int size, char *render) {
+  int idx = 0;
+  for (int j = 0; j < size; ++j) {
+    if (chars[j] == '\t') {
+      render[idx++] = ' ';
+      while (idx % TI_TAB_STOP != 0)
+        render[idx++] = ' ';
+    } else {
+      render[idx++] = chars[j];
+    }
+  }
+
+  render[idx] = '\0';
+  return idx;
+}
+
+void tiRenderRow(erow *row) {
+  const char *chars = tiRowChars(row);
+  int tabs = tiRenderTabs(chars, row->size);
+  memFree(row->render);
+
+  row->render = memAlloc(MEM_RENDER, row->size + tabs * (TI_TAB_STOP - 1) + 1);
+  row->rsize = tiRenderInto(chars, row->size, row->render);
+}
+
+void tiUpdateRow(tiBuffer *b, erow *row) {
+  tiRenderRow(row);
+  tiUpdateSyntax(b, row);
+}
+
+// inside a batch the row is only marked, and rendered and highlighted once
+// by tiBufferBatchEnd however many times it changed
+static void tiRowChanged(tiBuffer *b, erow *row) {
+  if (!b->batch) {
+    tiUpdateRow(b, row);
+    return;
+  }
+  tiRowDropCaches(row);
+  row->stale = 1;
+  if (row->idx < b->batchlo)
+    b->batchlo = row->idx;
+  if (row->idx > b->batchhi)
+    b->batchhi = row->idx;
+}
+
+void tiBufferBatchBegin(tiBuffer *b) {
+  if (b->batch++)
+    return;
+  b->batchlo = b->numrows;
+  b->batchhi = -1;
+}
+
+void tiBufferBatchEnd(tiBuffer *b) {
+  if (b->batch == 0 || --b->batch)
+    return;
+  for (int j = b->batchlo; j <= b->batchhi && j < b->numrows; ++j) {
+    erow *row = &b->row[j];
+    if (!row->stale)
+      continue;
+    row->stale = 0;
+    if (row->render == NULL)
+      tiRenderRow(row);
+    tiUpdateSyntax(b, row);
+  }
+}
+
+erow *tiRowEnsure(tiBuffer *b, erow *row) {
+  if (row->render == NULL)
+    tiRenderRow(row);
+  // the comment state of every row survives tiBufferDropCaches, so the
+  // row can be highlighted on its own without touching its neighbours.
+  // Rows changed in a batch wait for its end
+  if (row->hl == NULL && !row->stale)
+    tiHighlightRow(b, row);
+  return row;
+}
+
+void tiInsertRow(tiBuffer *b, int at, const char *s, size_t len) {
+  if (at < 0 || at > b->numrows)
+    return;
+  if (b->journal)
+    tiJournalRecord(b->journal, TI_JOURNAL_INSERT_ROW, at, 0, s, len);
+
+  if (b->numrows == b->rowcap) {
+    b->rowcap = b->rowcap ? b->rowcap * 2 : 64;
+    b->row = memRealloc(MEM_ROWS, b->row, sizeof(erow) * b->rowcap);
+  }
+  memmove(&b->row[at + 1], &b->row[at], sizeof(erow) * (b->numrows - at));
+  for (int j = at + 1; j <= b->numrows; ++j)
+    b->row[j].idx++;
+  if (b->batch && at <= b->batchhi)
+    b->batchhi++;
+  if (b->batch && at < b->batchlo)
+    b->batchlo++;
+
+  b->row[at].idx = at;
+  tiRowSetChars(b, &b->row[at], s, len);
+  b->row[at].rsize = 0;
+  b->row[at].render = NULL;
+  b->row[at].hl = NULL;
+  b->row[at].hl_open_comment = 0;
+  b->row[at].stale = 0;
+  b->numrows++;
+  tiRowChanged(b, &b->row[at]);
+
+  b->dirty++;
+  b->edits++;
+}
+
+void tiFreeRow(erow *row) {
+  memFree(row->render);
+  if (row->cold)
+    tiColdRelease(row->cold);
+  else if (row->interned)
+    tiInternRelease(row->chars);
+  else
+    memFree(row->chars);
+  tiHlRelease(row->hl);
+}
+
+void tiDelRow(tiBuffer *b, int at) {
+  if (at < 0 || at >= b->numrows)
+    return;
+  if (b->journal)
+    tiJournalRecord(b->journal, TI_JOURNAL_DEL_ROW, at, 0, NULL, 0);
+  tiDropRow(b, &b->row[at]);
+  memmove(&b->row[at], &b->row[at + 1], sizeof(erow) * (b->numrows - at - 1));
+  for (int j = at; j < b->numrows - 1; ++j)
+    b->row[j].idx--;
+  b->numrows--;
+  if (b->batch && at <= b->batchhi)
+    b->batchhi--;
+  if (b->batch && at < b->batchlo)
+    b->batchlo--;
+  b->dirty++;
+  b->edits++;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ bulk row operations ~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// marks a row rewritten by a bulk operation, which runs as a batch
+static void tiRowTouched(tiBuffer *b, int at) {
+  tiRowDropCaches(&b->row[at]);
+  b->row[at].stale = 1;
+  if (at < b->batchlo)
+    b->batchlo = at;
+  if (at > b->batchhi)
+    b->batchhi = at;
+}
+
+static void tiRenumber(tiBuffer *b, int from) {
+  for (int j = from; j < b->numrows; ++j)
+    b->row[j].idx = j;
+}
+
+void tiSplitRows(tiBuffer *b, const int *rows, const int *cols, int n) {
+  if (n <= 0 || rows[0] < 0 || rows[n - 1] >= b->numrows)
+    return;
+  if (b->numrows + n + 1 > b->rowcap) {
+    int cap = b->numrows + n + 1;
+    b->rowcap = cap > b->rowcap * 2 ? cap : b->rowcap * 2;
+    b->row = memRealloc(MEM_ROWS, b->row, sizeof(erow) * b->rowcap);
+  }
+  tiBufferBatchBegin(b);
+
+  // recorded as the splits one at a time would have been: the rest of the
+  // row from the cut goes in a new row, then the row is cut short
+  for (int i = 0, prev = 0; b->journal && i < n; ++i) {
+    erow *row = &b->row[rows[i]];
+    int cut = cols[i] < row->size ? cols[i] : row->size;
+    int from = (i && rows[i - 1] == rows[i]) ? prev : 0;
+    tiJournalRecord(b->journal, TI_JOURNAL_INSERT_ROW, rows[i] + i + 1, 0,
+                    tiRowChars(row) + cut, row->size - cut);
+    tiJournalRecord(b->journal, TI_JOURNAL_TRUNCATE, rows[i] + i, cut - from,
+                    NULL, 0);
+    prev = cut;
+  }
+
+  // from the end, moving the rows between cut rows up as blocks, so every
+  // row moves once
+  int k = n;
+  for (int j = b->numrows - 1; k > 0;) {
+    int r = rows[k - 1];
+    int out = j + 1 + k;
+    if (j > r) {
+      memmove(&b->row[out - (j - r)], &b->row[r + 1], sizeof(erow) * (j - r));
+      j = r;
+      continue;
+    }
+
+    int first = k - 1;
+    while (first > 0 && rows[first - 1] == r)
+      first--;
+    erow head = b->row[r];
+    const char *chars = tiRowChars(&head);
+    for (int c = k - 1; c >= first; --c) {
+      int from = cols[c] < head.size ? cols[c] : head.size;
+      int to = c + 1 < k && cols[c + 1] < head.size ? cols[c + 1] : head.size;
+      erow *piece = &b->row[--out];
+      memset(piece, 0, sizeof(erow));
+      tiRowSetChars(b, piece, chars + from, to > from ? to - from : 0);
+    }
+    erow *row = &b->row[--out];
+    *row = head;
+    int cut = cols[first] < head.size ? cols[first] : head.size;
+    if (cut < row->size) {
+      tiRowOwn(b, row);
+      row->size = cut;
+      row->chars[cut] = '\0';
+    }
+    k = first;
+    j = r - 1;
+  }
+  b->numrows += n;
+  tiRenumber(b, rows[0]);
+
+  for (int i = 0; i < n; ++i) {
+    tiRowTouched(b, rows[i] + i);
+    tiRowTouched(b, rows[i] + i + 1);
+  }
+  b->dirty++;
+  b->edits++;
+  tiBufferBatchEnd(b);
+}
+
+void tiJoinRows(tiBuffer *b, const int *rows, int n) {
+  if (n <= 0 || rows[0] <= 0 || rows[n - 1] >= b->numrows)
+    return;
+  tiBufferBatchBegin(b);
+
+  // one pass compacting the rows left, each joined row goes onto the last
+  // one kept
+  int out = rows[0];
+  int k = 0;
+  for (int j = rows[0]; j < b->numrows; ++j) {
+    erow *row = &b->row[j];
+    if (k < n && rows[k] == j) {
+      erow *prev = &b->row[out - 1];
+      if (b->journal) {
+        tiJournalRecord(b->journal, TI_JOURNAL_APPEND, out - 1, 0,
+                        tiRowChars(row), row->size);
+        tiJournalRecord(b->journal, TI_JOURNAL_DEL_ROW, out, 0, NULL, 0);
+      }
+      tiRowOwn(b, prev);
+      prev->chars = memRealloc(MEM_CHARS, prev->chars, prev->size + row->size + 1);
+      memcpy(&prev->chars[prev->size], tiRowChars(row), row->size);
+      prev->size += row->size;
+      prev->chars[prev->size] = '\0';
+      prev->idx = out - 1;
+      tiRowTouched(b, out - 1);
+      tiDropRow(b, row);
+      k++;
+      continue;
+    }
+    if (out != j)
+      b->row[out] = *row;
+    out++;
+  }
+  b->numrows = out;
+  tiRenumber(b, rows[0]);
+  if (b->batchhi >= b->numrows)
+    b->batchhi = b->numrows - 1;
+  b->dirty++;
+  b->edits++;
+  tiBufferBatchEnd(b);
+}
+
+void tiDelRows(tiBuffer *b, const int *rows, int n) {
+  if (n <= 0 || rows[0] < 0 || rows[n - 1] >= b->numrows)
+    return;
+  tiBufferBatchBegin(b);
+  int out = rows[0];
+  int k = 0;
+  for (int j = rows[0]; j < b->numrows; ++j) {
+    if (k < n && rows[k] == j) {
+      if (b->journal)
+        tiJournalRecord(b->journal, TI_JOURNAL_DEL_ROW, out, 0, NULL, 0);
+      tiDropRow(b, &b->row[j]);
+      k++;
+      continue;
+    }
+    if (out != j)
+      b->row[out] = b->row[j];
+    out++;
+  }
+  b->numrows = out;
+  tiRenumber(b, rows[0]);
+  // the row after each removed one starts in a different comment state
+  for (int i = 0; i < n && rows[i] - i < b->numrows; ++i)
+    tiRowTouched(b, rows[i] - i);
+  if (b->batchhi >= b->numrows)
+    b->batchhi = b->numrows - 1;
+  b->dirty++;
+  b->edits++;
+  tiBufferBatchEnd(b);
+}
+
+void tiReplaceRows(tiBuffer *b, int at, int n, tiBuffer *src) {
+  int m = src->numrows;
+  if (at < 0 || n < 0 || at + n > b->numrows)
+    return;
+  if (b->numrows - n + m + 1 > b->rowcap) {
+    int cap = b->numrows - n + m + 1;
+    b->rowcap = cap > b->rowcap * 2 ? cap : b->rowcap * 2;
+    b->row = memRealloc(MEM_ROWS, b->row, sizeof(erow) * b->rowcap);
+  }
+  tiBufferBatchBegin(b);
+  // rows after the range keep their place in an enclosing batch
+  if (b->batchlo >= at + n)
+    b->batchlo += m - n;
+  if (b->batchhi >= at + n)
+    b->batchhi += m - n;
+
+  if (b->journal)
+    tiJournalRecordRows(b->journal, at, n, src->row, m);
+
+  for (int j = at; j < at + n; ++j)
+    tiDropRow(b, &b->row[j]);
+  memmove(&b->row[at + m], &b->row[at + n],
+          sizeof(erow) * (b->numrows - at - n));
+  if (m)
+    memcpy(&b->row[at], src->row, sizeof(erow) * m);
+  b->numrows += m - n;
+  src->numrows = 0;
+  tiRenumber(b, at);
+
+  for (int j = at; j < at + m; ++j) {
+    b->row[j].gen = b->snapgen;
+    tiRowTouched(b, j);
+  }
+  // the comment state carried into the rows after may have changed
+  if (at + m < b->numrows)
+    tiRowTouched(b, at + m);
+  if (b->batchhi >= b->numrows)
+    b->batchhi = b->numrows - 1;
+  b->dirty++;
+  b->edits++;
+  tiBufferBatchEnd(b);
+}
+
+// marks a row whose bytes are the same but whose comment state coming in
+// may have changed, which only needs highlighting again
+static void tiRowRecolor(tiBuffer *b, int at) {
+  erow *row = &b->row[at];
+  tiHlRelease(row->hl);
+  row->hl = NULL;
+  row->stale = 1;
+  if (at < b->batchlo)
+    b->batchlo = at;
+  if (at > b->batchhi)
+    b->batchhi = at;
+}
+
+int tiSortRows(tiBuffer *b, int first, int last, int flags, int threads) {
+  if (first < 0)
+    first = 0;
+  if (last >= b->numrows)
+    last = b->numrows - 1;
+  int n = last - first + 1;
+  if (n <= 1)
+    return 0;
+
+  // the sort compares chars from several threads, the block cache can't
+  // serve them
+  for (int j = first; j <= last; ++j)
+    if (b->row[j].cold)
+      tiRowOwn(b, &b->row[j]);
+
+  int kept;
+  erow **order = tiSortOrder(&b->row[first], n, flags, threads, &kept);
+  if (order == NULL)
+    return -1;
+  int moved = kept < n;
+  for (int i = 0; i < kept && !moved; ++i)
+    moved = order[i] != &b->row[first + i];
+  if (!moved) {
+    memFree(order);
+    return 0;
+  }
+
+  erow *rows = memAlloc(MEM_ROWS, sizeof(erow) * kept + 1);
+  // the comment state each row was highlighted with, and that of the row
+  // after the range
+  unsigned char *in = memAlloc(MEM_ROWS, kept + 1);
+  char *keep = memAlloc(MEM_ROWS, n);
+  if (rows == NULL || in == NULL || keep == NULL) {
+    memFree(rows);
+    memFree(in);
+    memFree(keep);
+    memFree(order);
+    return -1;
+  }
+  memset(keep, 0, n);
+  for (int i = 0; i < kept; ++i) {
+    int j = order[i] - b->row;
+    rows[i] = *order[i];
+    in[i] = j > 0 ? b->row[j - 1].hl_open_comment : 0;
+    keep[j - first] = 1;
+  }
+  in[kept] = b->row[last].hl_open_comment;
+  memFree(order);
+
+  // the sort is stable, replaying it gives the same rows
+  if (b->journal) {
+    int32_t f = flags;
+    tiJournalRecord(b->journal, TI_JOURNAL_SORT, first, last, (char *)&f,
+                    sizeof(f));
+  }
+
+  tiBufferBatchBegin(b);
+  if (b->batchlo > last)
+    b->batchlo -= n - kept;
+  if (b->batchhi > last)
+    b->batchhi -= n - kept;
+  for (int i = 0; i < n; ++i)
+    if (!keep[i])
+      tiDropRow(b, &b->row[first + i]);
+  memcpy(&b->row[first], rows, sizeof(erow) * kept);
+  memmove(&b->row[first + kept], &b->row[last + 1],
+          sizeof(erow) * (b->numrows - last - 1));
+  b->numrows -= n - kept;
+  tiRenumber(b, first);
+
+  // the rest of a row's highlight only depends on its own text
+  for (int i = 0; i <= kept && first + i < b->numrows; ++i) {
+    int at = first + i;
+    int now = at > 0 ? b->row[at - 1].hl_open_comment : 0;
+    if (now != in[i])
+      tiRowRecolor(b, at);
+  }
+  if (b->batchhi >= b->numrows)
+    b->batchhi = b->numrows - 1;
+  b->dirty++;
+  b->edits++;
+  tiBufferBatchEnd(b);
+
+  memFree(rows);
+  memFree(in);
+  memFree(keep);
+  return n - kept;
+}
+
+void tiRowInsertChar(tiBuffer *b, erow *row, int at, int c) {
+  if (at < 0 || at > row->size)
+    at = row->size;
+  if (b->journal) {
+    char ch = c;
+    tiJournalRecord(b->journal, TI_JOURNAL_INSERT_CHAR, row->idx, at, &ch, 1);
+  }
+  tiRowOwn(b, row);
+
+  row->chars = memRealloc(MEM_CHARS, row->chars, row->size + 2);
+  memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
+  row->size++;
+  row->chars[at] = c;
+  tiRowChanged(b, row);
+  b->dirty++;
+  b->edits++;
+}
+
+void tiRowAppendString(tiBuffer *b, erow *row, const char *s, size_t len) {
+  if (b->journal)
+    tiJournalRecord(b->journal, TI_JOURNAL_APPEND, row->idx, 0, s, len);
+  tiRowOwn(b, row);
+  row->chars = memRealloc(MEM_CHARS, row->chars, row->size + len + 1);
+  memcpy(&row->chars[row->size], s, len);
+  row->size += len;
+  row->chars[row->size] = '\0';
+  tiRowChanged(b, row);
+  b->dirty++;
+  b->edits++;
+}
+
+void tiRowDelChar(tiBuffer *b, erow *row, int at) {
+  if (at < 0 || at >= row->size)
+    return;
+  if (b->journal)
+    tiJournalRecord(b->journal, TI_JOURNAL_DEL_CHAR, row->idx, at, NULL, 0);
+  tiRowOwn(b, row);
+
+  memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
+  row->size--;
+  tiRowChanged(b, row);
+  b->dirty++;
+  b->edits++;
+}
+
+void tiRowTruncate(tiBuffer *b, erow *row, int len) {
+  if (len < 0 || len >= row->size)
+    return;
+  if (b->journal)
+    tiJournalRecord(b->journal, TI_JOURNAL_TRUNCATE, row->idx, len, NULL, 0);
+  tiRowOwn(b, row);
+
+  row->size = len;
+  row->chars[row->size] = '\0';
+  tiRowChanged(b, row);
+  b->dirty++;
+  b->edits++;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ file I/O ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+char *tiRowsToString(tiBuffer *b, size_t *buflen) {
+  size_t total_len = 0;
+  int j;
+  for (j = 0; j < b->numrows; ++j)
+    total_len += b->row[j].size + 1;
+
+  *buflen = total_len;
+  char *buf = memAlloc(MEM_IO, total_len);
+  if (buf == NULL)
+    return NULL;
+  char *p = buf;
+  for (j = 0; j < b->numrows; ++j) {
+    memcpy(p, tiRowChars(&b->row[j]), b->row[j].size);
+    p += b->row[j].size;
+    *p = '\n';
+    p++;
+  }
+
+  return buf;
+}
+
+// a line ends at its first '\r' or '\n', as strcspn(line, "\r\n") did
+static void tiAppendLine(tiBuffer *b, const char *s, size_t len) {
+  const char *cr = memchr(s, '\r', len);
+  tiInsertRow(b, b->numrows, s, cr ? (size_t)(cr - s) : len);
+}
+
+// a row whose render and hl are left to tiRowEnsure, leaving a comment
+// open as its line did when the buffer was last highlighted
+static void tiAppendLazy(tiBuffer *b, const char *s, size_t len, int open) {
+  const char *cr = memchr(s, '\r', len);
+  erow *row = &b->row[b->numrows];
+  row->idx = b->numrows;
+  tiRowSetChars(b, row, s, cr ? (size_t)(cr - s) : len);
+  row->rsize = 0;
+  row->render = NULL;
+  row->hl = NULL;
+  row->hl_open_comment = open;
+  row->stale = 0;
+  b->numrows++;
+}
+
+void tiAppendLines(tiBuffer *b, const char *buf, size_t len) {
+  size_t count;
+  size_t *nl = tiIndexNewlines(buf, len, &count, 0);
+  if (nl == NULL)
+    return;
+  tiAppendIndexed(b, buf, len, nl, count, NULL);
+  memFree(nl);
+}
+
+void tiAppendIndexed(tiBuffer *b, const char *buf, size_t len,
+                     const size_t *nl, size_t count,
+                     const unsigned char *open) {
+  // one allocation for all the new rows, growing geometrically so callers
+  // appending in small batches (follow mode) don't copy the array each time
+  if (b->numrows + count + 1 > (size_t)b->rowcap) {
+    size_t cap = b->numrows + count + 1;
+    b->rowcap = cap > (size_t)b->rowcap * 2 ? cap : (size_t)b->rowcap * 2;
+    b->row = memRealloc(MEM_ROWS, b->row, sizeof(erow) * b->rowcap);
+  }
+
+  if (open) {
+    size_t start = 0, j = 0;
+    for (; j < count; ++j) {
+      tiAppendLazy(b, buf + start, nl[j] - start, open[j / 8] >> (j % 8) & 1);
+      start = nl[j] + 1;
+    }
+    if (start < len)
+      tiAppendLazy(b, buf + start, len - start, open[j / 8] >> (j % 8) & 1);
+    b->dirty++;
+    b->edits++;
+    return;
+  }
+
+  size_t start = 0;
+  for (size_t i = 0; i < count; ++i) {
+    tiAppendLine(b, buf + start, nl[i] - start);
+    start = nl[i] + 1;
+  }
+  if (start < len)
+    tiAppendLine(b, buf + start, len - start);
+}
+
+int tiOpen(tiBuffer *b, const char *filename) {
+
+  if (b->filename != filename) {
+    char *name = strdup(basename(filename));
+    free(b->filename);
+    b->filename = name;
+  }
+
+  tiSelectSyntax(b);
+
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  // regular files are mapped and indexed in one go, anything else (pipes,
+  // devices) is read line by line
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      tiAppendLines(b, map, st.st_size);
+      munmap(map, st.st_size);
+      close(fd);
+      b->dirty = 0;
+      return 0;
+    }
+  }
+
+  FILE *fp = fdopen(fd, "r");
+  if (!fp) {
+    close(fd);
+    return -1;
+  }
+
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t linelen;
+  while ((linelen = getline(&line, &linecap, fp)) != -1) {
+    line[(linelen = strcspn(line, "\r\n"))] = 0;
+
+    tiInsertRow(b, b->numrows, line, linelen);
+  }
+
+  free(line);
+  fclose(fp);
+  b->dirty = 0;
+  return 0;
+}
+
+// line k of an indexed buffer, cut at its first '\r' like tiAppendLine
+static size_t tiLineAt(const char *buf, size_t len, const size_t *nl,
+                       size_t count, size_t k, const char **s) {
+  size_t start = k ? nl[k - 1] + 1 : 0;
+  size_t end = k < count ? nl[k] : len;
+  const char *cr = memchr(buf + start, '\r', end - start);
+  *s = buf + start;
+  return cr ? (size_t)(cr - *s) : end - start;
+}
+
+static int tiRowIs(erow *row, const char *s, size_t len) {
+  return (size_t)row->size == len && memcmp(tiRowChars(row), s, len) == 0;
+}
+
+int tiReload(tiBuffer *b, const char *filename, int *first, int *removed,
+             int *added) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  // only regular files are mapped and diffed
+  struct stat st;
+  int found = fstat(fd, &st) == 0;
+  if (!found || !S_ISREG(st.st_mode)) {
+    int saved = found ? EINVAL : errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+
+  size_t len = st.st_size;
+  char *map = NULL;
+  if (len > 0) {
+    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      int saved = errno;
+      close(fd);
+      errno = saved;
+      return -1;
+    }
+  }
+  close(fd);
+
+  size_t count = 0;
+  size_t *nl = len ? tiIndexNewlines(map, len, &count, 0) : NULL;
+  if (len && nl == NULL) {
+    munmap(map, len);
+    errno = ENOMEM;
+    return -1;
+  }
+  size_t lines = count + (len && (count == 0 || nl[count - 1] + 1 < len));
+
+  // the rows both versions share at the start and at the end are kept as
+  // they are, caches included; only the range in between is replaced
+  const char *s;
+  size_t n;
+  int pre = 0;
+  while (pre < b->numrows && (size_t)pre < lines &&
+         (n = tiLineAt(map, len, nl, count, pre, &s),
+          tiRowIs(&b->row[pre], s, n)))
+    pre++;
+  int suf = 0;
+  while (suf < b->numrows - pre && (size_t)suf < lines - pre &&
+         (n = tiLineAt(map, len, nl, count, lines - 1 - suf, &s),
+          tiRowIs(&b->row[b->numrows - 1 - suf], s, n)))
+    suf++;
+
+  int ndel = b->numrows - pre - suf;
+  int nins = lines - pre - suf;
+  for (int j = pre; j < pre + ndel; ++j)
+    tiDropRow(b, &b->row[j]);
+  if (b->numrows - ndel + nins > b->rowcap) {
+    b->rowcap = b->numrows - ndel + nins;
+    b->row = memRealloc(MEM_ROWS, b->row, sizeof(erow) * b->rowcap);
+  }
+  memmove(&b->row[pre + nins], &b->row[pre + ndel], sizeof(erow) * suf);
+  b->numrows += nins - ndel;
+  for (int j = pre + nins; j < b->numrows; ++j)
+    b->row[j].idx = j;
+
+  for (int j = pre; j < pre + nins; ++j) {
+    erow *row = &b->row[j];
+    n = tiLineAt(map, len, nl, count, j, &s);
+    memset(row, 0, sizeof(erow));
+    row->idx = j;
+    tiRowSetChars(b, row, s, n);
+    tiRenderRow(row);
+    tiHighlightRow(b, row);
+  }
+  // an opened or closed comment carries on into the kept rows
+  if ((ndel || nins) && pre + nins < b->numrows) {
+    erow *row = &b->row[pre + nins];
+    if (row->render == NULL)
+      tiRenderRow(row);
+    tiUpdateSyntax(b, row);
+  }
+
+  memFree(nl);
+  if (map)
+    munmap(map, len);
+  b->dirty = 0;
+  b->edits++;
+  if (b->journal)
+    tiJournalReset(b->journal, &st);
+  *first = pre;
+  *removed = ndel;
+  *added = nins;
+  return 0;
+}
+
+ssize_t tiSave(tiBuffer *b, const char *path) {
+  size_t len;
+  char *buf = tiRowsToString(b, &len);
+  if (buf == NULL)
+    return -1;
+
+  ssize_t written = -1;
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd != -1) {
+    if (ftruncate(fd, len) != -1) {
+      size_t done = 0;
+      while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n == -1 && errno == EINTR)
+          continue;
+        if (n <= 0)
+          break;
+        done += n;
+      }
+      if (done == len)
+        written = len;
+    }
+
+    // the file holds every edit now, the journal can start over
+    struct stat st;
+    if (written != -1 && b->journal && fstat(fd, &st) == 0)
+      tiJournalReset(b->journal, &st);
+
+    int saved = errno;
+    close(fd);
+    errno = saved;
+  }
+
+  memFree(buf);
+  if (written != -1)
+    b->dirty = 0;
+  return written;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ find / search ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// rows without a render are searched in their bytes, which are the render
+// unless they hold tabs, so a search doesn't rebuild the caches of every
+// row it passes and reads cold rows a block at a time
+int tiFind(tiBuffer *b, const char *query, int from, int direction, int *rx) {
+  char *scratch = NULL;
+  size_t scratchcap = 0;
+  int found = -1;
+  int current = from;
+  int i;
+  for (i = 0; i < b->numrows; ++i) {
+    current += direction;
+
+    if (current == -1)
+      current = b->numrows - 1;
+    else if (current == b->numrows)
+      current = 0;
+
+    erow *row = &b->row[current];
+    const char *text = row->render;
+    if (text == NULL) {
+      text = tiRowChars(row);
+      int tabs = text ? tiRenderTabs(text, row->size) : 0;
+      if (tabs) {
+        size_t need = row->size + tabs * (TI_TAB_STOP - 1) + 1;
+        if (need > scratchcap) {
+          char *grown = memRealloc(MEM_SEARCH, scratch, need);
+          if (grown == NULL)
+            break;
+          scratch = grown;
+          scratchcap = need;
+        }
+        tiRenderInto(text, row->size, scratch);
+        text = scratch;
+      }
+    }
+    if (text == NULL)
+      break;
+
+    const char *match = strstr(text, query);
+    if (match) {
+      *rx = match - text;
+      found = current;
+      break;
+    }
+  }
+
+  memFree(scratch);
+  return found;
+}
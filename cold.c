@@ -0,0 +1,253 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_WINDOW 65535
+
+// the rows of a block, each followed by a NUL, packed with lzPack. A block
+// that would not shrink keeps its bytes as they are (packed == 0)
+struct tiColdBlock {
+
+  int refs;
+  int nrows;
+  uint32_t len;
+  uint32_t packed;
+  // unpacked bytes while the block is in the cache
+  char *raw;
+  unsigned char data[];
+};
+
+struct tiColdStats tiCold;
+
+// most recently read first
+static tiColdBlock *lru[TI_COLD_LRU];
+static int nlru;
+
+/*~~~~~~~~~~~~~~~~~~~~ codec ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * A byte oriented LZ77 in the LZ4 mould: each sequence is a token holding
+ * the literal count and match length (4 bits each, 15 meaning more follow
+ * in bytes of up to 255), the literals, then a 16-bit offset back into the
+ * output and the rest of the match length. The last sequence has literals
+ * only. Matches are found through a table of the last position of each
+ * hashed 4-byte string, so packing is one pass and unpacking is copies.
+ */
+
+static unsigned char *lzLength(unsigned char *p, size_t len) {
+  if (len < 15)
+    return p;
+  for (len -= 15; len >= 255; len -= 255)
+    *p++ = 255;
+  *p++ = len;
+  return p;
+}
+
+static int lzSequence(unsigned char *dst, size_t cap, size_t *o,
+                      const unsigned char *lit, size_t nlit, size_t off,
+                      size_t mlen) {
+  size_t ml = mlen ? mlen - LZ_MIN_MATCH : 0;
+  if (*o + 1 + nlit / 255 + 1 + nlit + 2 + ml / 255 + 1 > cap)
+    return 0;
+  unsigned char *p = dst + *o;
+  *p++ = (nlit < 15 ? nlit : 15) << 4 | (ml < 15 ? ml : 15);
+  p = lzLength(p, nlit);
+  memcpy(p, lit, nlit);
+  p += nlit;
+  if (mlen) {
+    *p++ = off;
+    *p++ = off >> 8;
+    p = lzLength(p, ml);
+  }
+  *o = p - dst;
+  return 1;
+}
+
+// returns the packed length, 0 if it would not fit in cap
+static size_t lzPack(const unsigned char *src, size_t n, unsigned char *dst,
+                     size_t cap) {
+  uint32_t table[1 << LZ_HASH_BITS] = {0};
+  size_t i = 0, anchor = 0, o = 0;
+
+  while (i + LZ_MIN_MATCH <= n) {
+    uint32_t seq;
+    memcpy(&seq, src + i, 4);
+    uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+    size_t cand = table[h];
+    table[h] = i + 1;
+    if (cand == 0 || i - (cand - 1) > LZ_WINDOW ||
+        memcmp(src + cand - 1, src + i, 4)) {
+      // the longer nothing matched, the faster it is skipped
+      i += 1 + ((i - anchor) >> 6);
+      continue;
+    }
+
+    cand--;
+    size_t len = LZ_MIN_MATCH;
+    while (i + len < n && src[cand + len] == src[i + len])
+      len++;
+    if (!lzSequence(dst, cap, &o, src + anchor, i - anchor, i - cand, len))
+      return 0;
+    i += len;
+    anchor = i;
+  }
+
+  if (!lzSequence(dst, cap, &o, src + anchor, n - anchor, 0, 0))
+    return 0;
+  return o;
+}
+
+static int lzReadLength(const unsigned char *src, size_t n, size_t *i,
+                        size_t *len) {
+  if (*len < 15)
+    return 0;
+  unsigned char c;
+  do {
+    if (*i >= n)
+      return -1;
+    c = src[(*i)++];
+    *len += c;
+  } while (c == 255);
+  return 0;
+}
+
+// unpacks exactly cap bytes, -1 if src is not the packing of that many
+static int lzUnpack(const unsigned char *src, size_t n, unsigned char *dst,
+                    size_t cap) {
+  size_t i = 0, o = 0;
+  while (i < n) {
+    unsigned token = src[i++];
+    size_t nlit = token >> 4;
+    if (lzReadLength(src, n, &i, &nlit) == -1 || nlit > n - i ||
+        nlit > cap - o)
+      return -1;
+    memcpy(dst + o, src + i, nlit);
+    i += nlit;
+    o += nlit;
+    if (i == n)
+      break;
+
+    if (n - i < 2)
+      return -1;
+    size_t off = src[i] | src[i + 1] << 8;
+    i += 2;
+    size_t ml = token & 15;
+    if (lzReadLength(src, n, &i, &ml) == -1)
+      return -1;
+    ml += LZ_MIN_MATCH;
+    if (off == 0 || off > o || ml > cap - o)
+      return -1;
+    if (off >= ml) {
+      memcpy(dst + o, dst + o - off, ml);
+      o += ml;
+    } else {
+      // overlapping, the match repeats the last off bytes
+      for (size_t k = 0; k < ml; ++k, ++o)
+        dst[o] = dst[o - off];
+    }
+  }
+  return o == cap ? 0 : -1;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ blocks ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+tiColdBlock *tiColdPack(const char *raw, size_t len, int nrows) {
+  unsigned char *tmp = memAlloc(MEM_COLD, len);
+  if (tmp == NULL && len)
+    return NULL;
+  size_t packed = len ? lzPack((const unsigned char *)raw, len, tmp, len) : 0;
+
+  tiColdBlock *c =
+      memAlloc(MEM_COLD, sizeof(tiColdBlock) + (packed ? packed : len));
+  if (c) {
+    c->refs = nrows;
+    c->nrows = nrows;
+    c->len = len;
+    c->packed = packed;
+    c->raw = NULL;
+    memcpy(c->data, packed ? tmp : (const unsigned char *)raw,
+           packed ? packed : len);
+    tiCold.blocks++;
+    tiCold.raw += len;
+    tiCold.packed += packed ? packed : len;
+  }
+  memFree(tmp);
+  return c;
+}
+
+static void coldEvict(tiColdBlock *c) {
+  memFree(c->raw);
+  c->raw = NULL;
+}
+
+const char *tiColdRead(tiColdBlock *c) {
+  if (!c->packed)
+    return (const char *)c->data;
+
+  tiCold.reads++;
+  int at = 0;
+  while (at < nlru && lru[at] != c)
+    at++;
+  if (at < nlru) {
+    tiCold.hits++;
+  } else {
+    char *raw = memAlloc(MEM_COLD, c->len);
+    if (raw == NULL)
+      return NULL;
+    if (lzUnpack(c->data, c->packed, (unsigned char *)raw, c->len) == -1) {
+      // blocks only come from tiColdPack, this is memory corruption
+      memFree(raw);
+      return NULL;
+    }
+    if (nlru == TI_COLD_LRU)
+      coldEvict(lru[--nlru]);
+    c->raw = raw;
+    at = nlru++;
+  }
+  memmove(&lru[1], &lru[0], sizeof(lru[0]) * at);
+  lru[0] = c;
+  return c->raw;
+}
+
+int tiColdUnpack(const tiColdBlock *c, char *out) {
+  if (!c->packed) {
+    memcpy(out, c->data, c->len);
+    return 0;
+  }
+  return lzUnpack(c->data, c->packed, (unsigned char *)out, c->len);
+}
+
+size_t tiColdSize(const tiColdBlock *c) { return c->len; }
+
+void tiColdRetain(tiColdBlock *c) { c->refs++; }
+
+void tiColdRelease(tiColdBlock *c) {
+  if (c == NULL || --c->refs)
+    return;
+  for (int i = 0; i < nlru; ++i) {
+    if (lru[i] == c) {
+      memmove(&lru[i], &lru[i + 1], sizeof(lru[0]) * (nlru - i - 1));
+      nlru--;
+      break;
+    }
+  }
+  coldEvict(c);
+  tiCold.blocks--;
+  tiCold.raw -= c->len;
+  tiCold.packed -= c->packed ? c->packed : c->len;
+  memFree(c);
+}
+
+int tiColdSparse(const tiColdBlock *c) { return c->refs * 4 < c->nrows; }
@@ -0,0 +1,422 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// bytes a single character can take once escaped, with the color or span
+// changes around it
+#define EXPORT_CHAR_MAX 64
+
+// files exported together share fd: each is written out in turn, the
+// threads on later ones highlighting into their buffer until it fills
+struct exportJob {
+
+  char **files;
+  struct editorSyntax **syn;
+  int *errs;
+  int n, format, fd;
+  pthread_mutex_t lock;
+  pthread_cond_t turn;
+  // the next file to be claimed by a thread, and the one written out now
+  int next, current;
+};
+
+// the output of file idx, written to fd once the files before it are
+struct exportOut {
+
+  struct exportJob *job;
+  int idx;
+  int fd;
+  char *buf;
+  size_t len;
+  int err;
+};
+
+// a line with its tabs expanded and its highlight, reused line to line
+struct exportLine {
+
+  char *carry;
+  size_t clen, ccap;
+  char *render;
+  unsigned char *hl;
+  size_t cap;
+};
+
+// HTML classes of the highlights, the same for both kinds of comment
+static const char *exportClass[HL_MATCH + 1] = {
+    [HL_COMMENT] = "c",  [HL_MLCOMMENT] = "c", [HL_KEYWORD1] = "k1",
+    [HL_KEYWORD2] = "k2", [HL_KEYWORD3] = "k3", [HL_KEYWORD4] = "k4",
+    [HL_STRING] = "s",   [HL_NUMBER] = "n",    [HL_MATCH] = "m"};
+
+/*~~~~~~~~~~~~~~~~~~~~ output ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int exportWrite(int fd, const char *p, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// waits for the files before this one to be written out, then writes
+// what is buffered. Once its turn comes it stays until the file is done
+static void exportFlush(struct exportOut *o) {
+  struct exportJob *job = o->job;
+  if (job) {
+    pthread_mutex_lock(&job->lock);
+    while (job->current != o->idx)
+      pthread_cond_wait(&job->turn, &job->lock);
+    pthread_mutex_unlock(&job->lock);
+  }
+  if (!o->err && exportWrite(o->fd, o->buf, o->len) == -1)
+    o->err = errno;
+  o->len = 0;
+}
+
+static void exportRoom(struct exportOut *o, size_t n) {
+  if (o->len + n > TI_EXPORT_BUF)
+    exportFlush(o);
+}
+
+static void exportPut(struct exportOut *o, const char *s, size_t n) {
+  exportRoom(o, n);
+  if (n > TI_EXPORT_BUF) {
+    if (!o->err && exportWrite(o->fd, s, n) == -1)
+      o->err = errno;
+    return;
+  }
+  memcpy(o->buf + o->len, s, n);
+  o->len += n;
+}
+
+static void exportString(struct exportOut *o, const char *s) {
+  exportPut(o, s, strlen(s));
+}
+
+// c with &, < and > escaped, at p
+static int exportEscape(char *p, char c) {
+  const char *esc = c == '&'   ? "&amp;"
+                    : c == '<' ? "&lt;"
+                    : c == '>' ? "&gt;"
+                               : NULL;
+  if (esc == NULL) {
+    *p = c;
+    return 1;
+  }
+  memcpy(p, esc, strlen(esc));
+  return strlen(esc);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ formats ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// colors and control characters as the editor draws them
+static void exportAnsi(struct exportOut *o, const char *c,
+                       const unsigned char *hl, int len) {
+  int color = -1;
+  for (int j = 0; j < len; ++j) {
+    exportRoom(o, EXPORT_CHAR_MAX);
+    char *p = o->buf + o->len;
+    if (iscntrl((unsigned char)c[j])) {
+      char sym = (c[j] >= 0 && c[j] <= 26) ? '@' + c[j] : '?';
+      p += sprintf(p, "\x1b[7m%c\x1b[m", sym);
+      if (color != -1)
+        p += sprintf(p, "\x1b[%dm", color);
+    } else {
+      int want = hl[j] == HL_NORMAL ? -1 : tiSyntaxToColor(hl[j]);
+      if (want == -1 && color != -1)
+        p += sprintf(p, "\x1b[39m");
+      else if (want != color)
+        p += sprintf(p, "\x1b[%dm", want);
+      color = want;
+      *p++ = c[j];
+    }
+    o->len = p - o->buf;
+  }
+  exportPut(o, color != -1 ? "\x1b[39m\n" : "\n", color != -1 ? 6 : 1);
+}
+
+static void exportHtml(struct exportOut *o, const char *c,
+                       const unsigned char *hl, int len) {
+  const char *cls = NULL;
+  for (int j = 0; j < len; ++j) {
+    exportRoom(o, EXPORT_CHAR_MAX);
+    char *p = o->buf + o->len;
+    int cntrl = iscntrl((unsigned char)c[j]);
+    const char *want = cntrl ? "x" : hl[j] <= HL_MATCH ? exportClass[hl[j]]
+                                                       : NULL;
+    if (want != cls) {
+      if (cls)
+        p += sprintf(p, "</span>");
+      if (want)
+        p += sprintf(p, "<span class=\"%s\">", want);
+      cls = want;
+    }
+    if (cntrl)
+      *p++ = (c[j] >= 0 && c[j] <= 26) ? '@' + c[j] : '?';
+    else
+      p += exportEscape(p, c[j]);
+    o->len = p - o->buf;
+  }
+  exportPut(o, cls ? "</span>\n" : "\n", cls ? 8 : 1);
+}
+
+// the page around the files, colored like the terminal's default palette
+static void exportHtmlHead(struct exportOut *o) {
+  static const int hls[] = {HL_COMMENT,  HL_KEYWORD1, HL_KEYWORD2,
+                            HL_KEYWORD3, HL_KEYWORD4, HL_STRING,
+                            HL_NUMBER,   HL_MATCH};
+  exportString(o, "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n"
+                  "<style>\n"
+                  "body { background: #1e1e1e; color: #e5e5e5; }\n"
+                  ".x { background: #e5e5e5; color: #1e1e1e; }\n");
+  for (size_t i = 0; i < sizeof(hls) / sizeof(hls[0]); ++i) {
+    const char *css;
+    switch (tiSyntaxToColor(hls[i])) {
+    case 31: css = "#cd3131"; break;
+    case 32: css = "#0dbc79"; break;
+    case 33: css = "#e5e510"; break;
+    case 34: css = "#2472c8"; break;
+    case 35: css = "#bc3fbc"; break;
+    case 36: css = "#11a8cd"; break;
+    case 92: css = "#23d18b"; break;
+    case 93: css = "#f5f543"; break;
+    default: css = "#e5e5e5"; break;
+    }
+    char rule[64];
+    snprintf(rule, sizeof(rule), ".%s { color: %s; }\n", exportClass[hls[i]],
+             css);
+    exportString(o, rule);
+  }
+  exportString(o, "</style>\n</head>\n<body>\n");
+}
+
+static void exportHtmlTitle(struct exportOut *o, const char *filename) {
+  exportString(o, "<h3>");
+  for (const char *s = filename; *s; ++s) {
+    exportRoom(o, EXPORT_CHAR_MAX);
+    o->len += exportEscape(o->buf + o->len, *s);
+  }
+  exportString(o, "</h3>\n<pre>\n");
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ export ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// highlights one line, cut at its first '\r' as tiAppendLines does, from
+// the comment state the line before left
+static int exportLine(struct exportOut *o, struct exportLine *x,
+                      const char *s, size_t len,
+                      const struct editorSyntax *syn, int format,
+                      int *in_comment) {
+  const char *cr = memchr(s, '\r', len);
+  if (cr)
+    len = cr - s;
+  size_t tabs = 0;
+  for (size_t j = 0; j < len; ++j)
+    tabs += s[j] == '\t';
+  size_t need = len + tabs * (TI_TAB_STOP - 1) + 1;
+  if (need > x->cap) {
+    char *render = memRealloc(MEM_RENDER, x->render, need);
+    if (render)
+      x->render = render;
+    unsigned char *hl = memRealloc(MEM_HL, x->hl, need);
+    if (hl)
+      x->hl = hl;
+    if (render == NULL || hl == NULL)
+      return ENOMEM;
+    x->cap = need;
+  }
+
+  int rlen = 0;
+  for (size_t j = 0; j < len; ++j) {
+    if (s[j] == '\t') {
+      x->render[rlen++] = ' ';
+      while (rlen % TI_TAB_STOP != 0)
+        x->render[rlen++] = ' ';
+    } else {
+      x->render[rlen++] = s[j];
+    }
+  }
+  x->render[rlen] = '\0';
+  *in_comment = tiHighlightInto(syn, x->render, rlen, *in_comment, x->hl);
+  if (format == TI_EXPORT_HTML)
+    exportHtml(o, x->render, x->hl, rlen);
+  else
+    exportAnsi(o, x->render, x->hl, rlen);
+  return 0;
+}
+
+// a line that goes on past the bytes read so far
+static int exportCarry(struct exportLine *x, const char *s, size_t len) {
+  if (x->clen + len > x->ccap) {
+    size_t cap = x->ccap ? x->ccap : 4096;
+    while (cap < x->clen + len)
+      cap *= 2;
+    char *carry = memRealloc(MEM_IO, x->carry, cap);
+    if (carry == NULL)
+      return ENOMEM;
+    x->carry = carry;
+    x->ccap = cap;
+  }
+  memcpy(x->carry + x->clen, s, len);
+  x->clen += len;
+  return 0;
+}
+
+// reads filename TI_EXPORT_BUF bytes at a time and writes it out a line at
+// a time. Returns 0 or an errno
+static int exportFile(struct exportOut *o, struct exportLine *x,
+                      const char *filename, const struct editorSyntax *syn,
+                      int format) {
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return errno;
+  char *rd = memAlloc(MEM_IO, TI_EXPORT_BUF);
+  if (rd == NULL) {
+    close(fd);
+    return ENOMEM;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if (format == TI_EXPORT_HTML)
+    exportHtmlTitle(o, filename);
+
+  int in_comment = 0;
+  int err = 0;
+  x->clen = 0;
+  ssize_t n;
+  while (!err && (n = read(fd, rd, TI_EXPORT_BUF)) != 0) {
+    if (n == -1) {
+      err = errno == EINTR ? 0 : errno;
+      continue;
+    }
+    const char *s = rd, *end = rd + n, *nl;
+    while (!err && (nl = memchr(s, '\n', end - s))) {
+      if (x->clen) {
+        err = exportCarry(x, s, nl - s);
+        if (!err)
+          err = exportLine(o, x, x->carry, x->clen, syn, format, &in_comment);
+        x->clen = 0;
+      } else {
+        err = exportLine(o, x, s, nl - s, syn, format, &in_comment);
+      }
+      s = nl + 1;
+    }
+    if (!err && s < end)
+      err = exportCarry(x, s, end - s);
+  }
+  // the last line, without a newline
+  if (!err && x->clen)
+    err = exportLine(o, x, x->carry, x->clen, syn, format, &in_comment);
+  if (format == TI_EXPORT_HTML)
+    exportString(o, "</pre>\n");
+  memFree(rd);
+  close(fd);
+  return err ? err : o->err;
+}
+
+static void *exportWorker(void *arg) {
+  struct exportJob *job = arg;
+  struct exportOut o = {job, 0, job->fd, memAlloc(MEM_IO, TI_EXPORT_BUF), 0,
+                        0};
+  struct exportLine x = {0};
+  while (1) {
+    pthread_mutex_lock(&job->lock);
+    int i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->n)
+      break;
+
+    o.idx = i;
+    o.err = 0;
+    job->errs[i] = o.buf ? exportFile(&o, &x, job->files[i], job->syn[i],
+                                      job->format)
+                         : ENOMEM;
+    // written out even if it failed halfway, and then the next file's turn
+    if (o.buf)
+      exportFlush(&o);
+    pthread_mutex_lock(&job->lock);
+    while (job->current != i)
+      pthread_cond_wait(&job->turn, &job->lock);
+    job->current++;
+    pthread_cond_broadcast(&job->turn);
+    pthread_mutex_unlock(&job->lock);
+  }
+  memFree(o.buf);
+  memFree(x.carry);
+  memFree(x.render);
+  memFree(x.hl);
+  return NULL;
+}
+
+int tiExport(char **files, int n, int format, int fd, int threads,
+             int *errs) {
+  struct exportJob job = {files, NULL, errs, n, format, fd,
+                          PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                          0, 0};
+  job.syn = memAlloc(MEM_SYNTAX, sizeof(*job.syn) * n + 1);
+  if (job.syn == NULL) {
+    for (int i = 0; i < n; ++i)
+      errs[i] = ENOMEM;
+    return n;
+  }
+  // the syntax database is loaded on first use, before any thread
+  for (int i = 0; i < n; ++i)
+    job.syn[i] = tiSyntaxMatch(files[i]);
+
+  struct exportOut page = {NULL, 0, fd, NULL, 0, 0};
+  if (format == TI_EXPORT_HTML)
+    page.buf = memAlloc(MEM_IO, TI_EXPORT_BUF);
+  if (page.buf) {
+    exportHtmlHead(&page);
+    exportFlush(&page);
+  }
+
+  if (threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+  if (threads > TI_EXPORT_THREADS)
+    threads = TI_EXPORT_THREADS;
+  if (threads > n)
+    threads = n;
+  pthread_t tid[TI_EXPORT_THREADS];
+  int started[TI_EXPORT_THREADS] = {0};
+  for (int t = 1; t < threads; ++t)
+    started[t] = pthread_create(&tid[t], NULL, exportWorker, &job) == 0;
+  exportWorker(&job);
+  for (int t = 1; t < threads; ++t)
+    if (started[t])
+      pthread_join(tid[t], NULL);
+
+  if (page.buf) {
+    exportString(&page, "</body>\n</html>\n");
+    exportFlush(&page);
+    memFree(page.buf);
+  }
+  pthread_mutex_destroy(&job.lock);
+  pthread_cond_destroy(&job.turn);
+  memFree(job.syn);
+
+  int failed = 0;
+  for (int i = 0; i < n; ++i)
+    failed += errs[i] != 0;
+  return failed;
+}
@@ -0,0 +1,45 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ hash tables ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+uint64_t tiHash(uint64_t seed, const char *s, size_t len) {
+  uint64_t h = (seed * 0x9e3779b97f4a7c15ULL) ^ (uint64_t)len;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, 8);
+    h = (h ^ w) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  uint64_t w = 0;
+  memcpy(&w, s + i, len - i);
+  h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+  return h ^ (h >> 29);
+}
+
+int tiHashGrow(struct tiHashLink ***slots, size_t *nslots) {
+  size_t n = *nslots ? *nslots * 2 : 4096;
+  struct tiHashLink **grown = calloc(n, sizeof(struct tiHashLink *));
+  if (grown == NULL)
+    return -1;
+  for (size_t i = 0; i < *nslots; ++i) {
+    for (struct tiHashLink *e = (*slots)[i], *next; e; e = next) {
+      next = e->next;
+      e->next = grown[e->hash & (n - 1)];
+      grown[e->hash & (n - 1)] = e;
+    }
+  }
+  free(*slots);
+  *slots = grown;
+  *nslots = n;
+  return 0;
+}
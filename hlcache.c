@@ -0,0 +1,150 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// one highlight result, shared by every row with the same render, incoming
+// comment state and syntax. Rows point at hl, never write to it; the render
+// it was made from follows it, but for rows without a syntax, whose hl only
+// depends on their length
+struct hlEntry {
+
+  struct tiHashLink link;
+  const struct editorSyntax *syntax;
+  uint32_t refs;
+  int32_t len;
+  unsigned char in_comment;
+  unsigned char open_comment;
+  // cleared by each pass of the eviction clock, set again on a hit
+  unsigned char used;
+  unsigned char hl[];
+};
+
+struct tiHlStats tiHl;
+
+static struct tiHashLink **slots;
+static size_t nslots;
+static size_t hand;
+
+/*~~~~~~~~~~~~~~~~~~~~ table ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// frees idle entries not hit since the clock last passed them, until the
+// idle ones fit under keep
+static void hlEvict(size_t keep) {
+  for (size_t swept = 0; swept < nslots * 2 && tiHl.idle > keep; ++swept) {
+    struct tiHashLink **p = &slots[hand];
+    while (*p) {
+      struct hlEntry *e = (struct hlEntry *)*p;
+      if (e->refs || e->used) {
+        e->used = 0;
+        p = &e->link.next;
+        continue;
+      }
+      *p = e->link.next;
+      tiHl.idle -= e->len;
+      tiHl.entries--;
+      tiHl.evictions++;
+      memFree(e);
+    }
+    hand = (hand + 1) & (nslots - 1);
+  }
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ highlight cache ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+const unsigned char *tiHlAcquire(const struct editorSyntax *syntax,
+                                 const char *render, int len, int in_comment,
+                                 int *open_comment) {
+  // without a syntax every row is HL_NORMAL, only its length matters
+  in_comment = syntax && in_comment;
+  uint64_t hash =
+      syntax ? tiHash((uintptr_t)syntax + in_comment, render, len)
+             : (uint64_t)len;
+  tiHl.lookups++;
+  for (struct tiHashLink *l = nslots ? slots[hash & (nslots - 1)] : NULL; l;
+       l = l->next) {
+    struct hlEntry *e = (struct hlEntry *)l;
+    if (l->hash != hash || e->len != len || e->syntax != syntax ||
+        e->in_comment != in_comment ||
+        (syntax && memcmp(e->hl + len, render, len)))
+      continue;
+    if (e->refs++)
+      tiHl.shared += len;
+    else
+      tiHl.idle -= len;
+    e->used = 1;
+    tiHl.hits++;
+    *open_comment = e->open_comment;
+    return e->hl;
+  }
+
+  struct hlEntry *e =
+      memAlloc(MEM_HL, sizeof(struct hlEntry) + (syntax ? len * 2 : len));
+  if (e == NULL)
+    return NULL;
+  e->link.hash = hash;
+  e->syntax = syntax;
+  e->refs = 1;
+  e->len = len;
+  e->in_comment = in_comment;
+  if (syntax)
+    memcpy(e->hl + len, render, len);
+  e->used = 1;
+  e->open_comment = tiHighlightInto(syntax, render, len, in_comment, e->hl);
+  *open_comment = e->open_comment;
+
+  // the clock starts over on the grown table
+  if (tiHl.entries >= nslots && tiHashGrow(&slots, &nslots) == 0)
+    hand = 0;
+  if (nslots == 0) {
+    memFree(e);
+    return NULL;
+  }
+  e->link.next = slots[hash & (nslots - 1)];
+  slots[hash & (nslots - 1)] = &e->link;
+  tiHl.entries++;
+  return e->hl;
+}
+
+void tiHlRelease(const unsigned char *hl) {
+  if (hl == NULL)
+    return;
+  struct hlEntry *e =
+      (struct hlEntry *)(hl - offsetof(struct hlEntry, hl));
+  if (--e->refs) {
+    tiHl.shared -= e->len;
+    return;
+  }
+
+  // a long line edited a key at a time would fill the cache with versions
+  // of itself, it is dropped right away
+  if (e->len > TI_HLCACHE_IDLE / 64) {
+    struct tiHashLink **p = &slots[e->link.hash & (nslots - 1)];
+    while (*p != &e->link)
+      p = &(*p)->next;
+    *p = e->link.next;
+    tiHl.entries--;
+    memFree(e);
+    return;
+  }
+
+  tiHl.idle += e->len;
+  if (tiHl.idle > TI_HLCACHE_IDLE)
+    hlEvict(TI_HLCACHE_IDLE - TI_HLCACHE_IDLE / 4);
+}
+
+size_t tiHlTrim(void) {
+  size_t idle = tiHl.idle;
+  hlEvict(0);
+  return idle - tiHl.idle;
+}
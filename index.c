@@ -0,0 +1,145 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+struct indexRange {
+
+  const char *buf;
+  size_t from, to;
+  size_t *nl;
+  size_t count;
+  size_t cap;
+};
+
+/*~~~~~~~~~~~~~~~~~~~~ line index ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int indexReserve(struct indexRange *r, size_t n) {
+  if (r->count + n <= r->cap)
+    return 0;
+  size_t cap = r->cap ? r->cap * 2 : 1024;
+  while (cap < r->count + n)
+    cap *= 2;
+  size_t *nl = memRealloc(MEM_INDEX, r->nl, sizeof(size_t) * cap);
+  if (nl == NULL)
+    return -1;
+  r->nl = nl;
+  r->cap = cap;
+  return 0;
+}
+
+static void *indexRange(void *arg) {
+  struct indexRange *r = arg;
+  const char *buf = r->buf;
+  size_t i = r->from;
+
+#ifdef __SSE2__
+  // 64 bytes per step: four compares folded into one bitmask, then one
+  // store per set bit, so dense short lines cost no more than sparse ones
+  const __m128i nl = _mm_set1_epi8('\n');
+  for (; i + 64 <= r->to; i += 64) {
+    uint64_t m0 = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), nl));
+    uint64_t m1 = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 16)), nl));
+    uint64_t m2 = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 32)), nl));
+    uint64_t m3 = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 48)), nl));
+    uint64_t mask = m0 | m1 << 16 | m2 << 32 | m3 << 48;
+    if (mask == 0)
+      continue;
+    if (indexReserve(r, 64) == -1)
+      return NULL;
+    while (mask) {
+      r->nl[r->count++] = i + __builtin_ctzll(mask);
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  const char *s = buf + i;
+  const char *end = buf + r->to;
+  while ((s = memchr(s, '\n', end - s)) != NULL) {
+    if (indexReserve(r, 1) == -1)
+      return NULL;
+    r->nl[r->count++] = s - buf;
+    s++;
+  }
+
+  return r;
+}
+
+size_t *tiIndexNewlines(const char *buf, size_t len, size_t *count,
+                        int threads) {
+  if (threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+  if (threads > TI_INDEX_THREADS)
+    threads = TI_INDEX_THREADS;
+  // small inputs are not worth a thread each
+  if ((size_t)threads > len / TI_INDEX_SPLIT + 1)
+    threads = len / TI_INDEX_SPLIT + 1;
+
+  struct indexRange r[TI_INDEX_THREADS];
+  pthread_t tid[TI_INDEX_THREADS];
+  int started[TI_INDEX_THREADS] = {0};
+  memset(r, 0, sizeof(r));
+  for (int t = 0; t < threads; ++t) {
+    r[t].buf = buf;
+    r[t].from = len / threads * t;
+    r[t].to = t == threads - 1 ? len : len / threads * (t + 1);
+    // guess one line per 64 bytes so most ranges never grow
+    indexReserve(&r[t], (r[t].to - r[t].from) / 64 + 1);
+    if (t > 0)
+      started[t] = pthread_create(&tid[t], NULL, indexRange, &r[t]) == 0;
+  }
+
+  int ok = indexRange(&r[0]) != NULL;
+  for (int t = 1; t < threads; ++t) {
+    if (started[t]) {
+      void *ret;
+      pthread_join(tid[t], &ret);
+      ok &= ret != NULL;
+    } else {
+      ok &= indexRange(&r[t]) != NULL;
+    }
+  }
+
+  // each range holds absolute offsets, stitching them is a concatenation
+  size_t total = 0;
+  for (int t = 0; t < threads; ++t)
+    total += r[t].count;
+
+  size_t *nl = NULL;
+  if (ok && threads == 1) {
+    nl = r[0].nl;
+    r[0].nl = NULL;
+  } else if (ok && (nl = memAlloc(MEM_INDEX, sizeof(size_t) * total + 1))) {
+    size_t at = 0;
+    for (int t = 0; t < threads; ++t) {
+      memcpy(nl + at, r[t].nl, sizeof(size_t) * r[t].count);
+      at += r[t].count;
+    }
+  }
+
+  for (int t = 0; t < threads; ++t)
+    memFree(r[t].nl);
+  *count = nl ? total : 0;
+  return nl;
+}
@@ -0,0 +1,92 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// the bytes of a line, shared by every interned row holding that line
+struct internEntry {
+
+  struct tiHashLink link;
+  uint32_t refs;
+  int32_t len;
+  char chars[];
+};
+
+struct tiInternStats tiIntern;
+
+static struct tiHashLink **slots;
+static size_t nslots;
+
+/*~~~~~~~~~~~~~~~~~~~~ pool ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static struct internEntry *internEntryOf(const char *chars) {
+  return (struct internEntry *)(chars - offsetof(struct internEntry, chars));
+}
+
+char *tiInternAcquire(const char *s, size_t len) {
+  uint64_t hash = tiHash(1, s, len);
+  tiIntern.lookups++;
+  for (struct tiHashLink *l = nslots ? slots[hash & (nslots - 1)] : NULL; l;
+       l = l->next) {
+    struct internEntry *e = (struct internEntry *)l;
+    if (l->hash == hash && (size_t)e->len == len &&
+        !memcmp(e->chars, s, len)) {
+      e->refs++;
+      tiIntern.hits++;
+      tiIntern.saved += len + 1;
+      return e->chars;
+    }
+  }
+
+  if (tiIntern.entries >= nslots)
+    tiHashGrow(&slots, &nslots);
+  struct internEntry *e =
+      nslots ? memAlloc(MEM_CHARS, sizeof(struct internEntry) + len + 1) : NULL;
+  if (e == NULL)
+    return NULL;
+  e->link.hash = hash;
+  e->refs = 1;
+  e->len = len;
+  memcpy(e->chars, s, len);
+  e->chars[len] = '\0';
+  e->link.next = slots[hash & (nslots - 1)];
+  slots[hash & (nslots - 1)] = &e->link;
+  tiIntern.entries++;
+  tiIntern.bytes += len + 1;
+  tiIntern.overhead += sizeof(struct internEntry);
+  return e->chars;
+}
+
+void tiInternRetain(const char *chars) {
+  struct internEntry *e = internEntryOf(chars);
+  e->refs++;
+  tiIntern.saved += e->len + 1;
+}
+
+void tiInternRelease(const char *chars) {
+  if (chars == NULL)
+    return;
+  struct internEntry *e = internEntryOf(chars);
+  if (--e->refs) {
+    tiIntern.saved -= e->len + 1;
+    return;
+  }
+
+  struct tiHashLink **p = &slots[e->link.hash & (nslots - 1)];
+  while (*p != &e->link)
+    p = &(*p)->next;
+  *p = e->link.next;
+  tiIntern.entries--;
+  tiIntern.bytes -= e->len + 1;
+  tiIntern.overhead -= sizeof(struct internEntry);
+  memFree(e);
+}
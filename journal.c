@@ -0,0 +1,398 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define JOURNAL_MAGIC "TIJ1"
+// text in one record of tiJournalRecordRows at most, bar a longer row
+#define JOURNAL_CHUNK (64 << 20)
+
+// identifies the file contents the recorded edits apply to
+struct journalHeader {
+
+  char magic[4];
+  uint32_t pad;
+  int64_t ino;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+};
+
+// followed by len bytes of text and a checksum of both, so a record torn
+// by a crash is recognized and dropped
+struct journalRecord {
+
+  uint32_t len;
+  uint32_t op;
+  int32_t row;
+  int32_t at;
+};
+
+struct tiJournal {
+
+  int fd;
+  char *path;
+  char *pending;
+  size_t len;
+  size_t cap;
+  // records written but not yet fsync'd
+  int unsynced;
+  uint64_t synced;
+  // errno of the first record that was lost, see journalFail
+  int err;
+};
+
+/*~~~~~~~~~~~~~~~~~~~~ records ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static uint32_t journalSum(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i)
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  return h;
+}
+
+static void journalHeader(struct journalHeader *h, const struct stat *base) {
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, JOURNAL_MAGIC, 4);
+  h->ino = base->st_ino;
+  h->size = base->st_size;
+  h->mtime_sec = base->st_mtim.tv_sec;
+  h->mtime_nsec = base->st_mtim.tv_nsec;
+}
+
+// a record that can't be kept would have the ones after it replayed
+// against the wrong rows: the journal is removed and records nothing more
+static int journalFail(tiJournal *j, int err) {
+  if (!j->err) {
+    j->err = err ? err : EIO;
+    j->len = 0;
+    unlink(j->path);
+  }
+  errno = j->err;
+  return -1;
+}
+
+static int journalWrite(tiJournal *j) {
+  size_t done = 0;
+  while (done < j->len) {
+    ssize_t n = write(j->fd, j->pending + done, j->len - done);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      // what made it out must not be written again by the next call
+      int saved = n == 0 ? EIO : errno;
+      memmove(j->pending, j->pending + done, j->len - done);
+      j->len -= done;
+      return journalFail(j, saved);
+    }
+    done += n;
+  }
+  j->len = 0;
+  j->unsynced = 1;
+  return 0;
+}
+
+// room for a record with len bytes of text, which go after the
+// journalRecord at the returned address. NULL once the journal failed
+static char *journalReserve(tiJournal *j, size_t len) {
+  if (j->err)
+    return NULL;
+  size_t need = sizeof(struct journalRecord) + len + sizeof(uint32_t);
+  if (j->len + need > j->cap) {
+    size_t cap = j->cap ? j->cap * 2 : 4096;
+    while (cap < j->len + need)
+      cap *= 2;
+    char *pending = memRealloc(MEM_IO, j->pending, cap);
+    if (pending == NULL) {
+      journalFail(j, ENOMEM);
+      return NULL;
+    }
+    j->pending = pending;
+    j->cap = cap;
+  }
+  return j->pending + j->len;
+}
+
+// fills in the reserved record at p, its text already in place
+static void journalCommit(tiJournal *j, char *p, int op, int row, int at,
+                          size_t len) {
+  struct journalRecord r = {len, op, row, at};
+  memcpy(p, &r, sizeof(r));
+  uint32_t sum = journalSum(p, sizeof(r) + len);
+  memcpy(p + sizeof(r) + len, &sum, sizeof(sum));
+  j->len += sizeof(r) + len + sizeof(sum);
+
+  // large batches (a paste) go to the kernel right away, the fsync still
+  // waits for the timer
+  if (j->len >= TI_JOURNAL_BATCH)
+    journalWrite(j);
+}
+
+void tiJournalRecord(tiJournal *j, int op, int row, int at, const char *s,
+                     size_t len) {
+  char *p = journalReserve(j, len);
+  if (p == NULL)
+    return;
+  memcpy(p + sizeof(struct journalRecord), s, len);
+  journalCommit(j, p, op, row, at, len);
+}
+
+void tiJournalRecordRows(tiJournal *j, int at, int n, erow *rows, int m) {
+  int i = 0;
+  do {
+    size_t len = 0;
+    int end = i;
+    while (end < m && (end == i || len + rows[end].size < JOURNAL_CHUNK))
+      len += rows[end++].size + 1;
+    char *p = journalReserve(j, len);
+    if (p == NULL)
+      return;
+    char *t = p + sizeof(struct journalRecord);
+    for (int k = i; k < end; ++k) {
+      memcpy(t, tiRowChars(&rows[k]), rows[k].size);
+      t += rows[k].size;
+      *t++ = '\n';
+    }
+    // the first record removes the n rows, the rest insert after it
+    journalCommit(j, p, TI_JOURNAL_REPLACE_ROWS, at + i, i ? 0 : n, len);
+    i = end;
+  } while (i < m);
+}
+
+static void journalReplaceRows(tiBuffer *b, int at, int n, const char *s,
+                               size_t len) {
+  tiBuffer *src = tiBufferNew();
+  if (src == NULL)
+    return;
+  for (size_t i = 0; i < len;) {
+    const char *nl = memchr(s + i, '\n', len - i);
+    size_t end = nl ? (size_t)(nl - s) : len;
+    tiInsertRow(src, src->numrows, s + i, end - i);
+    i = end + 1;
+  }
+  tiReplaceRows(b, at, n, src);
+  tiBufferFree(src);
+}
+
+static int journalReplay(tiBuffer *b, const char *buf, size_t len,
+                         size_t *valid) {
+  size_t off = sizeof(struct journalHeader);
+  int edits = 0;
+  while (off + sizeof(struct journalRecord) + sizeof(uint32_t) <= len) {
+    struct journalRecord r;
+    memcpy(&r, buf + off, sizeof(r));
+    if (r.len > len - off - sizeof(r) - sizeof(uint32_t))
+      break;
+    uint32_t sum;
+    memcpy(&sum, buf + off + sizeof(r) + r.len, sizeof(sum));
+    if (sum != journalSum(buf + off, sizeof(r) + r.len))
+      break;
+
+    const char *s = buf + off + sizeof(r);
+    erow *row = r.row >= 0 && r.row < b->numrows ? &b->row[r.row] : NULL;
+    switch (r.op) {
+    case TI_JOURNAL_INSERT_ROW:
+      tiInsertRow(b, r.row, s, r.len);
+      break;
+    case TI_JOURNAL_DEL_ROW:
+      tiDelRow(b, r.row);
+      break;
+    case TI_JOURNAL_INSERT_CHAR:
+      if (row && r.len == 1)
+        tiRowInsertChar(b, row, r.at, (unsigned char)*s);
+      break;
+    case TI_JOURNAL_APPEND:
+      if (row)
+        tiRowAppendString(b, row, s, r.len);
+      break;
+    case TI_JOURNAL_DEL_CHAR:
+      if (row)
+        tiRowDelChar(b, row, r.at);
+      break;
+    case TI_JOURNAL_TRUNCATE:
+      if (row)
+        tiRowTruncate(b, row, r.at);
+      break;
+    case TI_JOURNAL_SORT:
+      if (row && r.at >= r.row && r.at < b->numrows &&
+          r.len == sizeof(int32_t)) {
+        int32_t flags;
+        memcpy(&flags, s, sizeof(flags));
+        tiSortRows(b, r.row, r.at, flags, 0);
+      }
+      break;
+    case TI_JOURNAL_REPLACE_ROWS:
+      journalReplaceRows(b, r.row, r.at, s, r.len);
+      break;
+    }
+    edits++;
+    off += sizeof(r) + r.len + sizeof(uint32_t);
+  }
+
+  *valid = off;
+  return edits;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ journal ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+tiJournal *tiJournalOpen(tiBuffer *b, const char *path,
+                         const struct stat *base, int *replayed) {
+  *replayed = 0;
+  // held until the journal is closed: a second editor on the file must not
+  // replay the edits of the first one, nor record its own next to them
+  int fd;
+  struct stat st;
+  for (;;) {
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1)
+      return NULL;
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1 || fstat(fd, &st) == -1) {
+      int saved = errno == EWOULDBLOCK ? EBUSY : errno;
+      close(fd);
+      errno = saved;
+      return NULL;
+    }
+    // unlinked by the editor that held it before we got the lock
+    if (st.st_nlink > 0)
+      break;
+    close(fd);
+  }
+
+  tiJournal *j = calloc(1, sizeof(tiJournal));
+  if (j == NULL) {
+    close(fd);
+    errno = ENOMEM;
+    return NULL;
+  }
+  j->fd = fd;
+  j->path = strdup(path);
+  j->synced = statsNow();
+
+  struct journalHeader want;
+  journalHeader(&want, base);
+  if (st.st_size == 0) {
+    tiJournalReset(j, base);
+    b->journal = j;
+    return j;
+  }
+
+  // edits left behind by a session that never got to save them
+  char *buf = memAlloc(MEM_IO, st.st_size);
+  size_t len = 0;
+  while (buf && len < (size_t)st.st_size) {
+    ssize_t n = pread(fd, buf + len, st.st_size - len, len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    len += n;
+  }
+
+  if (buf == NULL || len < sizeof(want) || memcmp(buf, &want, sizeof(want))) {
+    // written against other contents of the file, not ours to replay
+    memFree(buf);
+    tiJournalClose(j, 1);
+    errno = ESTALE;
+    return NULL;
+  }
+
+  size_t valid;
+  *replayed = journalReplay(b, buf, len, &valid);
+  memFree(buf);
+  // a torn last record is cut so new ones follow the good ones
+  if (ftruncate(fd, valid) == -1 || lseek(fd, valid, SEEK_SET) == -1) {
+    tiJournalClose(j, 1);
+    return NULL;
+  }
+  b->journal = j;
+  return j;
+}
+
+int tiJournalReset(tiJournal *j, const struct stat *base) {
+  struct journalHeader h;
+  journalHeader(&h, base);
+  if (j->err)
+    return journalFail(j, j->err);
+  j->len = 0;
+  if (ftruncate(j->fd, 0) == -1 || pwrite(j->fd, &h, sizeof(h), 0) == -1 ||
+      lseek(j->fd, sizeof(h), SEEK_SET) == -1)
+    return journalFail(j, errno);
+  j->unsynced = 1;
+  return tiJournalSync(j, 1);
+}
+
+int tiJournalSync(tiJournal *j, int force) {
+  if (j->err)
+    return journalFail(j, j->err);
+  uint64_t now = statsNow();
+  if (!force && now - j->synced < TI_JOURNAL_INTERVAL)
+    return 0;
+  if (j->len && journalWrite(j) == -1)
+    return -1;
+  if (!j->unsynced)
+    return 0;
+  j->synced = now;
+  j->unsynced = 0;
+  return fdatasync(j->fd) == 0 ? 1 : journalFail(j, errno);
+}
+
+void tiJournalClose(tiJournal *j, int keep) {
+  if (j == NULL)
+    return;
+  // a failed journal is gone already, the path may be another editor's now
+  if (keep)
+    tiJournalSync(j, 1);
+  else if (!j->err)
+    unlink(j->path);
+  close(j->fd);
+  memFree(j->pending);
+  free(j->path);
+  free(j);
+}
+
+off_t tiJournalMark(tiJournal *j) {
+  if (j->err || (j->len && journalWrite(j) == -1))
+    return -1;
+  return lseek(j->fd, 0, SEEK_CUR);
+}
+
+int tiJournalRebase(tiJournal *j, off_t mark, const struct stat *base) {
+  off_t end = tiJournalMark(j);
+  if (end == -1 || mark == -1 || end < mark)
+    return journalFail(j, end == -1 ? errno : EINVAL);
+
+  // edits made while the file was written, usually a handful
+  size_t len = end - mark;
+  char *tail = memAlloc(MEM_IO, len + 1);
+  if (tail == NULL || pread(j->fd, tail, len, mark) != (ssize_t)len) {
+    int err = tail ? errno : ENOMEM;
+    memFree(tail);
+    return journalFail(j, err);
+  }
+
+  int ret = tiJournalReset(j, base);
+  if (ret != -1 && len) {
+    if (write(j->fd, tail, len) == (ssize_t)len) {
+      j->unsynced = 1;
+      ret = tiJournalSync(j, 1);
+    } else {
+      // the edits made during the save are lost from the journal
+      ret = journalFail(j, errno);
+    }
+  }
+  memFree(tail);
+  return ret;
+}
@@ -0,0 +1,116 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+struct editorMem tiMem;
+
+/*~~~~~~~~~~~~~~~~~~~~ memory accounting ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+const char *memNames[MEM_COUNT] = {"rows",   "chars",  "render", "hl",
+                                   "search", "frame",  "prompt", "io",
+                                   "index",  "syntax", "cold"};
+
+// every tracked block is prefixed with its size and category so memFree
+// and memRealloc can keep the per category counters exact
+typedef union memHeader {
+  struct {
+    size_t size;
+    int cat;
+  } h;
+  long double align;
+} memHeader;
+
+// counters are updated atomically since background threads (the pager
+// indexer) allocate too
+static void memPeak(struct memCategory *mc, size_t live) {
+  size_t peak = __atomic_load_n(&mc->peak, __ATOMIC_RELAXED);
+  while (live > peak &&
+         !__atomic_compare_exchange_n(&mc->peak, &peak, live, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+static void memAccount(int cat, size_t size, int sign) {
+  struct memCategory *mc = &tiMem.cat[cat];
+  if (sign > 0) {
+    memPeak(mc, __atomic_add_fetch(&mc->live, size, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&mc->allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mc->live_allocs, 1, __ATOMIC_RELAXED);
+  } else {
+    __atomic_sub_fetch(&mc->live, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&mc->live_allocs, 1, __ATOMIC_RELAXED);
+  }
+}
+
+void *memAlloc(int cat, size_t size) {
+  memHeader *mh = malloc(sizeof(memHeader) + size);
+  if (mh == NULL)
+    return NULL;
+  mh->h.size = size;
+  mh->h.cat = cat;
+  memAccount(cat, size, 1);
+  return mh + 1;
+}
+
+void *memRealloc(int cat, void *p, size_t size) {
+  if (p == NULL)
+    return memAlloc(cat, size);
+
+  memHeader *mh = (memHeader *)p - 1;
+  size_t old = mh->h.size;
+  mh = realloc(mh, sizeof(memHeader) + size);
+  if (mh == NULL)
+    return NULL;
+  mh->h.size = size;
+  struct memCategory *mc = &tiMem.cat[cat];
+  memPeak(mc, __atomic_add_fetch(&mc->live, size - old, __ATOMIC_RELAXED));
+  return mh + 1;
+}
+
+void memFree(void *p) {
+  if (p == NULL)
+    return;
+  memHeader *mh = (memHeader *)p - 1;
+  memAccount(mh->h.cat, mh->h.size, -1);
+  free(mh);
+}
+
+int memFormat(char *buf, size_t size, size_t bytes) {
+  if (bytes < 1024)
+    return snprintf(buf, size, "%zuB", bytes);
+  if (bytes < 1024 * 1024)
+    return snprintf(buf, size, "%.1fK", bytes / 1024.0);
+  if (bytes < 1024 * 1024 * 1024)
+    return snprintf(buf, size, "%.1fM", bytes / (1024.0 * 1024));
+  return snprintf(buf, size, "%.2fG", bytes / (1024.0 * 1024 * 1024));
+}
+
+size_t memTotal(void) {
+  size_t total = 0;
+  for (int i = 0; i < MEM_COUNT; ++i)
+    total += tiMem.cat[i].live;
+  return total;
+}
+
+void memReport(void) {
+  char live[16], peak[16];
+  fprintf(stderr, "%-8s %10s %10s %12s %12s\r\n", "category", "live",
+          "peak", "live allocs", "allocs");
+  for (int i = 0; i < MEM_COUNT; ++i) {
+    struct memCategory *mc = &tiMem.cat[i];
+    memFormat(live, sizeof(live), mc->live);
+    memFormat(peak, sizeof(peak), mc->peak);
+    fprintf(stderr, "%-8s %10s %10s %12zu %12zu\r\n", memNames[i], live,
+            peak, mc->live_allocs, mc->allocs);
+  }
+  memFormat(live, sizeof(live), memTotal());
+  fprintf(stderr, "%-8s %10s\r\n", "total", live);
+}
@@ -0,0 +1,356 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define PAGER_CHUNK (1 << 20)
+#define PAGER_SCAN (1 << 16)
+
+struct tiPagerRow {
+
+  int64_t off;
+  int64_t next;
+  erow row;
+};
+
+struct tiPager {
+
+  int fd;
+  int64_t size;
+  char *filename;
+
+  // marks[k] is the offset of line k * TI_PAGER_STRIDE, everything the
+  // indexer publishes is guarded by lock
+  pthread_mutex_t lock;
+  pthread_t thread;
+  int64_t *marks;
+  int64_t nmarks;
+  int64_t markcap;
+  int64_t indexed;
+  int64_t lines;
+  int done;
+  int stop;
+
+  // materialized rows, direct mapped on their offset
+  struct tiPagerRow *cache;
+  char *scan;
+};
+
+/*~~~~~~~~~~~~~~~~~~~~ indexer ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// -1 if the marks can't grow, they stay as they were
+static int pagerAddMark(tiPager *p, int64_t off) {
+  pthread_mutex_lock(&p->lock);
+  if (p->nmarks == p->markcap) {
+    int64_t cap = p->markcap ? p->markcap * 2 : 1024;
+    int64_t *marks = memRealloc(MEM_INDEX, p->marks, sizeof(int64_t) * cap);
+    if (marks == NULL) {
+      pthread_mutex_unlock(&p->lock);
+      return -1;
+    }
+    p->marks = marks;
+    p->markcap = cap;
+  }
+  p->marks[p->nmarks++] = off;
+  pthread_mutex_unlock(&p->lock);
+  return 0;
+}
+
+static void *pagerIndex(void *arg) {
+  tiPager *p = arg;
+  char *buf = memAlloc(MEM_IO, PAGER_CHUNK);
+  int64_t off = 0;
+  int64_t lines = 0;
+  char last = '\n';
+
+  // out of memory the index stops where it got to, what is past it is
+  // scanned for as before it was indexed
+  int full = buf == NULL || pagerAddMark(p, 0) == -1;
+  while (!full && off < p->size &&
+         !__atomic_load_n(&p->stop, __ATOMIC_RELAXED)) {
+    ssize_t n = pread(p->fd, buf, PAGER_CHUNK, off);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+
+    size_t count;
+    size_t *nl = tiIndexNewlines(buf, n, &count, 1);
+    if (nl == NULL)
+      break;
+    int64_t had = lines;
+    for (size_t i = 0; i < count && !full; ++i)
+      if (++lines % TI_PAGER_STRIDE == 0 &&
+          pagerAddMark(p, off + nl[i] + 1) == -1)
+        full = 1;
+    memFree(nl);
+    if (full) {
+      lines = had;
+      break;
+    }
+    last = buf[n - 1];
+    off += n;
+
+    pthread_mutex_lock(&p->lock);
+    p->indexed = off;
+    p->lines = lines;
+    pthread_mutex_unlock(&p->lock);
+  }
+  memFree(buf);
+
+  pthread_mutex_lock(&p->lock);
+  // a last line without a newline still counts
+  if (off == p->size && last != '\n')
+    p->lines++;
+  p->done = 1;
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ scanning ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// offset just past the n-th newline at or after off, or the file size
+static int64_t pagerSkipLines(tiPager *p, int64_t off, int64_t n) {
+  // most lines are short, start with a small read and grow it
+  size_t want = 4096;
+  while (n > 0 && off < p->size) {
+    ssize_t got = pread(p->fd, p->scan, want, off);
+    if (got == -1 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return p->size;
+
+    char *s = p->scan;
+    char *end = p->scan + got;
+    while (n > 0 && (s = memchr(s, '\n', end - s)) != NULL) {
+      s++;
+      n--;
+    }
+    off += n ? got : s - p->scan;
+    if (want < PAGER_SCAN)
+      want *= 2;
+  }
+
+  return off < p->size ? off : p->size;
+}
+
+// start of the line holding the byte at off
+static int64_t pagerLineStart(tiPager *p, int64_t off) {
+  int64_t want = 4096;
+  while (off > 0) {
+    int64_t from = off > want ? off - want : 0;
+    ssize_t got = pread(p->fd, p->scan, off - from, from);
+    if (got == -1 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return 0;
+
+    char *nl = memrchr(p->scan, '\n', got);
+    if (nl)
+      return from + (nl - p->scan) + 1;
+    off = from;
+    if (want < PAGER_SCAN)
+      want *= 2;
+  }
+
+  return 0;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ pager ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+tiPager *tiPagerOpen(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+
+  struct stat st;
+  tiPager *p = calloc(1, sizeof(tiPager));
+  if (p == NULL || fstat(fd, &st) == -1) {
+    int saved = errno;
+    close(fd);
+    free(p);
+    errno = saved;
+    return NULL;
+  }
+
+  p->fd = fd;
+  p->size = st.st_size;
+  p->filename = strdup(basename(filename));
+  p->cache = calloc(TI_PAGER_CACHE, sizeof(struct tiPagerRow));
+  p->scan = memAlloc(MEM_IO, PAGER_SCAN > TI_PAGER_LINE_MAX ? PAGER_SCAN
+                                                            : TI_PAGER_LINE_MAX);
+  pthread_mutex_init(&p->lock, NULL);
+  if (p->cache == NULL || p->scan == NULL ||
+      pthread_create(&p->thread, NULL, pagerIndex, p) != 0) {
+    free(p->cache);
+    memFree(p->scan);
+    free(p->filename);
+    close(fd);
+    free(p);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  return p;
+}
+
+void tiPagerClose(tiPager *p) {
+  if (p == NULL)
+    return;
+  __atomic_store_n(&p->stop, 1, __ATOMIC_RELAXED);
+  pthread_join(p->thread, NULL);
+  pthread_mutex_destroy(&p->lock);
+
+  for (int i = 0; i < TI_PAGER_CACHE; ++i)
+    tiFreeRow(&p->cache[i].row);
+  free(p->cache);
+  memFree(p->marks);
+  memFree(p->scan);
+  free(p->filename);
+  close(p->fd);
+  free(p);
+}
+
+const char *tiPagerName(tiPager *p) { return p->filename; }
+
+int64_t tiPagerSize(tiPager *p) { return p->size; }
+
+int tiPagerProgress(tiPager *p, int64_t *indexed, int64_t *lines) {
+  pthread_mutex_lock(&p->lock);
+  *indexed = p->indexed;
+  *lines = p->lines;
+  int done = p->done;
+  pthread_mutex_unlock(&p->lock);
+  return done;
+}
+
+erow *tiPagerRow(tiPager *p, int64_t off, int64_t *next) {
+  if (off < 0 || off >= p->size)
+    return NULL;
+
+  struct tiPagerRow *pr =
+      &p->cache[((uint64_t)off * 0x9e3779b97f4a7c15ULL) >> 54 &
+                (TI_PAGER_CACHE - 1)];
+  if (pr->row.chars && pr->off == off) {
+    *next = pr->next;
+    return &pr->row;
+  }
+
+  // try a short read first, only long lines need the full TI_PAGER_LINE_MAX
+  ssize_t got;
+  char *nl = NULL;
+  for (size_t want = 4096;; want = TI_PAGER_LINE_MAX) {
+    while ((got = pread(p->fd, p->scan, want, off)) == -1 && errno == EINTR)
+      ;
+    if (got < 0)
+      got = 0;
+    nl = memchr(p->scan, '\n', got);
+    if (nl || (size_t)got < want || want == TI_PAGER_LINE_MAX)
+      break;
+  }
+
+  int len = nl ? nl - p->scan : got;
+  int used = nl ? len + 1 : got;
+  if (len > 0 && p->scan[len - 1] == '\r')
+    len--;
+
+  tiFreeRow(&pr->row);
+  memset(&pr->row, 0, sizeof(erow));
+  pr->off = off;
+  pr->row.size = len;
+  pr->row.chars = memAlloc(MEM_CHARS, len + 1);
+  memcpy(pr->row.chars, p->scan, len);
+  pr->row.chars[len] = '\0';
+  tiRenderRow(&pr->row);
+
+  // longer lines are cut, the rest of them is skipped
+  if (nl == NULL && got == TI_PAGER_LINE_MAX)
+    pr->next = pagerSkipLines(p, off + got, 1);
+  else
+    pr->next = off + used;
+
+  *next = pr->next;
+  return &pr->row;
+}
+
+int64_t tiPagerNextLine(tiPager *p, int64_t off) {
+  return pagerSkipLines(p, off, 1);
+}
+
+int64_t tiPagerPrevLine(tiPager *p, int64_t off) {
+  return off > 0 ? pagerLineStart(p, off - 1) : 0;
+}
+
+int tiPagerLineOf(tiPager *p, int64_t off, int64_t *line) {
+  pthread_mutex_lock(&p->lock);
+  if (off > p->indexed || p->nmarks == 0) {
+    pthread_mutex_unlock(&p->lock);
+    return -1;
+  }
+
+  int64_t lo = 0, hi = p->nmarks - 1;
+  while (lo < hi) {
+    int64_t mid = (lo + hi + 1) / 2;
+    if (p->marks[mid] <= off)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  int64_t from = p->marks[lo];
+  pthread_mutex_unlock(&p->lock);
+
+  *line = lo * TI_PAGER_STRIDE;
+  while (from < off) {
+    int64_t want = off - from < PAGER_SCAN ? off - from : PAGER_SCAN;
+    ssize_t got = pread(p->fd, p->scan, want, from);
+    if (got == -1 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      break;
+    for (char *s = p->scan, *end = p->scan + got;
+         (s = memchr(s, '\n', end - s)) != NULL; s++)
+      (*line)++;
+    from += got;
+  }
+
+  return 0;
+}
+
+int tiPagerSeekLine(tiPager *p, int64_t line, int64_t *off) {
+  if (line < 0)
+    line = 0;
+
+  pthread_mutex_lock(&p->lock);
+  if (line <= p->lines && line / TI_PAGER_STRIDE < p->nmarks) {
+    int64_t from = p->marks[line / TI_PAGER_STRIDE];
+    pthread_mutex_unlock(&p->lock);
+    *off = pagerSkipLines(p, from, line % TI_PAGER_STRIDE);
+    if (*off == p->size && p->size > 0)
+      *off = pagerLineStart(p, p->size - 1);
+    return 0;
+  }
+
+  // past the indexed part: extrapolate from the average line length so far
+  double avg = p->lines ? (double)p->indexed / p->lines : 80;
+  int64_t est = p->indexed + (int64_t)((line - p->lines) * avg);
+  pthread_mutex_unlock(&p->lock);
+
+  if (est >= p->size)
+    est = p->size - 1;
+  *off = est > 0 ? pagerLineStart(p, est) : 0;
+  return 1;
+}
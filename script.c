@@ -0,0 +1,539 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// groups of a substitution the replacement can refer to, \0 to \9
+#define SCRIPT_GROUPS 10
+
+enum scriptOp {
+
+  SCRIPT_SUBSTITUTE,
+  SCRIPT_DELETE,
+  // g/re/d, or v/re/d with keep set
+  SCRIPT_GLOBAL,
+  SCRIPT_SORT,
+  SCRIPT_WRITE,
+  SCRIPT_QUIT
+
+};
+
+struct scriptCmd {
+
+  int op;
+  // the command as given, its range is read again against each file
+  const char *text;
+  // a pattern without special characters is searched for as is
+  regex_t re;
+  int regex;
+  char *lit;
+  size_t litlen;
+  char *rep;
+  // s///g, v instead of g, sort flags
+  int global, keep, flags;
+};
+
+struct tiScript {
+
+  struct scriptCmd *cmds;
+  int n;
+};
+
+// what each thread reuses file to file
+struct scriptScratch {
+
+  char *buf;
+  size_t len, cap;
+  int *rows;
+  size_t rowcap;
+};
+
+struct scriptJob {
+
+  const tiScript *script;
+  char **files;
+  struct tiScriptResult *res;
+  int n;
+  pthread_mutex_t lock;
+  int next;
+};
+
+/*~~~~~~~~~~~~~~~~~~~~ ranges ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// one line address: N, . for line cur or $ for the last, then any number
+// of +N or -N (on their own, from line cur). Returns the rest of s
+static char *tiParseAddress(char *s, int numrows, int cur, int *line) {
+  char *p = s;
+  if (isdigit((unsigned char)*p)) {
+    *line = strtol(p, &p, 10) - 1;
+  } else if (*p == '.') {
+    *line = cur;
+    p++;
+  } else if (*p == '$') {
+    *line = numrows - 1;
+    p++;
+  }
+  while (*p == '+' || *p == '-') {
+    if (p == s)
+      *line = cur;
+    int sign = *p++ == '+' ? 1 : -1;
+    *line += sign * (isdigit((unsigned char)*p) ? strtol(p, &p, 10) : 1);
+  }
+  return p;
+}
+
+char *tiParseRange(char *s, int numrows, int cur, int *first, int *last) {
+  *first = cur;
+  if (*s == '%') {
+    *first = 0;
+    *last = numrows - 1;
+    s++;
+  } else {
+    s = tiParseAddress(s, numrows, cur, first);
+    *last = *first;
+    if (*s == ',')
+      s = tiParseAddress(s + 1, numrows, cur, last);
+  }
+  if (*first > *last) {
+    int t = *first;
+    *first = *last;
+    *last = t;
+  }
+  if (*first < 0)
+    *first = 0;
+  if (*last >= numrows)
+    *last = numrows - 1;
+  return s;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ compile ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// the text up to the next unescaped delim, with \delim turned into delim.
+// Returns where it stopped, at the delim or the end of s
+static const char *scriptField(const char *s, char delim, char **out) {
+  size_t n = 0;
+  *out = malloc(strlen(s) + 1);
+  if (*out == NULL)
+    return NULL;
+  for (; *s && *s != delim; ++s) {
+    if (s[0] == '\\' && s[1] == delim)
+      s++;
+    else if (s[0] == '\\' && s[1])
+      (*out)[n++] = *s++;
+    (*out)[n++] = *s;
+  }
+  (*out)[n] = '\0';
+  return s;
+}
+
+static int scriptPattern(struct scriptCmd *c, char *pat, int icase,
+                         char *err, size_t errlen) {
+  if (*pat == '\0') {
+    free(pat);
+    snprintf(err, errlen, "empty pattern");
+    return -1;
+  }
+  if (!icase && strpbrk(pat, "\\.[]()*+?{}|^$") == NULL) {
+    c->lit = pat;
+    c->litlen = strlen(pat);
+    return 0;
+  }
+  int rc = regcomp(&c->re, pat, REG_EXTENDED | (icase ? REG_ICASE : 0));
+  free(pat);
+  if (rc) {
+    regerror(rc, &c->re, err, errlen);
+    return -1;
+  }
+  c->regex = 1;
+  return 0;
+}
+
+// [range]s/re/rep/[gi], [range]g/re/d or v/re/d, [range]d, [range]sort
+// [n][u], [range]uniq, w, q
+static int scriptCompile(struct scriptCmd *c, const char *text, char *err,
+                         size_t errlen) {
+  int first, last;
+  const char *s = tiParseRange((char *)text, INT_MAX, 0, &first, &last);
+  c->text = text;
+
+  if ((s[0] == 's' || s[0] == 'g' || s[0] == 'v') && s[1] &&
+      !isalnum((unsigned char)s[1]) && s[1] != '\\' && s[1] != ' ') {
+    char delim = s[1];
+    char *pat;
+    c->op = s[0] == 's' ? SCRIPT_SUBSTITUTE : SCRIPT_GLOBAL;
+    c->keep = s[0] == 'v';
+    s = scriptField(s + 2, delim, &pat);
+    if (s == NULL || *s != delim) {
+      free(pat);
+      snprintf(err, errlen, "unterminated pattern");
+      return -1;
+    }
+    int icase = 0;
+    if (c->op == SCRIPT_SUBSTITUTE) {
+      s = scriptField(s + 1, delim, &c->rep);
+      if (s == NULL) {
+        free(pat);
+        snprintf(err, errlen, "%s", strerror(ENOMEM));
+        return -1;
+      }
+      s += *s == delim;
+      for (; *s == 'g' || *s == 'i'; ++s) {
+        if (*s == 'g')
+          c->global = 1;
+        else
+          icase = 1;
+      }
+    } else if (!strcmp(s + 1, "d")) {
+      s += 2;
+    } else {
+      free(pat);
+      snprintf(err, errlen, "only %c/re/d is supported", c->keep ? 'v' : 'g');
+      return -1;
+    }
+    if (*s) {
+      free(pat);
+      snprintf(err, errlen, "trailing characters: %s", s);
+      return -1;
+    }
+    return scriptPattern(c, pat, icase, err, errlen);
+  }
+
+  if (!strcmp(s, "d") || !strcmp(s, "delete")) {
+    c->op = SCRIPT_DELETE;
+  } else if (!strncmp(s, "sort", 4) && strspn(s + 4, " nu") == strlen(s + 4)) {
+    c->op = SCRIPT_SORT;
+    c->flags |= strchr(s + 4, 'n') ? TI_SORT_NUMERIC : 0;
+    c->flags |= strchr(s + 4, 'u') ? TI_SORT_UNIQUE : 0;
+  } else if (!strcmp(s, "uniq")) {
+    c->op = SCRIPT_SORT;
+    c->flags = TI_SORT_UNIQUE | TI_SORT_KEEP_ORDER;
+  } else if (!strcmp(s, "w") || !strcmp(s, "write")) {
+    c->op = SCRIPT_WRITE;
+  } else if (!strcmp(s, "wq") || !strcmp(s, "x")) {
+    c->op = SCRIPT_WRITE;
+    c->keep = 1;
+  } else if (!strcmp(s, "q") || !strcmp(s, "quit")) {
+    c->op = SCRIPT_QUIT;
+  } else {
+    snprintf(err, errlen, "unknown command");
+    return -1;
+  }
+  return 0;
+}
+
+tiScript *tiScriptNew(char **cmds, int n, int *bad, char *err,
+                      size_t errlen) {
+  tiScript *sc = calloc(1, sizeof(tiScript));
+  if (sc)
+    sc->cmds = calloc(n + 1, sizeof(struct scriptCmd));
+  if (sc == NULL || sc->cmds == NULL) {
+    free(sc);
+    *bad = 0;
+    snprintf(err, errlen, "%s", strerror(ENOMEM));
+    return NULL;
+  }
+  for (; sc->n < n; sc->n++) {
+    if (scriptCompile(&sc->cmds[sc->n], cmds[sc->n], err, errlen) == -1) {
+      *bad = sc->n;
+      tiScriptFree(sc);
+      return NULL;
+    }
+  }
+  return sc;
+}
+
+void tiScriptFree(tiScript *sc) {
+  if (sc == NULL)
+    return;
+  // a command that failed to compile is freed too, as far as it got
+  for (int i = 0; i <= sc->n; ++i) {
+    if (sc->cmds[i].regex)
+      regfree(&sc->cmds[i].re);
+    free(sc->cmds[i].lit);
+    free(sc->cmds[i].rep);
+  }
+  free(sc->cmds);
+  free(sc);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ run ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int scriptPut(struct scriptScratch *x, const char *s, size_t len) {
+  if (x->len + len + 1 > x->cap) {
+    size_t cap = x->cap ? x->cap : 256;
+    while (cap < x->len + len + 1)
+      cap *= 2;
+    char *buf = memRealloc(MEM_IO, x->buf, cap);
+    if (buf == NULL)
+      return -1;
+    x->buf = buf;
+    x->cap = cap;
+  }
+  memcpy(x->buf + x->len, s, len);
+  x->len += len;
+  return 0;
+}
+
+// the first match in s[from, size) into m[0], and the groups after it
+static int scriptMatch(const struct scriptCmd *c, const char *s, size_t size,
+                       size_t from, regmatch_t *m) {
+  if (!c->regex) {
+    const char *p = memmem(s + from, size - from, c->lit, c->litlen);
+    if (p == NULL)
+      return 0;
+    m[0].rm_so = p - s;
+    m[0].rm_eo = m[0].rm_so + c->litlen;
+    return 1;
+  }
+  if (regexec(&c->re, s + from, SCRIPT_GROUPS, m, from ? REG_NOTBOL : 0))
+    return 0;
+  for (int g = 0; g < SCRIPT_GROUPS && m[g].rm_so != -1; ++g) {
+    m[g].rm_so += from;
+    m[g].rm_eo += from;
+  }
+  return 1;
+}
+
+// rep with & the match, \0 to \9 its groups and \& or \\ themselves
+static int scriptReplace(struct scriptScratch *x, const struct scriptCmd *c,
+                         const char *s, const regmatch_t *m) {
+  for (const char *r = c->rep; *r; ++r) {
+    int g = -1;
+    if (*r == '&')
+      g = 0;
+    else if (r[0] == '\\' && isdigit((unsigned char)r[1]))
+      g = *++r - '0';
+    else if (r[0] == '\\' && r[1])
+      r++;
+    if (g == -1) {
+      if (scriptPut(x, r, 1) == -1)
+        return -1;
+    } else if ((g == 0 || c->regex) && m[g].rm_so != -1 &&
+               scriptPut(x, s + m[g].rm_so, m[g].rm_eo - m[g].rm_so) == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// the row with its matches replaced into x, returns how many there were
+static int scriptSubstituteRow(struct scriptScratch *x,
+                               const struct scriptCmd *c, const char *s,
+                               size_t size) {
+  regmatch_t m[SCRIPT_GROUPS];
+  size_t pos = 0;
+  // where the last match that wasn't empty ended, as sed, an empty match
+  // right there is no match
+  size_t after = (size_t)-1;
+  int subs = 0;
+  x->len = 0;
+  while (pos <= size && scriptMatch(c, s, size, pos, m)) {
+    size_t so = m[0].rm_so, eo = m[0].rm_eo;
+    if (scriptPut(x, s + pos, so - pos) == -1)
+      return -1;
+    if (so != eo || so != after) {
+      if (scriptReplace(x, c, s, m) == -1)
+        return -1;
+      subs++;
+    }
+    pos = eo;
+    if (so != eo)
+      after = eo;
+    // an empty match takes the character after it along, to move on
+    if (so == eo) {
+      if (pos < size && scriptPut(x, s + pos, 1) == -1)
+        return -1;
+      pos++;
+    }
+    if (!c->global && subs)
+      break;
+  }
+  if (subs && pos < size && scriptPut(x, s + pos, size - pos) == -1)
+    return -1;
+  return subs;
+}
+
+static int *scriptRows(struct scriptScratch *x, size_t n) {
+  if (n > x->rowcap) {
+    int *rows = memRealloc(MEM_ROWS, x->rows, sizeof(int) * n);
+    if (rows == NULL)
+      return NULL;
+    x->rows = rows;
+    x->rowcap = n;
+  }
+  return x->rows;
+}
+
+// reads path into b as rows that are never rendered or highlighted
+static int scriptLoad(tiBuffer *b, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return errno;
+  struct stat st;
+  int err = fstat(fd, &st) == -1 ? errno : 0;
+  if (!err && !S_ISREG(st.st_mode))
+    err = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+  if (err) {
+    close(fd);
+    return err;
+  }
+  if (st.st_size > 0) {
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    size_t count = 0;
+    size_t *nl = map != MAP_FAILED
+                     ? tiIndexNewlines(map, st.st_size, &count, 1)
+                     : NULL;
+    // no row leaves a comment open, there is no syntax to open one
+    unsigned char *open = nl ? memAlloc(MEM_ROWS, count / 8 + 1) : NULL;
+    if (open) {
+      memset(open, 0, count / 8 + 1);
+      tiAppendIndexed(b, map, st.st_size, nl, count, open);
+    } else {
+      err = map == MAP_FAILED ? errno : ENOMEM;
+    }
+    memFree(open);
+    memFree(nl);
+    if (map != MAP_FAILED)
+      munmap(map, st.st_size);
+  }
+  close(fd);
+  b->dirty = 0;
+  return err;
+}
+
+static int scriptRunFile(const tiScript *sc, const char *path,
+                         struct scriptScratch *x, struct tiScriptResult *r) {
+  tiBuffer *b = tiBufferNew();
+  if (b == NULL || (b->filename = strdup(basename(path))) == NULL) {
+    tiBufferFree(b);
+    return ENOMEM;
+  }
+  int err = scriptLoad(b, path);
+  // one batch the script never leaves: changed rows are only marked, and
+  // nothing is rendered or highlighted before the buffer is freed
+  tiBufferBatchBegin(b);
+
+  for (int i = 0; !err && i < sc->n; ++i) {
+    const struct scriptCmd *c = &sc->cmds[i];
+    int first, last;
+    // without a range, commands apply to every line
+    if (tiParseRange((char *)c->text, b->numrows, 0, &first, &last) ==
+        c->text) {
+      first = 0;
+      last = b->numrows - 1;
+    }
+
+    if (c->op == SCRIPT_SUBSTITUTE) {
+      for (int j = first; j <= last && !err; ++j) {
+        erow *row = &b->row[j];
+        int subs = scriptSubstituteRow(x, c, tiRowChars(row), row->size);
+        if (subs == -1) {
+          err = ENOMEM;
+        } else if (subs) {
+          tiRowTruncate(b, row, 0);
+          tiRowAppendString(b, row, x->buf, x->len);
+          r->subs += subs;
+        }
+      }
+    } else if (c->op == SCRIPT_DELETE || c->op == SCRIPT_GLOBAL) {
+      int *rows = scriptRows(x, last - first + 1);
+      int n = 0;
+      regmatch_t m[SCRIPT_GROUPS];
+      for (int j = first; rows && j <= last; ++j)
+        if (c->op == SCRIPT_DELETE ||
+            scriptMatch(c, tiRowChars(&b->row[j]), b->row[j].size, 0, m) !=
+                c->keep)
+          rows[n++] = j;
+      if (rows == NULL && last >= first)
+        err = ENOMEM;
+      else if (n)
+        tiDelRows(b, rows, n);
+      r->deleted += n;
+    } else if (c->op == SCRIPT_SORT) {
+      int dropped = last > first ? tiSortRows(b, first, last, c->flags, 1) : 0;
+      if (dropped == -1)
+        err = ENOMEM;
+      else
+        r->deleted += dropped;
+    } else if (c->op == SCRIPT_WRITE) {
+      // an unchanged file is left alone, mtime and all
+      if (b->dirty && tiSave(b, path) == -1)
+        err = errno;
+      else
+        r->saved |= r->modified;
+      if (c->keep)
+        break;
+    } else if (c->op == SCRIPT_QUIT) {
+      break;
+    }
+    r->modified |= b->dirty != 0;
+  }
+
+  tiBufferFree(b);
+  return err;
+}
+
+static void *scriptWorker(void *arg) {
+  struct scriptJob *job = arg;
+  struct scriptScratch x = {0};
+  while (1) {
+    pthread_mutex_lock(&job->lock);
+    int i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->n)
+      break;
+    struct tiScriptResult *r = &job->res[i];
+    uint64_t start = statsNow();
+    memset(r, 0, sizeof(*r));
+    r->err = scriptRunFile(job->script, job->files[i], &x, r);
+    r->ns = statsNow() - start;
+  }
+  memFree(x.buf);
+  memFree(x.rows);
+  return NULL;
+}
+
+int tiScriptRun(const tiScript *sc, char **files, int n, int threads,
+                struct tiScriptResult *res) {
+  struct scriptJob job = {sc, files, res, n, PTHREAD_MUTEX_INITIALIZER, 0};
+  if (threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+  if (threads > TI_SCRIPT_THREADS)
+    threads = TI_SCRIPT_THREADS;
+  if (threads > n)
+    threads = n;
+  pthread_t tid[TI_SCRIPT_THREADS];
+  int started[TI_SCRIPT_THREADS] = {0};
+  for (int t = 1; t < threads; ++t)
+    started[t] = pthread_create(&tid[t], NULL, scriptWorker, &job) == 0;
+  scriptWorker(&job);
+  for (int t = 1; t < threads; ++t)
+    if (started[t])
+      pthread_join(tid[t], NULL);
+  pthread_mutex_destroy(&job.lock);
+
+  int failed = 0;
+  for (int i = 0; i < n; ++i)
+    failed += res[i].err != 0;
+  return failed;
+}
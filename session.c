@@ -0,0 +1,386 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define SESSION_MAGIC "TIW1"
+
+// A session image, used in place once mapped: the header, the file's
+// path, the offset of every '\n' in it as tiIndexNewlines found them and
+// one bit per row for the comment state it leaves. Offsets are from the
+// start of the image
+struct sesHeader {
+
+  char magic[4];
+  // sizeof(size_t) of the index
+  uint32_t word;
+  uint64_t size;
+  // the file the rows were read from
+  int64_t file_size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t hash;
+  // what the comment states depend on in the language, see sesSyntax
+  uint64_t syntax;
+  uint64_t path;
+  uint64_t lines;
+  uint64_t nlines;
+  uint64_t open;
+  uint64_t numrows;
+  int32_t cx, cy;
+  int32_t rowoff, coloff;
+};
+
+/*~~~~~~~~~~~~~~~~~~~~ hashing ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static uint64_t sesMix(uint64_t h, uint64_t w) {
+  h = (h ^ w) * 0xff51afd7ed558ccdULL;
+  return h ^ (h >> 32);
+}
+
+// 64-bit hash of len bytes in four independent lanes of 8 bytes, so the
+// multiplies of one lane overlap those of the others
+static uint64_t sesHash(const char *s, size_t len) {
+  uint64_t h[4] = {len, 0x9e3779b97f4a7c15ULL, 0xc4ceb9fe1a85ec53ULL,
+                   0x2545f4914f6cdd1dULL};
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    for (int k = 0; k < 4; ++k) {
+      uint64_t w;
+      memcpy(&w, s + i + 8 * k, 8);
+      h[k] = sesMix(h[k], w);
+    }
+  }
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, 8);
+    h[0] = sesMix(h[0], w);
+  }
+  uint64_t w = 0;
+  memcpy(&w, s + i, len - i);
+  h[1] = sesMix(h[1], w);
+  return sesMix(sesMix(h[0], h[1]), sesMix(h[2], h[3]));
+}
+
+static uint64_t sesString(uint64_t h, const char *s) {
+  return sesMix(h, s ? sesHash(s, strlen(s)) : 0);
+}
+
+// the parts of a language the comment state of a row depends on; keywords
+// don't change where comments open and close
+static uint64_t sesSyntax(const struct editorSyntax *syn) {
+  if (syn == NULL)
+    return 0;
+  uint64_t h = sesString(1, syn->filetype);
+  h = sesString(h, syn->single_line_comment_start);
+  h = sesString(h, syn->multi_line_comment_start);
+  h = sesString(h, syn->multi_line_comment_end);
+  return sesMix(h, syn->flags);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ sessions ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+char *tiSessionPath(const char *filename) {
+  char *real = realpath(filename, NULL);
+  if (real == NULL)
+    return NULL;
+  uint64_t h = sesHash(real, strlen(real));
+  free(real);
+
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  char path[4096];
+  if (base && *base)
+    snprintf(path, sizeof(path), "%s/ti/sessions/%016llx", base,
+             (unsigned long long)h);
+  else if (home && *home)
+    snprintf(path, sizeof(path), "%s/.cache/ti/sessions/%016llx", home,
+             (unsigned long long)h);
+  else
+    return NULL;
+  return strdup(path);
+}
+
+// checks the image was saved for real as st describes it, except for the
+// bytes themselves, and that its index can be followed through the file
+static int sesFresh(const char *img, size_t size, const char *real,
+                    const struct stat *st, uint64_t syntax) {
+  const struct sesHeader *h = (const struct sesHeader *)img;
+  if (size < sizeof(*h) || memcmp(h->magic, SESSION_MAGIC, 4) ||
+      h->word != sizeof(size_t) || h->size != size ||
+      h->file_size != st->st_size || h->mtime_sec != st->st_mtim.tv_sec ||
+      h->mtime_nsec != st->st_mtim.tv_nsec || h->syntax != syntax ||
+      h->path >= size ||
+      strnlen(img + h->path, size - h->path) == size - h->path ||
+      strcmp(img + h->path, real) || h->lines > size ||
+      h->nlines > (size - h->lines) / sizeof(size_t) || h->open > size ||
+      h->numrows > INT32_MAX || (h->numrows + 7) / 8 > size - h->open ||
+      h->lines % sizeof(size_t))
+    return 0;
+
+  const size_t *nl = (const size_t *)(img + h->lines);
+  size_t prev = 0;
+  for (uint64_t i = 0; i < h->nlines; ++i) {
+    if (nl[i] >= (size_t)st->st_size || (i && nl[i] <= prev))
+      return 0;
+    prev = nl[i];
+  }
+  size_t last = h->nlines ? nl[h->nlines - 1] + 1 : 0;
+  return h->numrows == h->nlines + (last < (size_t)st->st_size);
+}
+
+int tiSessionOpen(tiBuffer *b, const char *filename, const char *path,
+                  struct tiSessionView *view) {
+  char *real = realpath(filename, NULL);
+  if (real == NULL)
+    return 0;
+  int fd = open(filename, O_RDONLY);
+  int sfd = open(path, O_RDONLY);
+  struct stat st, sst;
+  char *map = MAP_FAILED, *img = MAP_FAILED;
+  if (fd != -1 && sfd != -1 && fstat(fd, &st) == 0 && fstat(sfd, &sst) == 0 &&
+      S_ISREG(st.st_mode) && st.st_size > 0 && sst.st_size > 0) {
+    img = mmap(NULL, sst.st_size, PROT_READ, MAP_PRIVATE, sfd, 0);
+    if (img != MAP_FAILED)
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if (fd != -1)
+    close(fd);
+  if (sfd != -1)
+    close(sfd);
+
+  int ret = 0;
+  if (map != MAP_FAILED) {
+    // the comment states are those of the language the file opens in
+    if (b->filename != filename) {
+      char *name = strdup(basename(filename));
+      free(b->filename);
+      b->filename = name;
+    }
+    tiSelectSyntax(b);
+
+    const struct sesHeader *h = (const struct sesHeader *)img;
+    if (sesFresh(img, sst.st_size, real, &st, sesSyntax(b->syntax)) &&
+        sesHash(map, st.st_size) == h->hash) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      tiAppendIndexed(b, map, st.st_size, (const size_t *)(img + h->lines),
+                      h->nlines, (const unsigned char *)img + h->open);
+      b->dirty = 0;
+      view->cx = h->cx;
+      view->cy = h->cy;
+      view->rowoff = h->rowoff;
+      view->coloff = h->coloff;
+      ret = 1;
+    }
+    munmap(map, st.st_size);
+  }
+  if (img != MAP_FAILED)
+    munmap(img, sst.st_size);
+  free(real);
+  return ret;
+}
+
+// a session already saved for the file as it is only needs the new view
+static int sesUpdate(tiBuffer *b, const char *real, const char *path,
+                     const struct stat *st, const struct tiSessionView *view) {
+  int fd = open(path, O_RDWR);
+  struct stat sst;
+  if (fd == -1)
+    return -1;
+  char *img = MAP_FAILED;
+  if (fstat(fd, &sst) == 0 && sst.st_size > 0)
+    img = mmap(NULL, sst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int ret = -1;
+  if (img != MAP_FAILED) {
+    const struct sesHeader *h = (const struct sesHeader *)img;
+    int32_t pos[4] = {view->cx, view->cy, view->rowoff, view->coloff};
+    if (sesFresh(img, sst.st_size, real, st, sesSyntax(b->syntax)) &&
+        h->numrows == (uint64_t)b->numrows &&
+        pwrite(fd, pos, sizeof(pos), offsetof(struct sesHeader, cx)) ==
+            sizeof(pos))
+      ret = 0;
+    munmap(img, sst.st_size);
+  }
+  close(fd);
+  return ret;
+}
+
+static int sesWrite(const char *path, const char *img, size_t size) {
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+  // the sessions directory may not exist yet
+  char *slash = strrchr(tmp, '/');
+  for (char *p = tmp + 1; slash && p <= slash; ++p) {
+    if (*p == '/') {
+      *p = '\0';
+      mkdir(tmp, 0700);
+      *p = '/';
+    }
+  }
+
+  int fd = mkstemp(tmp);
+  if (fd == -1)
+    return -1;
+  int ok = write(fd, img, size) == (ssize_t)size;
+  if (close(fd) == -1 || !ok || rename(tmp, path) == -1) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+struct sesEntry {
+
+  char name[256];
+  struct timespec mtime;
+};
+
+static int sesOlder(const void *a, const void *b) {
+  const struct timespec *x = &((const struct sesEntry *)a)->mtime;
+  const struct timespec *y = &((const struct sesEntry *)b)->mtime;
+  if (x->tv_sec != y->tv_sec)
+    return x->tv_sec < y->tv_sec ? -1 : 1;
+  return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// removes the least recently saved sessions beside path beyond
+// TI_SESSION_KEEP. Files being written have a '.' in their name
+static void sesPrune(const char *path) {
+  char dir[4096];
+  snprintf(dir, sizeof(dir), "%s", path);
+  char *slash = strrchr(dir, '/');
+  if (slash == NULL)
+    return;
+  *slash = '\0';
+  DIR *d = opendir(dir);
+  if (d == NULL)
+    return;
+
+  struct sesEntry *e = NULL;
+  size_t n = 0, cap = 0;
+  struct dirent *de;
+  while ((de = readdir(d)) != NULL) {
+    struct stat st;
+    if (strchr(de->d_name, '.') || fstatat(dirfd(d), de->d_name, &st, 0) ||
+        !S_ISREG(st.st_mode))
+      continue;
+    if (n == cap) {
+      cap = cap ? cap * 2 : TI_SESSION_KEEP * 2;
+      struct sesEntry *grown = realloc(e, sizeof(*e) * cap);
+      if (grown == NULL)
+        break;
+      e = grown;
+    }
+    snprintf(e[n].name, sizeof(e[n].name), "%s", de->d_name);
+    e[n++].mtime = st.st_mtim;
+  }
+  if (n > TI_SESSION_KEEP) {
+    qsort(e, n, sizeof(*e), sesOlder);
+    for (size_t i = 0; i < n - TI_SESSION_KEEP; ++i)
+      unlinkat(dirfd(d), e[i].name, 0);
+  }
+  free(e);
+  closedir(d);
+}
+
+int tiSessionSave(tiBuffer *b, const char *filename, const char *path,
+                  const struct stat *base, const struct tiSessionView *view) {
+  if (b->dirty) {
+    errno = EBUSY;
+    return -1;
+  }
+  char *real = realpath(filename, NULL);
+  if (real == NULL)
+    return -1;
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+      st.st_size == 0 || st.st_ino != base->st_ino ||
+      st.st_size != base->st_size ||
+      st.st_mtim.tv_sec != base->st_mtim.tv_sec ||
+      st.st_mtim.tv_nsec != base->st_mtim.tv_nsec) {
+    if (fd != -1)
+      close(fd);
+    free(real);
+    errno = ESTALE;
+    return -1;
+  }
+  if (sesUpdate(b, real, path, &st, view) == 0) {
+    close(fd);
+    free(real);
+    return 0;
+  }
+
+  char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    free(real);
+    return -1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  size_t nlines;
+  size_t *nl = tiIndexNewlines(map, st.st_size, &nlines, 0);
+  size_t last = nlines ? nl[nlines - 1] + 1 : 0;
+  size_t numrows = nlines + (last < (size_t)st.st_size);
+
+  // the rows must be the lines of the file for their states to be its
+  int ret = -1;
+  errno = ESTALE;
+  if (nl && numrows == (size_t)b->numrows) {
+    size_t plen = strlen(real) + 1;
+    size_t lines = (sizeof(struct sesHeader) + plen + 7) & ~(size_t)7;
+    size_t open = lines + nlines * sizeof(size_t);
+    size_t size = open + (numrows + 7) / 8;
+    char *img = memAlloc(MEM_IO, size);
+    if (img) {
+      memset(img, 0, size);
+      struct sesHeader *h = (struct sesHeader *)img;
+      memcpy(h->magic, SESSION_MAGIC, 4);
+      h->word = sizeof(size_t);
+      h->size = size;
+      h->file_size = st.st_size;
+      h->mtime_sec = st.st_mtim.tv_sec;
+      h->mtime_nsec = st.st_mtim.tv_nsec;
+      h->hash = sesHash(map, st.st_size);
+      h->syntax = sesSyntax(b->syntax);
+      h->path = sizeof(struct sesHeader);
+      h->lines = lines;
+      h->nlines = nlines;
+      h->open = open;
+      h->numrows = numrows;
+      h->cx = view->cx;
+      h->cy = view->cy;
+      h->rowoff = view->rowoff;
+      h->coloff = view->coloff;
+      memcpy(img + h->path, real, plen);
+      memcpy(img + lines, nl, nlines * sizeof(size_t));
+      unsigned char *bits = (unsigned char *)img + open;
+      for (size_t j = 0; j < numrows; ++j)
+        if (b->row[j].hl_open_comment)
+          bits[j / 8] |= 1 << (j % 8);
+      ret = sesWrite(path, img, size);
+      memFree(img);
+      sesPrune(path);
+    }
+  }
+  memFree(nl);
+  munmap(map, st.st_size);
+  free(real);
+  return ret;
+}
@@ -0,0 +1,250 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define SNAPSHOT_CHUNK (1 << 20)
+
+struct tiSnapshotRow {
+
+  const char *chars;
+  int size;
+  // held through the intern pool rather than retired
+  int interned;
+  // packed at coldoff in cold, which the snapshot holds a reference to
+  tiColdBlock *cold;
+  unsigned coldoff;
+};
+
+struct tiSnapshot {
+
+  struct tiSnapshotRow *rows;
+  int numrows;
+  int dirty;
+  char *path;
+  pthread_t thread;
+  int started;
+  int done;
+  ssize_t written;
+  int err;
+
+  // row bytes the buffer has replaced or dropped since the snapshot was
+  // taken, freed with it
+  char **retired;
+  int nretired;
+  int retiredcap;
+};
+
+/*~~~~~~~~~~~~~~~~~~~~ writer ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int snapshotFlush(int fd, const char *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = write(fd, buf + done, len - done);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    done += n;
+  }
+  return 0;
+}
+
+static ssize_t snapshotWriteRows(tiSnapshot *s, int fd, char *buf) {
+  ssize_t total = 0;
+  size_t len = 0;
+  // cold rows are unpacked here a block at a time, the block cache belongs
+  // to the editor's thread
+  const tiColdBlock *cold = NULL;
+  char *raw = NULL;
+  for (int j = 0; j < s->numrows; ++j) {
+    const char *chars = s->rows[j].chars;
+    size_t size = s->rows[j].size;
+    if (s->rows[j].cold) {
+      if (s->rows[j].cold != cold) {
+        free(raw);
+        cold = s->rows[j].cold;
+        raw = malloc(tiColdSize(cold));
+        if (raw == NULL || tiColdUnpack(cold, raw) == -1) {
+          free(raw);
+          errno = EIO;
+          return -1;
+        }
+      }
+      chars = raw + s->rows[j].coldoff;
+    }
+    if (len + size + 1 > SNAPSHOT_CHUNK) {
+      if (snapshotFlush(fd, buf, len) == -1) {
+        free(raw);
+        return -1;
+      }
+      total += len;
+      len = 0;
+      // rows longer than the chunk bypass it
+      if (size + 1 > SNAPSHOT_CHUNK) {
+        if (snapshotFlush(fd, chars, size) == -1) {
+          free(raw);
+          return -1;
+        }
+        total += size;
+        size = 0;
+      }
+    }
+    memcpy(buf + len, chars, size);
+    len += size;
+    buf[len++] = '\n';
+  }
+  free(raw);
+
+  if (snapshotFlush(fd, buf, len) == -1 || fsync(fd) == -1)
+    return -1;
+  return total + len;
+}
+
+// writes the rows to a temporary file next to path and renames it over
+// path, so readers see either the old file or the whole new one
+static void *snapshotWrite(void *arg) {
+  tiSnapshot *s = arg;
+  char *tmp = malloc(strlen(s->path) + 8);
+  char *buf = memAlloc(MEM_IO, SNAPSHOT_CHUNK);
+  int fd = -1;
+
+  s->written = -1;
+  s->err = ENOMEM;
+  if (tmp && buf) {
+    sprintf(tmp, "%s.XXXXXX", s->path);
+    fd = mkstemp(tmp);
+    s->err = errno;
+  }
+  if (fd != -1) {
+    struct stat st;
+    fchmod(fd, stat(s->path, &st) == 0 ? st.st_mode & 07777 : 0644);
+    ssize_t n = snapshotWriteRows(s, fd, buf);
+    s->err = errno;
+    if (close(fd) == -1 && n != -1) {
+      s->err = errno;
+      n = -1;
+    }
+    if (n != -1 && rename(tmp, s->path) == -1) {
+      s->err = errno;
+      n = -1;
+    }
+    if (n == -1)
+      unlink(tmp);
+    else
+      s->err = 0;
+    s->written = n;
+  }
+
+  free(tmp);
+  memFree(buf);
+  __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ snapshot ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+tiSnapshot *tiSnapshotSave(tiBuffer *b, const char *path) {
+  if (b->snapshot) {
+    errno = EBUSY;
+    return NULL;
+  }
+
+  tiSnapshot *s = calloc(1, sizeof(tiSnapshot));
+  if (s == NULL)
+    return NULL;
+  s->rows = memAlloc(MEM_ROWS, sizeof(struct tiSnapshotRow) * b->numrows + 1);
+  s->path = strdup(path);
+  if (s->rows == NULL || s->path == NULL) {
+    memFree(s->rows);
+    free(s->path);
+    free(s);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  // only the row pointers are copied; the bytes stay shared until the
+  // buffer changes a row, which then gets a copy of its own
+  for (int j = 0; j < b->numrows; ++j) {
+    s->rows[j].chars = b->row[j].chars;
+    s->rows[j].size = b->row[j].size;
+    s->rows[j].interned = b->row[j].interned;
+    s->rows[j].cold = b->row[j].cold;
+    s->rows[j].coldoff = b->row[j].coldoff;
+    if (b->row[j].interned)
+      tiInternRetain(b->row[j].chars);
+    if (b->row[j].cold)
+      tiColdRetain(b->row[j].cold);
+  }
+  s->numrows = b->numrows;
+  s->dirty = b->dirty;
+  b->snapshot = s;
+  b->snapgen++;
+
+  if (pthread_create(&s->thread, NULL, snapshotWrite, s) != 0)
+    snapshotWrite(s);
+  else
+    s->started = 1;
+  return s;
+}
+
+void tiSnapshotRetire(tiSnapshot *s, char *chars) {
+  if (s->nretired == s->retiredcap) {
+    int cap = s->retiredcap ? s->retiredcap * 2 : 64;
+    char **retired = memRealloc(MEM_ROWS, s->retired, sizeof(char *) * cap);
+    // bytes the writer may still read can't be freed, leak them instead
+    if (retired == NULL)
+      return;
+    s->retired = retired;
+    s->retiredcap = cap;
+  }
+  s->retired[s->nretired++] = chars;
+}
+
+int tiSnapshotDone(tiSnapshot *s, int wait, ssize_t *written, int *err) {
+  if (wait && s->started) {
+    pthread_join(s->thread, NULL);
+    s->started = 0;
+  }
+  if (!__atomic_load_n(&s->done, __ATOMIC_ACQUIRE))
+    return 0;
+  *written = s->written;
+  *err = s->err;
+  return 1;
+}
+
+int tiSnapshotDirty(tiSnapshot *s) { return s->dirty; }
+
+void tiSnapshotRelease(tiBuffer *b, tiSnapshot *s) {
+  if (s == NULL)
+    return;
+  if (b->snapshot == s)
+    b->snapshot = NULL;
+  if (s->started)
+    pthread_join(s->thread, NULL);
+  for (int i = 0; i < s->nretired; ++i)
+    memFree(s->retired[i]);
+  for (int j = 0; j < s->numrows; ++j)
+    if (s->rows[j].interned)
+      tiInternRelease(s->rows[j].chars);
+    else if (s->rows[j].cold)
+      tiColdRelease(s->rows[j].cold);
+  memFree(s->retired);
+  memFree(s->rows);
+  free(s->path);
+  free(s);
+}
@@ -0,0 +1,216 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// runs sorted by insertion before they are merged
+#define SORT_RUN 16
+
+// what rows are compared by: their bytes, or keys[row - base] if keys is
+// set
+struct sortCtx {
+
+  erow *base;
+  int64_t *keys;
+};
+
+// a slice of the handles: sorted by one thread, or two adjacent sorted
+// slices [from, mid) and [mid, to) of src merged into dst
+struct sortRange {
+
+  const struct sortCtx *ctx;
+  erow **src, **dst;
+  size_t from, mid, to;
+};
+
+/*~~~~~~~~~~~~~~~~~~~~ compare ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// the first decimal number in a row, a '-' right before it making it
+// negative. Rows without one sort before any that have one
+static int64_t sortNumber(const erow *row) {
+  const char *s = row->chars, *end = row->chars + row->size;
+  while (s < end && (*s < '0' || *s > '9'))
+    s++;
+  if (s == end)
+    return INT64_MIN;
+  int neg = s > row->chars && s[-1] == '-';
+  int64_t n = 0;
+  for (; s < end && *s >= '0' && *s <= '9'; ++s)
+    n = n < (INT64_MAX - 9) / 10 ? n * 10 + (*s - '0') : INT64_MAX;
+  return neg ? -n : n;
+}
+
+static int sortCmp(const struct sortCtx *c, const erow *x, const erow *y) {
+  if (c->keys) {
+    int64_t a = c->keys[x - c->base], b = c->keys[y - c->base];
+    return (a > b) - (a < b);
+  }
+  int n = x->size < y->size ? x->size : y->size;
+  int d = memcmp(x->chars, y->chars, n);
+  return d ? d : (x->size > y->size) - (x->size < y->size);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ merge sort ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// merges two sorted runs into dst, taking from the left one on ties so
+// rows that compare equal keep their order
+static void sortMerge(const struct sortCtx *c, erow **dst, erow **l,
+                      size_t nl, erow **r, size_t nr) {
+  size_t i = 0, j = 0, o = 0;
+  while (i < nl && j < nr)
+    dst[o++] = sortCmp(c, r[j], l[i]) < 0 ? r[j++] : l[i++];
+  memcpy(dst + o, l + i, sizeof(erow *) * (nl - i));
+  o += nl - i;
+  memcpy(dst + o, r + j, sizeof(erow *) * (nr - j));
+}
+
+// sorts src[from, to) in place, with the same slice of dst as scratch.
+// Keys of the slice are worked out here too, on the thread sorting it
+static void *sortSlice(void *arg) {
+  struct sortRange *r = arg;
+  const struct sortCtx *c = r->ctx;
+  erow **a = r->src + r->from, **tmp = r->dst + r->from;
+  size_t n = r->to - r->from;
+
+  if (c->keys)
+    for (size_t i = 0; i < n; ++i)
+      c->keys[a[i] - c->base] = sortNumber(a[i]);
+
+  for (size_t s = 0; s < n; s += SORT_RUN) {
+    size_t e = s + SORT_RUN < n ? s + SORT_RUN : n;
+    for (size_t i = s + 1; i < e; ++i) {
+      erow *x = a[i];
+      size_t j = i;
+      for (; j > s && sortCmp(c, x, a[j - 1]) < 0; --j)
+        a[j] = a[j - 1];
+      a[j] = x;
+    }
+  }
+
+  erow **src = a, **dst = tmp;
+  for (size_t w = SORT_RUN; w < n; w *= 2) {
+    for (size_t s = 0; s < n; s += 2 * w) {
+      size_t m = s + w < n ? s + w : n;
+      size_t e = s + 2 * w < n ? s + 2 * w : n;
+      sortMerge(c, dst + s, src + s, m - s, src + m, e - m);
+    }
+    erow **t = src;
+    src = dst;
+    dst = t;
+  }
+  if (src != a)
+    memcpy(a, src, sizeof(erow *) * n);
+  return NULL;
+}
+
+static void *sortMergeSlices(void *arg) {
+  struct sortRange *r = arg;
+  sortMerge(r->ctx, r->dst + r->from, r->src + r->from, r->mid - r->from,
+            r->src + r->mid, r->to - r->mid);
+  return NULL;
+}
+
+// runs fn on each of r[0..n), on threads but the first
+static void sortRun(void *(*fn)(void *), struct sortRange *r, int n) {
+  pthread_t tid[TI_SORT_THREADS];
+  int started[TI_SORT_THREADS] = {0};
+  for (int t = 1; t < n; ++t)
+    started[t] = pthread_create(&tid[t], NULL, fn, &r[t]) == 0;
+  fn(&r[0]);
+  for (int t = 1; t < n; ++t) {
+    if (started[t])
+      pthread_join(tid[t], NULL);
+    else
+      fn(&r[t]);
+  }
+}
+
+// each thread sorts a slice, then the slices are merged pairwise, the
+// merges of a round running in parallel, until one is left in a
+static void sortParallel(const struct sortCtx *c, erow **a, erow **tmp,
+                         size_t n, int threads) {
+  struct sortRange r[TI_SORT_THREADS];
+  size_t bound[TI_SORT_THREADS + 1];
+  for (int t = 0; t <= threads; ++t)
+    bound[t] = n / threads * t;
+  bound[threads] = n;
+  for (int t = 0; t < threads; ++t)
+    r[t] = (struct sortRange){c, a, tmp, bound[t], 0, bound[t + 1]};
+  sortRun(sortSlice, r, threads);
+
+  erow **src = a, **dst = tmp;
+  for (int slices = threads; slices > 1; slices = (slices + 1) / 2) {
+    int pairs = 0;
+    for (int s = 0; s < slices; s += 2) {
+      // an odd slice out is merged with nothing, which copies it
+      size_t mid = bound[s + 1];
+      size_t to = s + 2 <= slices ? bound[s + 2] : mid;
+      r[pairs++] = (struct sortRange){c, src, dst, bound[s], mid, to};
+    }
+    sortRun(sortMergeSlices, r, pairs);
+    for (int p = 0; p < pairs; ++p)
+      bound[p] = r[p].from;
+    bound[pairs] = n;
+    erow **t = src;
+    src = dst;
+    dst = t;
+  }
+  if (src != a)
+    memcpy(a, src, sizeof(erow *) * n);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ sort ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+erow **tiSortOrder(erow *rows, int n, int flags, int threads, int *kept) {
+  erow **a = memAlloc(MEM_ROWS, sizeof(erow *) * n + 1);
+  if (a == NULL)
+    return NULL;
+  for (int i = 0; i < n; ++i)
+    a[i] = &rows[i];
+  struct sortCtx c = {rows, NULL};
+
+  if (!(flags & TI_SORT_KEEP_ORDER) && n > 1) {
+    erow **tmp = memAlloc(MEM_ROWS, sizeof(erow *) * n);
+    if (flags & TI_SORT_NUMERIC)
+      c.keys = memAlloc(MEM_ROWS, sizeof(int64_t) * n);
+    if (tmp == NULL || ((flags & TI_SORT_NUMERIC) && c.keys == NULL)) {
+      memFree(tmp);
+      memFree(c.keys);
+      memFree(a);
+      return NULL;
+    }
+
+    if (threads <= 0) {
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = cpus > 0 ? cpus : 1;
+    }
+    if (threads > TI_SORT_THREADS)
+      threads = TI_SORT_THREADS;
+    if (threads > n / TI_SORT_SPLIT + 1)
+      threads = n / TI_SORT_SPLIT + 1;
+    sortParallel(&c, a, tmp, n, threads);
+    memFree(tmp);
+  }
+
+  int k = n;
+  if (flags & TI_SORT_UNIQUE) {
+    k = n ? 1 : 0;
+    for (int i = 1; i < n; ++i)
+      if (sortCmp(&c, a[k - 1], a[i]))
+        a[k++] = a[i];
+  }
+  memFree(c.keys);
+  *kept = k;
+  return a;
+}
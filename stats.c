@@ -0,0 +1,115 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+struct editorStats tiStats;
+
+/*~~~~~~~~~~~~~~~~~~~~ instrumentation ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+const char *stageNames[STAGE_COUNT] = {"read", "process", "syntax", "draw",
+                                       "write"};
+
+uint64_t statsNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int statsBucket(uint64_t ns) {
+  if (ns < (1 << STATS_SUB_BITS))
+    return ns;
+  int msb = 63 - __builtin_clzll(ns);
+  int shift = msb - STATS_SUB_BITS;
+  return ((shift + 1) << STATS_SUB_BITS) +
+         ((ns >> shift) & ((1 << STATS_SUB_BITS) - 1));
+}
+
+static uint64_t statsBucketValue(int bucket) {
+  if (bucket < (1 << STATS_SUB_BITS))
+    return bucket;
+  int shift = (bucket >> STATS_SUB_BITS) - 1;
+  uint64_t sub = bucket & ((1 << STATS_SUB_BITS) - 1);
+  // midpoint of the bucket
+  return ((sub | (1 << STATS_SUB_BITS)) << shift) + ((1ULL << shift) >> 1);
+}
+
+void statsRecord(int stage, uint64_t start) {
+  uint64_t end = statsNow();
+  uint64_t ns = end - start;
+  struct stageStats *st = &tiStats.stage[stage];
+
+  st->count++;
+  st->total += ns;
+  if (ns > st->max)
+    st->max = ns;
+  st->hist[statsBucket(ns)]++;
+
+  if (tiStats.trace) {
+    fprintf(tiStats.trace,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            tiStats.trace_events++ ? "," : "", stageNames[stage],
+            (start - tiStats.epoch) / 1e3, ns / 1e3);
+  }
+}
+
+uint64_t statsPercentile(struct stageStats *st, double p) {
+  if (st->count == 0)
+    return 0;
+
+  uint64_t want = (uint64_t)(p / 100.0 * st->count + 0.5);
+  if (want == 0)
+    want = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < STATS_BUCKETS; ++i) {
+    seen += st->hist[i];
+    if (seen >= want) {
+      uint64_t v = statsBucketValue(i);
+      return v > st->max ? st->max : v;
+    }
+  }
+  return st->max;
+}
+
+int statsFormat(char *buf, size_t size, uint64_t ns) {
+  if (ns < 10000)
+    return snprintf(buf, size, "%.1fus", ns / 1e3);
+  if (ns < 10000000)
+    return snprintf(buf, size, "%.0fus", ns / 1e3);
+  return snprintf(buf, size, "%.0fms", ns / 1e6);
+}
+
+void statsReset(void) {
+  memset(tiStats.stage, 0, sizeof(tiStats.stage));
+}
+
+static void statsCloseTrace(void) {
+  if (!tiStats.trace)
+    return;
+  fprintf(tiStats.trace, "\n]}\n");
+  fclose(tiStats.trace);
+  tiStats.trace = NULL;
+}
+
+int statsOpenTrace(const char *filename) {
+  tiStats.trace = fopen(filename, "w");
+  if (!tiStats.trace)
+    return -1;
+
+  tiStats.enabled = 1;
+  tiStats.epoch = statsNow();
+  tiStats.trace_events = 0;
+  fprintf(tiStats.trace, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  atexit(statsCloseTrace);
+  return 0;
+}
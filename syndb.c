@@ -0,0 +1,713 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define SYNDB_MAGIC "TIS1"
+#define SYNDB_SUFFIX ".syn"
+
+// A compiled set of languages. Everything refers to everything else by
+// offset from the start of the image, so a cache file is used in place
+// once mapped. Offset 0 (the header) stands for "none".
+struct synHeader {
+
+  char magic[4];
+  uint32_t size;
+  uint32_t nlangs;
+  uint32_t langs;
+  uint32_t nsources;
+  uint32_t sources;
+  // open addressed on filematch, extmask + 1 slots
+  uint32_t extmask;
+  uint32_t exts;
+  int64_t dir_mtime_sec;
+  int64_t dir_mtime_nsec;
+};
+
+// a .syn file the image was compiled from, checked before the cache is used
+struct synSource {
+
+  uint32_t name;
+  uint32_t pad;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+};
+
+struct synLang {
+
+  uint32_t filetype;
+  uint32_t scs;
+  uint32_t mcs;
+  uint32_t mce;
+  uint32_t flags;
+  uint32_t kwmask;
+  uint32_t keywords;
+  uint32_t lens;
+  uint32_t nlens;
+  uint32_t separators;
+};
+
+struct synExt {
+
+  uint32_t match;
+  uint32_t lang;
+};
+
+struct synImage {
+
+  char *base;
+  size_t size;
+  int mapped;
+  struct editorSyntax *langs;
+  int nlangs;
+};
+
+// user languages come first so they can replace built-in ones
+static struct synImage images[2];
+static int loaded;
+
+/*~~~~~~~~~~~~~~~~~~~~ compiler ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+struct synBuild {
+
+  char *img;
+  size_t len;
+  size_t cap;
+};
+
+static uint32_t synHash(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i)
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  return h;
+}
+
+static uint32_t synSlots(size_t n) {
+  uint32_t slots = 8;
+  while (slots < n * 2)
+    slots *= 2;
+  return slots;
+}
+
+// reserves len zeroed bytes, 8-byte aligned, returns their offset
+static uint32_t synReserve(struct synBuild *sb, size_t len) {
+  size_t off = (sb->len + 7) & ~(size_t)7;
+  if (off + len > sb->cap) {
+    size_t cap = sb->cap ? sb->cap * 2 : 16384;
+    while (cap < off + len)
+      cap *= 2;
+    char *img = memRealloc(MEM_SYNTAX, sb->img, cap);
+    if (img == NULL)
+      return 0;
+    sb->img = img;
+    sb->cap = cap;
+  }
+  memset(sb->img + sb->len, 0, off + len - sb->len);
+  sb->len = off + len;
+  return off;
+}
+
+static uint32_t synString(struct synBuild *sb, const char *s, size_t len) {
+  if (s == NULL)
+    return 0;
+  uint32_t off = synReserve(sb, len + 1);
+  if (off)
+    memcpy(sb->img + off, s, len);
+  return off;
+}
+
+// keyword types follow the HLDB convention: kw1 = default, kw2 = |,
+// kw3 = ||, kw4 = &
+static int synKeywordType(const char *kw, size_t *len) {
+  *len = strlen(kw);
+  if (*len > 1 && kw[*len - 1] == '&') {
+    (*len)--;
+    return HL_KEYWORD4;
+  }
+  if (*len > 2 && kw[*len - 1] == '|' && kw[*len - 2] == '|') {
+    *len -= 2;
+    return HL_KEYWORD3;
+  }
+  if (*len > 1 && kw[*len - 1] == '|') {
+    (*len)--;
+    return HL_KEYWORD2;
+  }
+  return HL_KEYWORD1;
+}
+
+static int synCompileLang(struct synBuild *sb, uint32_t at,
+                          const struct tiSyntaxDef *def) {
+  struct synLang l = {0};
+  l.filetype = synString(sb, def->filetype, strlen(def->filetype));
+  if (l.filetype == 0)
+    return -1;
+#define SYN_STR(s) ((s) ? synString(sb, (s), strlen(s)) : 0)
+  l.scs = SYN_STR(def->single_line_comment_start);
+  l.mcs = SYN_STR(def->multi_line_comment_start);
+  l.mce = SYN_STR(def->multi_line_comment_end);
+#undef SYN_STR
+  l.flags = def->flags;
+
+  l.separators = synReserve(sb, 256);
+  if (l.separators == 0)
+    return -1;
+  for (int c = 0; c < 256; ++c)
+    sb->img[l.separators + c] =
+        def->separators ? isspace(c) || c == '\0' ||
+                              (c && strchr(def->separators, c) != NULL)
+                        : is_seperator(c);
+
+  size_t nkw = 0;
+  while (def->keywords && def->keywords[nkw])
+    nkw++;
+  l.kwmask = synSlots(nkw) - 1;
+  l.keywords = synReserve(sb, sizeof(struct tiKeyword) * (l.kwmask + 1));
+  if (l.keywords == 0)
+    return -1;
+
+  unsigned char seen[256] = {0};
+  for (size_t k = 0; k < nkw; ++k) {
+    size_t len;
+    int type = synKeywordType(def->keywords[k], &len);
+    if (len == 0 || len > 255)
+      continue;
+    uint32_t i = synHash(def->keywords[k], len) & l.kwmask;
+    struct tiKeyword *slot;
+    for (;; i = (i + 1) & l.kwmask) {
+      slot = (struct tiKeyword *)(sb->img + l.keywords) + i;
+      if (slot->word == 0 || (slot->len == len &&
+                              !memcmp(sb->img + slot->word,
+                                      def->keywords[k], len)))
+        break;
+    }
+    // a word listed twice keeps its first type, as the linear scan did
+    if (slot->word)
+      continue;
+    uint32_t word = synString(sb, def->keywords[k], len);
+    if (word == 0)
+      return -1;
+    slot = (struct tiKeyword *)(sb->img + l.keywords) + i;
+    slot->word = word;
+    slot->len = len;
+    slot->type = type;
+    seen[len] = 1;
+  }
+
+  // longest first, so "<!DOCTYPE html>" wins over "<!DOCTYPE"
+  for (int len = 255; len > 0; --len)
+    l.nlens += seen[len];
+  l.lens = synReserve(sb, l.nlens);
+  if (l.nlens && l.lens == 0)
+    return -1;
+  for (int len = 255, n = 0; len > 0; --len)
+    if (seen[len])
+      sb->img[l.lens + n++] = len;
+
+  memcpy(sb->img + at, &l, sizeof(l));
+  return 0;
+}
+
+static int synCompileExts(struct synBuild *sb, const struct tiSyntaxDef *defs,
+                          int n) {
+  size_t count = 0;
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; defs[j].filematch && defs[j].filematch[i]; ++i)
+      count++;
+
+  uint32_t mask = synSlots(count) - 1;
+  uint32_t exts = synReserve(sb, sizeof(struct synExt) * (mask + 1));
+  if (exts == 0)
+    return -1;
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; defs[j].filematch && defs[j].filematch[i]; ++i) {
+      const char *m = defs[j].filematch[i];
+      size_t len = strlen(m);
+      uint32_t h = synHash(m, len) & mask;
+      struct synExt *e;
+      for (;; h = (h + 1) & mask) {
+        e = (struct synExt *)(sb->img + exts) + h;
+        if (e->match == 0 || !strcmp(sb->img + e->match, m))
+          break;
+      }
+      // the first language to claim a match keeps it
+      if (e->match)
+        continue;
+      uint32_t match = synString(sb, m, len);
+      if (match == 0)
+        return -1;
+      e = (struct synExt *)(sb->img + exts) + h;
+      e->match = match;
+      e->lang = j;
+    }
+  }
+
+  struct synHeader *h = (struct synHeader *)sb->img;
+  h->extmask = mask;
+  h->exts = exts;
+  return 0;
+}
+
+// sources are the stat'd .syn files of a user directory, NULL for built-ins
+static char *synCompile(const struct tiSyntaxDef *defs, int n,
+                        char **names, struct stat *sources,
+                        const struct stat *dir, size_t *size) {
+  struct synBuild sb = {0};
+  synReserve(&sb, sizeof(struct synHeader));
+  uint32_t langs = synReserve(&sb, sizeof(struct synLang) * (n + 1));
+  uint32_t srcs = synReserve(&sb, sizeof(struct synSource) * (n + 1));
+  int ok = sb.img && langs && srcs;
+
+  for (int j = 0; ok && j < n; ++j) {
+    ok = synCompileLang(&sb, langs + sizeof(struct synLang) * j, &defs[j]) == 0;
+    if (ok && sources) {
+      struct synSource s = {0};
+      s.name = synString(&sb, names[j], strlen(names[j]));
+      s.size = sources[j].st_size;
+      s.mtime_sec = sources[j].st_mtim.tv_sec;
+      s.mtime_nsec = sources[j].st_mtim.tv_nsec;
+      memcpy(sb.img + srcs + sizeof(s) * j, &s, sizeof(s));
+      ok = s.name != 0;
+    }
+  }
+  if (!ok || synCompileExts(&sb, defs, n) == -1) {
+    memFree(sb.img);
+    return NULL;
+  }
+
+  struct synHeader *h = (struct synHeader *)sb.img;
+  memcpy(h->magic, SYNDB_MAGIC, 4);
+  h->size = sb.len;
+  h->nlangs = n;
+  h->langs = langs;
+  h->nsources = sources ? n : 0;
+  h->sources = srcs;
+  if (dir) {
+    h->dir_mtime_sec = dir->st_mtim.tv_sec;
+    h->dir_mtime_nsec = dir->st_mtim.tv_nsec;
+  }
+  *size = sb.len;
+  return sb.img;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ definition files ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static void synPush(char ***list, int *n, const char *s, size_t len) {
+  char **grown = realloc(*list, sizeof(char *) * (*n + 2));
+  char *copy = strndup(s, len);
+  if (grown == NULL || copy == NULL) {
+    free(copy);
+    if (grown)
+      *list = grown;
+    return;
+  }
+  *list = grown;
+  grown[(*n)++] = copy;
+  grown[*n] = NULL;
+}
+
+static void synFreeDef(struct tiSyntaxDef *def) {
+  for (int i = 0; def->filematch && def->filematch[i]; ++i)
+    free(def->filematch[i]);
+  for (int i = 0; def->keywords && def->keywords[i]; ++i)
+    free(def->keywords[i]);
+  free(def->filematch);
+  free(def->keywords);
+  free(def->filetype);
+  free(def->single_line_comment_start);
+  free(def->multi_line_comment_start);
+  free(def->multi_line_comment_end);
+  free(def->separators);
+  memset(def, 0, sizeof(*def));
+}
+
+// next whitespace separated word of a line, advances *s past it
+static size_t synWord(const char **s, const char *end, const char **word) {
+  while (*s < end && isspace((unsigned char)**s))
+    (*s)++;
+  *word = *s;
+  while (*s < end && !isspace((unsigned char)**s))
+    (*s)++;
+  return *s - *word;
+}
+
+int tiSyntaxParse(struct tiSyntaxDef *def, const char *name, const char *text,
+                  size_t len) {
+  memset(def, 0, sizeof(*def));
+  int nmatch = 0, nkw = 0;
+  const char *end = text + len;
+
+  for (const char *line = text; line < end;) {
+    const char *eol = memchr(line, '\n', end - line);
+    if (eol == NULL)
+      eol = end;
+    const char *s = line, *key, *word;
+    size_t klen = synWord(&s, eol, &key), wlen;
+    line = eol + 1;
+    if (klen == 0 || *key == '#')
+      continue;
+
+#define SYN_KEY(k) (klen == strlen(k) && !strncmp(key, k, klen))
+    if (SYN_KEY("name") && (wlen = synWord(&s, eol, &word))) {
+      free(def->filetype);
+      def->filetype = strndup(word, wlen);
+    } else if (SYN_KEY("match")) {
+      while ((wlen = synWord(&s, eol, &word)))
+        synPush(&def->filematch, &nmatch, word, wlen);
+    } else if (SYN_KEY("keywords")) {
+      while ((wlen = synWord(&s, eol, &word)))
+        synPush(&def->keywords, &nkw, word, wlen);
+    } else if (SYN_KEY("comment") && (wlen = synWord(&s, eol, &word))) {
+      free(def->single_line_comment_start);
+      def->single_line_comment_start = strndup(word, wlen);
+    } else if (SYN_KEY("multiline") && (wlen = synWord(&s, eol, &word))) {
+      free(def->multi_line_comment_start);
+      def->multi_line_comment_start = strndup(word, wlen);
+      if ((wlen = synWord(&s, eol, &word))) {
+        free(def->multi_line_comment_end);
+        def->multi_line_comment_end = strndup(word, wlen);
+      }
+    } else if (SYN_KEY("separators") && synWord(&s, eol, &word)) {
+      free(def->separators);
+      def->separators = strndup(word, eol - word);
+    } else if (SYN_KEY("flags")) {
+      while ((wlen = synWord(&s, eol, &word))) {
+        if (wlen == 7 && !strncmp(word, "numbers", 7))
+          def->flags |= HL_HIGHLIGHT_NUMBERS;
+        else if (wlen == 7 && !strncmp(word, "strings", 7))
+          def->flags |= HL_HIGHLIGHT_STRINGS;
+      }
+    }
+    // anything else is left for newer versions
+#undef SYN_KEY
+  }
+
+  if (def->filetype == NULL) {
+    const char *dot = strrchr(name, '.');
+    def->filetype = strndup(name, dot ? (size_t)(dot - name) : strlen(name));
+  }
+  if (def->filetype == NULL) {
+    synFreeDef(def);
+    errno = ENOMEM;
+    return -1;
+  }
+  return 0;
+}
+
+static int synCompare(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// compiles every .syn file of dir, in name order
+static char *synCompileDir(const char *dir, const struct stat *dst,
+                           size_t *size) {
+  DIR *d = opendir(dir);
+  if (d == NULL)
+    return NULL;
+
+  char **names = NULL;
+  int n = 0;
+  struct dirent *de;
+  while ((de = readdir(d)) != NULL) {
+    size_t len = strlen(de->d_name);
+    if (de->d_name[0] != '.' && len > strlen(SYNDB_SUFFIX) &&
+        !strcmp(de->d_name + len - strlen(SYNDB_SUFFIX), SYNDB_SUFFIX))
+      synPush(&names, &n, de->d_name, len);
+  }
+  closedir(d);
+  if (n == 0) {
+    free(names);
+    return NULL;
+  }
+  qsort(names, n, sizeof(char *), synCompare);
+
+  struct tiSyntaxDef *defs = calloc(n, sizeof(struct tiSyntaxDef));
+  struct stat *sources = calloc(n, sizeof(struct stat));
+  int ndefs = 0;
+  for (int j = 0; defs && sources && j < n; ++j) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, names[j]);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+      continue;
+    char *text = NULL;
+    if (fstat(fd, &sources[ndefs]) == 0 && S_ISREG(sources[ndefs].st_mode))
+      text = memAlloc(MEM_IO, sources[ndefs].st_size + 1);
+    ssize_t got = text ? read(fd, text, sources[ndefs].st_size) : -1;
+    close(fd);
+    if (got >= 0 && tiSyntaxParse(&defs[ndefs], names[j], text, got) == 0) {
+      // keep names parallel to defs and sources
+      char *name = names[ndefs];
+      names[ndefs] = names[j];
+      names[j] = name;
+      ndefs++;
+    }
+    memFree(text);
+  }
+
+  char *img = ndefs ? synCompile(defs, ndefs, names, sources, dst, size) : NULL;
+  for (int j = 0; defs && j < ndefs; ++j)
+    synFreeDef(&defs[j]);
+  for (int j = 0; j < n; ++j)
+    free(names[j]);
+  free(names);
+  free(defs);
+  free(sources);
+  return img;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ cache ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// checks that img was compiled from the current contents of dir
+static int synFresh(const char *img, size_t size, const char *dir,
+                    const struct stat *dst) {
+  const struct synHeader *h = (const struct synHeader *)img;
+  if (size < sizeof(*h) || memcmp(h->magic, SYNDB_MAGIC, 4) ||
+      h->size != size || h->dir_mtime_sec != dst->st_mtim.tv_sec ||
+      h->dir_mtime_nsec != dst->st_mtim.tv_nsec ||
+      h->langs + (uint64_t)sizeof(struct synLang) * h->nlangs > size ||
+      h->sources + (uint64_t)sizeof(struct synSource) * h->nsources > size ||
+      h->exts + (uint64_t)sizeof(struct synExt) * (h->extmask + 1) > size)
+    return 0;
+
+  // a file edited in place leaves the directory alone
+  const struct synSource *src = (const struct synSource *)(img + h->sources);
+  for (uint32_t j = 0; j < h->nsources; ++j) {
+    char path[4096];
+    struct stat st;
+    if (src[j].name >= size)
+      return 0;
+    snprintf(path, sizeof(path), "%s/%s", dir, img + src[j].name);
+    if (stat(path, &st) == -1 || st.st_size != src[j].size ||
+        st.st_mtim.tv_sec != src[j].mtime_sec ||
+        st.st_mtim.tv_nsec != src[j].mtime_nsec)
+      return 0;
+  }
+  return 1;
+}
+
+static void synWriteCache(const char *cache, const char *img, size_t size) {
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", cache);
+
+  // the cache directory may not exist yet
+  char *slash = strrchr(tmp, '/');
+  for (char *p = tmp + 1; slash && p <= slash; ++p) {
+    if (*p == '/') {
+      *p = '\0';
+      mkdir(tmp, 0755);
+      *p = '/';
+    }
+  }
+
+  int fd = mkstemp(tmp);
+  if (fd == -1)
+    return;
+  fchmod(fd, 0644);
+  int ok = write(fd, img, size) == (ssize_t)size;
+  if (close(fd) == -1 || !ok || rename(tmp, cache) == -1)
+    unlink(tmp);
+}
+
+// maps cache if it is up to date with dir, compiles dir into it otherwise
+static int synLoadUser(struct synImage *im, const char *dir, const char *cache) {
+  struct stat dst;
+  if (dir == NULL || stat(dir, &dst) == -1 || !S_ISDIR(dst.st_mode))
+    return 0;
+
+  int fd = cache ? open(cache, O_RDONLY) : -1;
+  struct stat st;
+  if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0) {
+    char *img = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (img != MAP_FAILED && synFresh(img, st.st_size, dir, &dst)) {
+      close(fd);
+      im->base = img;
+      im->size = st.st_size;
+      im->mapped = 1;
+      return 0;
+    }
+    if (img != MAP_FAILED)
+      munmap(img, st.st_size);
+  }
+  if (fd != -1)
+    close(fd);
+
+  im->base = synCompileDir(dir, &dst, &im->size);
+  if (im->base == NULL)
+    return -1;
+  if (cache)
+    synWriteCache(cache, im->base, im->size);
+  return 0;
+}
+
+// resolves the languages of an image into editorSyntax structs
+static int synResolve(struct synImage *im) {
+  const struct synHeader *h = (const struct synHeader *)im->base;
+  im->langs = calloc(h->nlangs + 1, sizeof(struct editorSyntax));
+  if (im->langs == NULL)
+    return -1;
+
+  const struct synLang *l = (const struct synLang *)(im->base + h->langs);
+  for (uint32_t j = 0; j < h->nlangs; ++j) {
+    if (l[j].filetype >= im->size || l[j].scs >= im->size ||
+        l[j].mcs >= im->size || l[j].mce >= im->size ||
+        l[j].separators + 256 > im->size ||
+        l[j].lens + (uint64_t)l[j].nlens > im->size ||
+        l[j].keywords + (uint64_t)sizeof(struct tiKeyword) * (l[j].kwmask + 1) >
+            im->size)
+      break;
+    struct editorSyntax *s = &im->langs[j];
+    s->filetype = im->base + l[j].filetype;
+    s->single_line_comment_start = l[j].scs ? im->base + l[j].scs : NULL;
+    s->multi_line_comment_start = l[j].mcs ? im->base + l[j].mcs : NULL;
+    s->multi_line_comment_end = l[j].mce ? im->base + l[j].mce : NULL;
+    s->flags = l[j].flags;
+    s->words = im->base;
+    s->keywords = (const struct tiKeyword *)(im->base + l[j].keywords);
+    s->kwmask = l[j].kwmask;
+    s->lens = (const unsigned char *)im->base + l[j].lens;
+    s->nlens = l[j].nlens;
+    s->separators = (const unsigned char *)im->base + l[j].separators;
+    im->nlangs++;
+  }
+  return 0;
+}
+
+static void synUnload(struct synImage *im) {
+  if (im->mapped)
+    munmap(im->base, im->size);
+  else
+    memFree(im->base);
+  free(im->langs);
+  memset(im, 0, sizeof(*im));
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ syntax database ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// $XDG_<env>/ti/<sub>, or ~/<fallback>/ti/<sub>
+static char *synPath(const char *env, const char *fallback, const char *sub) {
+  const char *base = getenv(env);
+  const char *home = getenv("HOME");
+  char path[4096];
+  if (base && *base)
+    snprintf(path, sizeof(path), "%s/ti/%s", base, sub);
+  else if (home && *home)
+    snprintf(path, sizeof(path), "%s/%s/ti/%s", home, fallback, sub);
+  else
+    return NULL;
+  return strdup(path);
+}
+
+int tiSyntaxLoad(const char *dir, const char *cache) {
+  for (int i = 0; i < 2; ++i)
+    synUnload(&images[i]);
+  loaded = 1;
+
+  char *udir = dir ? NULL : synPath("XDG_CONFIG_HOME", ".config", "syntax");
+  char *ucache =
+      dir ? NULL : synPath("XDG_CACHE_HOME", ".cache", "syntax.cache");
+  int ret = synLoadUser(&images[0], dir ? dir : udir, dir ? cache : ucache);
+  free(udir);
+  free(ucache);
+  if (images[0].base && synResolve(&images[0]) == -1)
+    synUnload(&images[0]);
+
+  images[1].base =
+      synCompile(HLDB, HLDB_ENTRIES, NULL, NULL, NULL, &images[1].size);
+  if (images[1].base == NULL || synResolve(&images[1]) == -1)
+    return -1;
+  return ret == -1 ? -1 : images[0].nlangs + images[1].nlangs;
+}
+
+static struct editorSyntax *synLookup(const char *match) {
+  if (!loaded)
+    tiSyntaxLoad(NULL, NULL);
+
+  size_t len = strlen(match);
+  uint32_t hash = synHash(match, len);
+  for (int i = 0; i < 2; ++i) {
+    if (images[i].base == NULL)
+      continue;
+    const struct synHeader *h = (const struct synHeader *)images[i].base;
+    const struct synExt *exts =
+        (const struct synExt *)(images[i].base + h->exts);
+    for (uint32_t k = hash & h->extmask; exts[k].match;
+         k = (k + 1) & h->extmask) {
+      if (exts[k].match < images[i].size &&
+          !strcmp(images[i].base + exts[k].match, match))
+        return exts[k].lang < (uint32_t)images[i].nlangs
+                   ? &images[i].langs[exts[k].lang]
+                   : NULL;
+    }
+  }
+  return NULL;
+}
+
+struct editorSyntax *tiSyntaxMatch(const char *filename) {
+  const char *name = strrchr(filename, '/');
+  name = name ? name + 1 : filename;
+  const char *ext = strrchr(name, '.');
+  struct editorSyntax *s = ext ? synLookup(ext) : NULL;
+  // matches without a dot name whole files, like Makefile
+  return s ? s : synLookup(name);
+}
+
+struct editorSyntax *tiSyntaxFind(const char *lang) {
+  if (!loaded)
+    tiSyntaxLoad(NULL, NULL);
+  for (int i = 0; i < 2; ++i)
+    for (int j = 0; j < images[i].nlangs; ++j)
+      if (!strcasecmp(images[i].langs[j].filetype, lang))
+        return &images[i].langs[j];
+
+  // "py", "rs" and the like name a language by its extension
+  char ext[64];
+  snprintf(ext, sizeof(ext), ".%s", lang);
+  return synLookup(ext);
+}
+
+int tiSyntaxList(char *buf, size_t size) {
+  if (!loaded)
+    tiSyntaxLoad(NULL, NULL);
+  size_t len = 0;
+  buf[0] = '\0';
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < images[i].nlangs; ++j) {
+      // built-ins replaced by a user language are listed once
+      if (i && tiSyntaxFind(images[i].langs[j].filetype) != &images[i].langs[j])
+        continue;
+      int n = snprintf(buf + len, size - len, "%s%s", len ? ", " : "",
+                       images[i].langs[j].filetype);
+      if (n < 0 || (size_t)n >= size - len)
+        return len;
+      len += n;
+    }
+  }
+  return len;
+}
+
+int tiSyntaxKeyword(const struct editorSyntax *s, const char *p, int len) {
+  for (uint32_t i = synHash(p, len) & s->kwmask; s->keywords[i].word;
+       i = (i + 1) & s->kwmask)
+    if (s->keywords[i].len == len &&
+        !memcmp(s->words + s->keywords[i].word, p, len))
+      return s->keywords[i].type;
+  return HL_NORMAL;
+}
@@ -0,0 +1,364 @@
+/*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <string.h>
+
+#include "ti.h"
+
+/*~~~~~~~~~~~~~~~~~~~~ filetypes ~~~~~~~~~~~~~~~~~~~*/
+
+// kw1 = default, kw2 = |, kw3 = ||, kw4 = &
+
+char *C_HL_extensions[] = {".c", ".h", ".cpp", ".cc", ".hpp", ".c++", NULL};
+char *C_HL_keywords[] = {
+    "switch",    "if",         "while",    "for",    "break",
+    "continue",  "return",     "else",     "struct", "union",
+    "typedef",   "static",     "enum",     "class",  "case",
+
+    "int|",      "long|",      "double|",  "float|", "char|",
+    "unsigned|", "signed|",    "void|",
+
+    "#define||", "#endif||",   "#error||", "#if||",  "#ifdef||",
+    "#ifndef||", "#include||", "#undef||", NULL};
+
+char *JS_HL_extensions[] = {".js", NULL};
+char *JS_HL_keywords[] = {
+
+  "await",            "break",             "case",         "catch", 
+  "class",            "const",             "continue",     "debugger",
+  "default",          "delete",            "do",           "else", 
+  "enum",             "export",            "extends",      "false",
+  "finally",          "for",               "function",     "if", 
+  "implements",       "import",            "in",           "instanceof",
+  "interface",        "let",               "new",          "null", 
+  "package",          "private",           "protected",    "public",
+  "return",           "super",             "switch",       "static", 
+  "this",             "throw",             "try",          "true",
+  "typeof",           "var",               "void",         "while", 
+  "with",             "yield", 
+  
+  "str|",             "arr|",              "Object|",       "set|",
+  "document|", 
+  
+  "includes||",       "style||",           "value||",       "addEventListener||", 
+  "querySelector||",  "indexOf||",         "split||",       "concat||", 
+  "replace||",        "size||",            "add||",         "delete||",
+  "trim||",           "toLowerCase||",     "toUpperCase||", "forEach||", 
+  "join||",           "keys||",            "value||",       "style||",  
+  "has||",            "backgroundColor||", "textAlign||",   "fontWeight||", 
+  "text||", "size||", "add||", "delete||",
+  "preventDefault||", NULL};
+
+char *RUST_HL_extensions[] = {".rs", NULL};
+char *RUST_HL_keywords[] = {
+  "as",       "break",     "const",     "continue", "crate",
+  "else",     "enum",      "extern",    "false",    "fn",
+  "for",      "if",        "impl",      "in",       "let",
+  "loop",     "match",     "mod",       "move",     "mut",
+  "pub",      "ref",       "return",    "self",     "Self",
+  "static",   "struct",    "super",     "trait",    "true",
+  "false",    "type",      "unsafe",    "use",      "where",
+  "while",    "abstract|", "become|",   "box|",     "do|",
+  "final|",   "macro|",    "override|", "priv|",    "typeof|",
+  "unsized|", "virtual|",  "yield|",    "try|",     "macro_rules|",
+  "union|",   "'static|",  "bool||",    "char||",   "str||",
+  "&str",     "u8||",      "u16||",     "u32||",    "u64||",
+  "u128||",   "i8||",      "i16||",     "i32||",    "i64||",
+  "i128||",   "println!&", NULL};
+
+char *PYTHON_HL_extensions[] = {".py", NULL};
+char *PYTHON_HL_keywords[] = {
+    "and",     "as",         "assert",   "break",    "class",   "continue",
+    "def",     "del",        "elif",     "else",     "except",  "exec",
+    "finally", "for",        "from",     "global",   "if",      "import",
+    "in",      "is",         "lambda",   "not",      "or",      "pass",
+    "print",   "raise",      "return",   "try",      "while",   "with",
+    "yield",
+
+    "buffer|", "bytearray|", "complex|", "False|",   "float|",  "frozenset|",
+    "int|",    "list|",      "long|",    "None|",    "set|",    "str|",
+    "tuple|",  "True|",      "type|",    "unicode|", "xrange|", NULL};
+
+char *GO_HL_extensions[] = {".go", NULL};
+char *GO_HL_keywords[] = {
+    "if",     "for",   "range",   "while",   "defer",   "switch", "case",
+    "else",   "func",  "package", "import",  "type",    "struct", "import",
+    "const",  "var",
+
+    "nil|",   "true|", "false|",  "error|",  "err|",    "int|",   "int32|",
+    "int64|", "uint|", "uint32|", "uint64|", "string|", "bool|",  NULL};
+
+char *BASH_HL_extensions[] = {".sh", NULL};
+char *BASH_HL_keywords[] = {
+    "!",     "case", "coproc",   "do",   "done", "elif",   "else", "esac",
+    "fi",    "for",  "function", "if",   "in",   "select", "then", "until",
+    "while", "{",    "}",        "time", "[[",   "]]",
+
+    "$|",    NULL};
+
+char *HTML_HL_extensions[] = {".html", ".htm", NULL};
+char *HTML_HL_keywords[] = {
+    "<!DOCTYPE>", "<!DOCTYPE html>", "<!DOCTYPE",
+      
+    "<a>", "<abbr>", "<address>", "<area>", "<article>", "<aside>", "<audio>", 
+    "<b>", "<base>", "<bdi>", "<bdo>", "<blockquote>", "<body>", "<br>", "<button>", 
+    "<canvas>", "<caption>", "<cite>", "<code>", "<col>", "<colgroup>", "<data>", 
+    "<datalist>", "<dd>", "<del>", "<details>", "<dfn>", "<dialog>", "<div>", "<dl>", 
+    "<dt>", "<em>", "<embed>", "<fieldset>", "<figure>", "<footer>", "<form>", "<h1>", 
+    "<h2>", "<h3>", "<h4>", "<h5>", "<h6>", "<head>", "<header>", "<hgroup>", "<hr>", 
+    "<html>", "<i>", "<iframe>", "<img>", "<input>", "<ins>", "<kbd>", "<keygen>", 
+    "<label>", "<legend>", "<li>", "<link>", "<main>", "<map>", "<mark>", "<menu>", 
+    "<menuitem>", "<meta>", "<meter>", "<nav>", "<noscript>", "<object>", "<ol>", 
+    "<optgroup>", "<option>", "<output>", "<p>", "<param>", "<pre>", "<progress>", "<q>", 
+    "<rb>", "<rp>", "<rt>", "<rtc>", "<ruby>", "<s>", "<samp>", "<script>", "<section>", 
+    "<select>", "<small>", "<source>", "<span>", "<strong>", "<style>", "<sub>", "<summary>", 
+    "<sup>", "<table>", "<tbody>", "<td>", "<template>", "<textarea>", "<tfoot>", "<th>", 
+    "<thead>", "<time>", "<title>", "<tr>", "<track>", "<u>", "<ul>", "<var>", "<video>", 
+    "<wbr>","<a", "<abbr", "<address", "<area", "<article", "<aside", "<audio", 
+    "<b", "<base", "<bdi", "<bdo", "<blockquote", "<body", "<br", "<button", 
+    "<canvas", "<caption", "<cite", "<code", "<col", "<colgroup", "<data", 
+    "<datalist", "<dd", "<del", "<details", "<dfn", "<dialog", "<div", "<dl", 
+    "<dt", "<em", "<embed", "<fieldset", "<figure", "<footer", "<form", "<h1", 
+    "<h2", "<h3", "<h4", "<h5", "<h6", "<head", "<header", "<hgroup", "<hr", 
+    "<html", "<i", "<iframe", "<img", "<input", "<ins", "<kbd", "<keygen", 
+    "<label", "<legend", "<li", "<link", "<main", "<map", "<mark", "<menu", 
+    "<menuitem", "<meta", "<meter", "<nav", "<noscript", "<object", "<ol", 
+    "<optgroup", "<option", "<output", "<p", "<param", "<pre", "<progress", "<q", 
+    "<rb", "<rp", "<rt", "<rtc", "<ruby", "<s", "<samp", "<script", "<section", 
+    "<select", "<small", "<source", "<span", "<strong", "<style", "<sub", "<summary", 
+    "<sup", "<table", "<tbody", "<td", "<template", "<textarea", "<tfoot", "<th", 
+    "<thead", "<time", "<title", "<tr", "<track", "<u", "<ul", "<var", "<video", 
+    "<wbr",
+  
+    "</a>", "</abbr>", "</address>", "</area>", "</article>", "</aside>", "</audio>", 
+    "</b>", "</base>", "</bdi>", "</bdo>", "</blockquote>", "</body>", "</br>", "</button>", 
+    "</canvas>", "</caption>", "</cite>", "</code>", "</col>", "</colgroup>", "</data>", 
+    "</datalist>", "</dd>", "</del>", "</details>", "</dfn>", "</dialog>", "</div>", "</dl>", 
+    "</dt>", "</em>", "</embed>", "</fieldset>", "</figure>", "</footer>", "</form>", "</h1>", 
+    "</h2>", "</h3>", "</h4>", "</h5>", "</h6>", "</head>", "</header>", "</hgroup>", "</hr>", 
+    "</html>", "</i>", "</iframe>", "</img>", "</input>", "</ins>", "</kbd>", "</keygen>", 
+    "</label>", "</legend>", "</li>", "</link>", "</main>", "</map>", "</mark>", "</menu>", 
+    "</menuitem>", "</meta>", "</meter>", "</nav>", "</noscript>", "</object>", "</ol>", 
+    "</optgroup>", "</option>", "</output>", "</p>", "</param>", "</pre>", "</progress>", "</q>", 
+    "</rb>", "</rp>", "</rt>", "</rtc>", "</ruby>", "</s>", "</samp>", "</script>", "</section>", 
+    "</select>", "</small>", "</source>", "</span>", "</strong>", "</style>", "</sub>", "</summary>", 
+    "</sup>", "</table>", "</tbody>", "</td>", "</template>", "</textarea>", "</tfoot>", "</th>", 
+    "</thead>", "</time>", "</title>", "</tr>", "</track>", "</u>", "</ul>", "</var>", "</video>", 
+    "</wbr>",    NULL};
+
+// compiled into hash tables on first use, see syndb.c
+struct tiSyntaxDef HLDB[] = {
+    {"C", C_HL_extensions, C_HL_keywords, "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL},
+
+    {"JS", JS_HL_extensions, JS_HL_keywords, "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL},
+
+    {"PYTHON", PYTHON_HL_extensions, PYTHON_HL_keywords, "#", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL},
+
+    {"GO", GO_HL_extensions, GO_HL_keywords, "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL},
+
+    {"BASH", BASH_HL_extensions, BASH_HL_keywords, "#", "#!", "sh",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL},
+
+    {"RUST", RUST_HL_extensions, RUST_HL_keywords, "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL},
+  
+    {"HTML", HTML_HL_extensions, HTML_HL_keywords, "//", "<!--- ", " --->",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL},
+};
+
+const int HLDB_ENTRIES = sizeof(HLDB) / sizeof(HLDB[0]);
+
+/*~~~~~~~~~~~~~~~~~~~~ syntax highlighting ~~~~~~~~~~~~~~~~~~~~*/
+
+int is_seperator(int c) {
+  return isspace(c) || c == '\0' || strchr(",.()+-/<>*~%[];", c) != NULL;
+}
+
+// highlights len bytes of render into hl, returns the comment state the
+// next row starts in
+int tiHighlightInto(const struct editorSyntax *syn, const char *render,
+                    int len, int in_comment, unsigned char *hl) {
+  memset(hl, HL_NORMAL, len);
+  if (syn == NULL)
+    return 0;
+
+  const unsigned char *sep = syn->separators;
+
+  const char *scs = syn->single_line_comment_start;
+  const char *mcs = syn->multi_line_comment_start;
+  const char *mce = syn->multi_line_comment_end;
+
+  int scs_len = scs ? strlen(scs) : 0;
+  int mcs_len = mcs ? strlen(mcs) : 0;
+  int mce_len = mce ? strlen(mce) : 0;
+
+  int prev_sep = 1;
+  int in_string = 0;
+  int i = 0;
+  while (i < len) {
+    char c = render[i];
+    unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+
+    if (scs_len && !in_string && !in_comment) {
+      if (!strncmp(&render[i], scs, scs_len)) {
+        memset(&hl[i], HL_COMMENT, len - i);
+        break;
+      }
+    }
+
+    if (mcs_len && mce_len && !in_string) {
+      if (in_comment) {
+        hl[i] = HL_MLCOMMENT;
+        if (!strncmp(&render[i], mce, mce_len)) {
+          memset(&hl[i], HL_MLCOMMENT, mce_len);
+          i += mce_len;
+          in_comment = 0;
+          prev_sep = 1;
+          continue;
+        } else {
+          i++;
+          continue;
+        }
+      } else if (!strncmp(&render[i], mcs, mcs_len)) {
+        memset(&hl[i], HL_MLCOMMENT, mcs_len);
+        i += mcs_len;
+        in_comment = 1;
+        continue;
+      }
+    }
+    
+
+    if (syn->flags & HL_HIGHLIGHT_STRINGS) {
+      if (in_string) {
+        hl[i] = HL_STRING;
+        if (c == '\\' && i + 1 < len) {
+          hl[i + 1] = HL_STRING;
+          i += 2;
+          continue;
+        }
+        if (c == in_string)
+          in_string = 0;
+        i++;
+        prev_sep = 1;
+        continue;
+      } else {
+        if (c == '"' || c == '\'') {
+          in_string = c;
+          hl[i] = HL_STRING;
+          i++;
+          continue;
+        }
+      }
+    }
+
+    if (syn->flags & HL_HIGHLIGHT_NUMBERS) {
+      if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) ||
+          (c == '.' && prev_hl == HL_NUMBER)) {
+        hl[i] = HL_NUMBER;
+        i++;
+        prev_sep = 0;
+        continue;
+      }
+    }
+
+    if (prev_sep) {
+      // only lengths some keyword has are looked up, ending at a separator
+      int klen = 0, type = HL_NORMAL;
+      for (int k = 0; k < syn->nlens && type == HL_NORMAL; ++k) {
+        klen = syn->lens[k];
+        if (i + klen <= len &&
+            sep[(unsigned char)render[i + klen]])
+          type = tiSyntaxKeyword(syn, &render[i], klen);
+      }
+      if (type != HL_NORMAL) {
+        memset(&hl[i], type, klen);
+        i += klen;
+        prev_sep = 0;
+        continue;
+      }
+    }
+
+    prev_sep = sep[(unsigned char)c];
+    i++;
+  }
+
+  return in_comment;
+}
+
+// highlights a single row, returns 1 if its open comment state changed.
+// Rows with the same render and incoming comment state share one hl array
+int tiHighlightRow(tiBuffer *b, erow *row) {
+  int in_comment = (row->idx > 0 && b->row[row->idx - 1].hl_open_comment);
+  int open_comment = 0;
+  const unsigned char *hl = tiHlAcquire(b->syntax, row->render, row->rsize,
+                                  in_comment, &open_comment);
+  tiHlRelease(row->hl);
+  row->hl = hl;
+
+  int changed = (row->hl_open_comment != open_comment);
+  row->hl_open_comment = open_comment;
+  return changed;
+}
+
+void tiUpdateSyntax(tiBuffer *b, erow *row) {
+  uint64_t start = STATS_BEGIN();
+  while (tiHighlightRow(b, row) && row->idx + 1 < b->numrows) {
+    row = &b->row[row->idx + 1];
+    if (row->render == NULL)
+      tiRenderRow(row);
+  }
+  STATS_END(STAGE_SYNTAX, start);
+}
+
+int tiSyntaxToColor(int hl) {
+
+  switch (hl) {
+  case HL_COMMENT:
+  case HL_MLCOMMENT:
+    return 35;
+
+  case HL_KEYWORD1:
+    return 33;
+
+  case HL_KEYWORD2:
+    return 32;
+
+  case HL_KEYWORD3:
+    return 93;
+
+  case HL_KEYWORD4:
+    return 92;
+
+  case HL_STRING:
+    return 36;
+
+  case HL_NUMBER:
+    return 31;
+
+  case HL_MATCH:
+    return 34;
+
+  default:
+    return 37;
+  }
+}
+
+void tiSelectSyntax(tiBuffer *b) {
+  struct editorSyntax *old = b->syntax;
+  b->syntax = b->setlang[0] ? tiSyntaxFind(b->setlang) : NULL;
+  if (b->syntax == NULL && b->filename)
+    b->syntax = tiSyntaxMatch(b->filename);
+
+  if (b->syntax == NULL && old == NULL)
+    return;
+  for (int filerow = 0; filerow < b->numrows; ++filerow)
+    tiUpdateSyntax(b, &b->row[filerow]);
+}
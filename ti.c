@@ -1,7 +1,3 @@
-/*~~~~~~~~~~~~~~~~~~~~ version ~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-
-#define TI_VERSION "0.0.6"
-
 /*~~~~~~~~~~~~~~~~~~~~ includes ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
 #define _DEFAULT_SOURCE
@@ -12,21 +8,46 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "ti.h"
+
 /*~~~~~~~~~~~~~~~~~~~~ defines ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
 #define TI_QUIT_TIMES 1
-#define TI_TAB_STOP 4
+#define TI_MEM_BUDGET (256 << 20)
+#define TI_FOLLOW_CHUNK (1 << 20)
+#define TI_STREAM_CHUNK (1 << 20)
+// ns of reading a stream per idle tick before keys get their turn again
+#define TI_STREAM_SLICE (50 * 1000000ULL)
+// ns a filter is waited for to exit once it closed its output, before
+// leaving it to the next idle tick
+#define TI_FILTER_REAP (10 * 1000000ULL)
+// rows handed to a filter command per writev, two iovecs each
+#define TI_FILTER_ROWS 256
+// counts typed before a command stop growing past this
+#define TI_MAX_COUNT 10000000
+// bytes of a request to the daemon: the client's directory and files
+#define TI_DAEMON_MSG (64 << 10)
+// ms the daemon waits for a client before checking its files again
+#define TI_DAEMON_POLL 1000
 #define ESC '\x1b'
 #define CTRL_KEY(key) ((key)&0x1f)
 
@@ -44,52 +65,65 @@ enum editorKey {
   PAGE_DOWN,
   WORD_NEXT,
   DEL_WORD_NEXT,
-  WORD_LAST
+  WORD_LAST,
+  IDLE_KEY
 
 };
 
-enum editorHighlight {
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
-  HL_NORMAL = 0,
-  HL_COMMENT,
-  HL_MLCOMMENT,
-  HL_KEYWORD1,
-  HL_KEYWORD2,
-  HL_KEYWORD3,
-  HL_KEYWORD4,
-  HL_STRING,
-  HL_NUMBER,
-  HL_MATCH
+struct editorBuffer {
 
+  tiBuffer *buf;
+  int cx, cy;
+  int rowoff, coloff;
+  unsigned long used;
+  int dropped;
+  char *path;
+  // the file as last read or written, stale once it changed behind our back
+  struct stat disk;
+  int stale;
+  // background save in flight, and the journal position it covers up to
+  tiSnapshot *autosave;
+  off_t mark;
+  uint64_t saved;
+  // follow mode: fd and inotify watch of the file, bytes consumed so far
+  int follow;
+  int fd;
+  int wd;
+  int changed;
+  int64_t tail;
+  // cursor row + 1 when the rows away from it were last packed, 0 if never
+  int froze;
+  // no journal until saved: it is another editor's, or it failed
+  int busy;
 };
 
-#define HL_HIGHLIGHT_NUMBERS (1 << 10)
-#define HL_HIGHLIGHT_STRINGS (1 << 1)
+// a viewport onto one of the buffers. Windows on the same buffer share its
+// rows and render/hl caches; only the cursor and offsets are per window
+struct editorWindow {
 
-/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  int buf;
+  int cx, cy;
+  int rx;
+  int rowoff, coloff;
+  int top, left;
+  int rows, cols;
+};
 
-struct editorSyntax {
+struct editorCursor {
 
-  char *filetype;
-  char **filematch;
-  char **keywords;
-  char *single_line_comment_start;
-  char *multi_line_comment_start;
-  char *multi_line_comment_end;
-  int flags;
+  int cx, cy;
+  // the cursor in E.cx/E.cy while the cursors are being walked
+  int main;
 };
 
-typedef struct erow {
+// keys recorded into a register by q, replayed by @
+struct editorMacro {
 
-  int idx;
-  int size;
-  int rsize;
-  char *chars;
-  char *render;
-  unsigned char *hl;
-  int hl_open_comment;
-
-} erow;
+  int *keys;
+  int len, cap;
+};
 
 struct editorConfig {
 
@@ -99,204 +133,277 @@ struct editorConfig {
   int coloff;
   int screenrows;
   int screencols;
-  int numrows;
-  erow *row;
-  int dirty;
+  int termrows;
+  int termcols;
+  tiBuffer *buf;
+  struct editorBuffer *bufs;
+  int nbufs;
+  int curbuf;
+  unsigned long tick;
+  size_t budget;
+  struct editorWindow *wins;
+  int nwins;
+  int curwin;
+  int inotify;
   int modal;
   int newfile;
   int delete;
-  char *filename;
-  char setlang[10];
   int theme;
+  int journal;
+  // set once the journal had something to say the help line must not hide
+  int notice;
+  int autosave;
+  int intern;
+  int compress;
+  // buffers are opened from and their sessions saved to tiSessionPath
+  int session;
+  // search match, drawn over the row's shared hl
+  tiBuffer *matchbuf;
+  int matchrow, matchrx, matchlen;
+  // the last query searched for, what ^N adds cursors on
+  char *query;
+  // cursors besides E.cx/E.cy, in document order. While a key is run at
+  // each of them, curcursor is the one being edited at and the rows of
+  // those after it are off by cursorshift, see editorCursorsEdit
+  struct editorCursor *cursors;
+  int ncursors, cursorcap;
+  int curcursor;
+  int cursorshift;
+  // registers a-z, the one q is recording into and the one @@ replays (-1
+  // for none). While a macro replays, replay is it and keys are read from
+  // replaypos in it; the rows of replaybuf are updated when it ends
+  struct editorMacro macros[26];
+  int recording;
+  int lastmacro;
+  const struct editorMacro *replay;
+  int replaypos;
+  tiBuffer *replaybuf;
+  // count typed before a normal mode command
+  int count;
   char statusmsg[80];
   time_t statusmsg_time;
-  struct editorSyntax *syntax;
   struct termios orig_termios;
 };
 
 struct editorConfig E;
 
-/*~~~~~~~~~~~~~~~~~~~~ filetypes ~~~~~~~~~~~~~~~~~~~*/
-
-// kw1 = default, kw2 = |, kw3 = ||, kw4 = &
-
-char *C_HL_extensions[] = {".c", ".h", ".cpp", NULL};
-char *C_HL_keywords[] = {
-    "switch",    "if",         "while",    "for",    "break",
-    "continue",  "return",     "else",     "struct", "union",
-    "typedef",   "static",     "enum",     "class",  "case",
-
-    "int|",      "long|",      "double|",  "float|", "char|",
-    "unsigned|", "signed|",    "void|",
-
-    "#define||", "#endif||",   "#error||", "#if||",  "#ifdef||",
-    "#ifndef||", "#include||", "#undef||", NULL};
-
-char *JS_HL_extensions[] = {".js", NULL};
-char *JS_HL_keywords[] = {
-
-  "await",            "break",             "case",         "catch", 
-  "class",            "const",             "continue",     "debugger",
-  "default",          "delete",            "do",           "else", 
-  "enum",             "export",            "extends",      "false",
-  "finally",          "for",               "function",     "if", 
-  "implements",       "import",            "in",           "instanceof",
-  "interface",        "let",               "new",          "null", 
-  "package",          "private",           "protected",    "public",
-  "return",           "super",             "switch",       "static", 
-  "this",             "throw",             "try",          "true",
-  "typeof",           "var",               "void",         "while", 
-  "with",             "yield", 
-  
-  "str|",             "arr|",              "Object|",       "set|",
-  "document|", 
-  
-  "includes||",       "style||",           "value||",       "addEventListener||", 
-  "querySelector||",  "indexOf||",         "split||",       "concat||", 
-  "replace||",        "size||",            "add||",         "delete||",
-  "trim||",           "toLowerCase||",     "toUpperCase||", "forEach||", 
-  "join||",           "keys||",            "value||",       "style||",  
-  "has||",            "backgroundColor||", "textAlign||",   "fontWeight||", 
-  "text||", "size||", "add||", "delete||",
-  "preventDefault||", NULL};
-
-char *RUST_HL_extensions[] = {".rs", NULL};
-char *RUST_HL_keywords[] = {
-  "as",       "break",     "const",     "continue", "crate",
-  "else",     "enum",      "extern",    "false",    "fn",
-  "for",      "if",        "impl",      "in",       "let",
-  "loop",     "match",     "mod",       "move",     "mut",
-  "pub",      "ref",       "return",    "self",     "Self",
-  "static",   "struct",    "super",     "trait",    "true",
-  "false",    "type",      "unsafe",    "use",      "where",
-  "while",    "abstract|", "become|",   "box|",     "do|",
-  "final|",   "macro|",    "override|", "priv|",    "typeof|",
-  "unsized|", "virtual|",  "yield|",    "try|",     "macro_rules|",
-  "union|",   "'static|",  "bool||",    "char||",   "str||",
-  "&str",     "u8||",      "u16||",     "u32||",    "u64||",
-  "u128||",   "i8||",      "i16||",     "i32||",    "i64||",
-  "i128||",   "println!&", NULL};
-
-char *PYTHON_HL_extensions[] = {".py", NULL};
-char *PYTHON_HL_keywords[] = {
-    "and",     "as",         "assert",   "break",    "class",   "continue",
-    "def",     "del",        "elif",     "else",     "except",  "exec",
-    "finally", "for",        "from",     "global",   "if",      "import",
-    "in",      "is",         "lambda",   "not",      "or",      "pass",
-    "print",   "raise",      "return",   "try",      "while",   "with",
-    "yield",
-
-    "buffer|", "bytearray|", "complex|", "False|",   "float|",  "frozenset|",
-    "int|",    "list|",      "long|",    "None|",    "set|",    "str|",
-    "tuple|",  "True|",      "type|",    "unicode|", "xrange|", NULL};
-
-char *GO_HL_extensions[] = {".go", NULL};
-char *GO_HL_keywords[] = {
-    "if",     "for",   "range",   "while",   "defer",   "switch", "case",
-    "else",   "func",  "package", "import",  "type",    "struct", "import",
-    "const",  "var",
-
-    "nil|",   "true|", "false|",  "error|",  "err|",    "int|",   "int32|",
-    "int64|", "uint|", "uint32|", "uint64|", "string|", "bool|",  NULL};
-
-char *BASH_HL_extensions[] = {".sh", NULL};
-char *BASH_HL_keywords[] = {
-    "!",     "case", "coproc",   "do",   "done", "elif",   "else", "esac",
-    "fi",    "for",  "function", "if",   "in",   "select", "then", "until",
-    "while", "{",    "}",        "time", "[[",   "]]",
-
-    "$|",    NULL};
-
-char *HTML_HL_extensions[] = {".html", ".htm", NULL};
-char *HTML_HL_keywords[] = {
-    "<!DOCTYPE>", "<!DOCTYPE html>", "<!DOCTYPE",
-      
-    "<a>", "<abbr>", "<address>", "<area>", "<article>", "<aside>", "<audio>", 
-    "<b>", "<base>", "<bdi>", "<bdo>", "<blockquote>", "<body>", "<br>", "<button>", 
-    "<canvas>", "<caption>", "<cite>", "<code>", "<col>", "<colgroup>", "<data>", 
-    "<datalist>", "<dd>", "<del>", "<details>", "<dfn>", "<dialog>", "<div>", "<dl>", 
-    "<dt>", "<em>", "<embed>", "<fieldset>", "<figure>", "<footer>", "<form>", "<h1>", 
-    "<h2>", "<h3>", "<h4>", "<h5>", "<h6>", "<head>", "<header>", "<hgroup>", "<hr>", 
-    "<html>", "<i>", "<iframe>", "<img>", "<input>", "<ins>", "<kbd>", "<keygen>", 
-    "<label>", "<legend>", "<li>", "<link>", "<main>", "<map>", "<mark>", "<menu>", 
-    "<menuitem>", "<meta>", "<meter>", "<nav>", "<noscript>", "<object>", "<ol>", 
-    "<optgroup>", "<option>", "<output>", "<p>", "<param>", "<pre>", "<progress>", "<q>", 
-    "<rb>", "<rp>", "<rt>", "<rtc>", "<ruby>", "<s>", "<samp>", "<script>", "<section>", 
-    "<select>", "<small>", "<source>", "<span>", "<strong>", "<style>", "<sub>", "<summary>", 
-    "<sup>", "<table>", "<tbody>", "<td>", "<template>", "<textarea>", "<tfoot>", "<th>", 
-    "<thead>", "<time>", "<title>", "<tr>", "<track>", "<u>", "<ul>", "<var>", "<video>", 
-    "<wbr>","<a", "<abbr", "<address", "<area", "<article", "<aside", "<audio", 
-    "<b", "<base", "<bdi", "<bdo", "<blockquote", "<body", "<br", "<button", 
-    "<canvas", "<caption", "<cite", "<code", "<col", "<colgroup", "<data", 
-    "<datalist", "<dd", "<del", "<details", "<dfn", "<dialog", "<div", "<dl", 
-    "<dt", "<em", "<embed", "<fieldset", "<figure", "<footer", "<form", "<h1", 
-    "<h2", "<h3", "<h4", "<h5", "<h6", "<head", "<header", "<hgroup", "<hr", 
-    "<html", "<i", "<iframe", "<img", "<input", "<ins", "<kbd", "<keygen", 
-    "<label", "<legend", "<li", "<link", "<main", "<map", "<mark", "<menu", 
-    "<menuitem", "<meta", "<meter", "<nav", "<noscript", "<object", "<ol", 
-    "<optgroup", "<option", "<output", "<p", "<param", "<pre", "<progress", "<q", 
-    "<rb", "<rp", "<rt", "<rtc", "<ruby", "<s", "<samp", "<script", "<section", 
-    "<select", "<small", "<source", "<span", "<strong", "<style", "<sub", "<summary", 
-    "<sup", "<table", "<tbody", "<td", "<template", "<textarea", "<tfoot", "<th", 
-    "<thead", "<time", "<title", "<tr", "<track", "<u", "<ul", "<var", "<video", 
-    "<wbr",
-  
-    "</a>", "</abbr>", "</address>", "</area>", "</article>", "</aside>", "</audio>", 
-    "</b>", "</base>", "</bdi>", "</bdo>", "</blockquote>", "</body>", "</br>", "</button>", 
-    "</canvas>", "</caption>", "</cite>", "</code>", "</col>", "</colgroup>", "</data>", 
-    "</datalist>", "</dd>", "</del>", "</details>", "</dfn>", "</dialog>", "</div>", "</dl>", 
-    "</dt>", "</em>", "</embed>", "</fieldset>", "</figure>", "</footer>", "</form>", "</h1>", 
-    "</h2>", "</h3>", "</h4>", "</h5>", "</h6>", "</head>", "</header>", "</hgroup>", "</hr>", 
-    "</html>", "</i>", "</iframe>", "</img>", "</input>", "</ins>", "</kbd>", "</keygen>", 
-    "</label>", "</legend>", "</li>", "</link>", "</main>", "</map>", "</mark>", "</menu>", 
-    "</menuitem>", "</meta>", "</meter>", "</nav>", "</noscript>", "</object>", "</ol>", 
-    "</optgroup>", "</option>", "</output>", "</p>", "</param>", "</pre>", "</progress>", "</q>", 
-    "</rb>", "</rp>", "</rt>", "</rtc>", "</ruby>", "</s>", "</samp>", "</script>", "</section>", 
-    "</select>", "</small>", "</source>", "</span>", "</strong>", "</style>", "</sub>", "</summary>", 
-    "</sup>", "</table>", "</tbody>", "</td>", "</template>", "</textarea>", "</tfoot>", "</th>", 
-    "</thead>", "</time>", "</title>", "</tr>", "</track>", "</u>", "</ul>", "</var>", "</video>", 
-    "</wbr>",    NULL};
-
-struct editorSyntax HLDB[] = {
-    {"C", C_HL_extensions, C_HL_keywords, "//", "/*", "*/",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
-
-    {"JS", JS_HL_extensions, JS_HL_keywords, "//", "/*", "*/",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
-
-    {"PYTHON", PYTHON_HL_extensions, PYTHON_HL_keywords, "#", "/*", "*/",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
-
-    {"GO", GO_HL_extensions, GO_HL_keywords, "//", "/*", "*/",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
-
-    {"BASH", BASH_HL_extensions, BASH_HL_keywords, "#", "#!", "sh",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
-
-    {"RUST", RUST_HL_extensions, RUST_HL_keywords, "//", "/*", "*/",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
-  
-    {"HTML", HTML_HL_extensions, HTML_HL_keywords, "//", "<!--- ", " --->",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
+// read-only view mode (-R), the editor windows are not used while p is set
+struct editorPager {
+
+  tiPager *p;
+  int64_t top;
+  int64_t line;
+  int exact;
+  int coloff;
+  int64_t indexed;
+};
+
+struct editorPager P;
+
+// stdin piped into a buffer while the editor runs (ti -), the partial last
+// line waits in buf for the rest of it
+struct editorStream {
+
+  int fd;
+  tiBuffer *b;
+  char *buf;
+  size_t len;
+  int64_t received;
+};
+
+struct editorStream S;
+
+// rows first to first + count - 1 of b being run through a shell command
+// (:!), pumped from editorIdle. Rows from next on (off bytes into it) are
+// still to be written to in; the lines read from out are collected in
+// result, which replaces the range once out is closed. Any other change to
+// b (edits moving off) cancels it
+struct editorFilter {
+
+  pid_t pid;
+  int in, out;
+  tiBuffer *b;
+  unsigned edits;
+  int first, count;
+  int next;
+  size_t off;
+  tiBuffer *result;
+  char *buf;
+  size_t len;
+  int64_t sent, received;
+  char *cmd;
 };
 
-#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+struct editorFilter F;
 
 /*~~~~~~~~~~~~~~~~~~~~ function prototypes ~~~~~~~~~~~~~~~~~~~*/
 
 void editorSetStatusMessage(const char *fmt, ...);
 void editorRefreshScreen();
 char *editorPrompt(char *prompt, void (*callback)(char *, int));
+int editorDecodeKey(char c);
+int termRead(char *c);
+void termWrite(const char *s, int len);
+int getWindowSize(int *rows, int *cols);
+int editorIdle();
+void editorStopFollow(struct editorBuffer *eb);
+int editorWatchFile(struct editorBuffer *eb);
+void editorDiskSync(struct editorBuffer *eb);
+int editorCheckDisk(struct editorBuffer *eb);
+void editorStreamClose();
+void editorJournalOpen(struct editorBuffer *eb);
+void editorJournalClose(struct editorBuffer *eb);
+int editorAutosaveFinish(struct editorBuffer *eb, int wait);
+void editorPagerRefresh();
+void editorPagerHandleKey(int c);
+void editorCursorsEdit(int r, int c, int newr, int dcol, int drows);
+void editorCursorsClear();
+void editorHandleKey(int c);
+void editorDispatchKey(int c);
+void editorMacroRecord(int c);
+void editorFilterCancel(const char *why);
+void editorLoadFile(char *filename);
+void editorInitWindows();
+
+/*~~~~~~~~~~~~~~~~~~~~ instrumentation ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void editorStatsCommand(char *arg) {
+  while (*arg == ' ')
+    arg++;
+
+  if (!strcmp(arg, "on")) {
+    tiStats.enabled = 1;
+    editorSetStatusMessage("stats enabled");
+    return;
+  } else if (!strcmp(arg, "off")) {
+    tiStats.enabled = tiStats.trace != NULL;
+    editorSetStatusMessage(tiStats.enabled ? "stats still recording for --trace"
+                                     : "stats disabled");
+    return;
+  } else if (!strcmp(arg, "reset")) {
+    statsReset();
+    editorSetStatusMessage("stats reset");
+    return;
+  }
+
+  if (!tiStats.enabled) {
+    editorSetStatusMessage("stats disabled, ':stats on' to start recording");
+    return;
+  }
+
+  char p50[16], p90[16], p99[16], max[16];
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    if (strcmp(arg, stageNames[i]))
+      continue;
+
+    struct stageStats *st = &tiStats.stage[i];
+    statsFormat(p50, sizeof(p50), statsPercentile(st, 50));
+    statsFormat(p90, sizeof(p90), statsPercentile(st, 90));
+    statsFormat(p99, sizeof(p99), statsPercentile(st, 99));
+    statsFormat(max, sizeof(max), st->max);
+    editorSetStatusMessage("%s: %llu calls p50 %s p90 %s p99 %s max %s",
+                           stageNames[i], (unsigned long long)st->count, p50,
+                           p90, p99, max);
+    return;
+  }
+
+  // p50/p99 of every stage but read, which is mostly waiting on the user
+  char msg[80];
+  int len = 0;
+  for (int i = STAGE_PROCESS; i < STAGE_COUNT; ++i) {
+    statsFormat(p50, sizeof(p50), statsPercentile(&tiStats.stage[i], 50));
+    statsFormat(p99, sizeof(p99), statsPercentile(&tiStats.stage[i], 99));
+    len += snprintf(msg + len, sizeof(msg) - len, "%s%.4s %s/%s",
+                    len ? " | " : "", stageNames[i], p50, p99);
+    if (len >= (int)sizeof(msg))
+      break;
+  }
+  editorSetStatusMessage("%s", msg);
+}
+
+void editorMemCommand(char *arg) {
+  char live[16], peak[16];
+  while (*arg == ' ')
+    arg++;
+
+  for (int i = 0; i < MEM_COUNT; ++i) {
+    if (strcmp(arg, memNames[i]))
+      continue;
+
+    struct memCategory *mc = &tiMem.cat[i];
+    memFormat(live, sizeof(live), mc->live);
+    memFormat(peak, sizeof(peak), mc->peak);
+    editorSetStatusMessage("%s: %s live in %zu blocks, peak %s, %zu allocs",
+                           memNames[i], live, mc->live_allocs, peak,
+                           mc->allocs);
+    return;
+  }
+
+  char msg[80];
+  int len = memFormat(msg, sizeof(msg), memTotal());
+  len += snprintf(msg + len, sizeof(msg) - len, " |");
+  for (int i = 0; i < MEM_COUNT && len < (int)sizeof(msg); ++i) {
+    if (tiMem.cat[i].live == 0)
+      continue;
+    memFormat(live, sizeof(live), tiMem.cat[i].live);
+    len += snprintf(msg + len, sizeof(msg) - len, " %s %s", memNames[i], live);
+  }
+  editorSetStatusMessage("%s", msg);
+}
+
+void editorHlCacheCommand() {
+  char shared[16], idle[16];
+  memFormat(shared, sizeof(shared), tiHl.shared);
+  memFormat(idle, sizeof(idle), tiHl.idle);
+  editorSetStatusMessage(
+      "hl cache: %.1f%% hits of %llu, %zu entries, %s shared, %s idle",
+      tiHl.lookups ? 100.0 * tiHl.hits / tiHl.lookups : 0.0,
+      (unsigned long long)tiHl.lookups, tiHl.entries, shared, idle);
+}
+
+void editorInternCommand() {
+  char pool[16], saved[16];
+  memFormat(pool, sizeof(pool), tiIntern.bytes + tiIntern.overhead);
+  // each distinct line costs its bookkeeping on top of its bytes
+  size_t net = tiIntern.saved > tiIntern.overhead
+                   ? tiIntern.saved - tiIntern.overhead
+                   : 0;
+  memFormat(saved, sizeof(saved), net);
+  editorSetStatusMessage("intern %s: %zu lines in %s, %s saved, %.1f%% hits",
+                         E.intern ? "on" : "off", tiIntern.entries, pool,
+                         saved,
+                         tiIntern.lookups
+                             ? 100.0 * tiIntern.hits / tiIntern.lookups
+                             : 0.0);
+}
+
+void editorCompressCommand() {
+  int rows = 0;
+  for (int i = 0; i < E.nbufs; ++i)
+    for (int j = 0; j < E.bufs[i].buf->numrows; ++j)
+      rows += E.bufs[i].buf->row[j].cold != NULL;
+  char raw[16], packed[16];
+  memFormat(raw, sizeof(raw), tiCold.raw);
+  memFormat(packed, sizeof(packed), tiCold.packed);
+  editorSetStatusMessage(
+      "compress %s: %d rows in %zu blocks, %s packed into %s, %.1f%% hits",
+      E.compress ? "on" : "off", rows, tiCold.blocks, raw, packed,
+      tiCold.reads ? 100.0 * tiCold.hits / tiCold.reads : 0.0);
+}
 
 /*~~~~~~~~~~~~~~~~~~~~ terminal ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
 void die(const char *s) {
-  write(STDOUT_FILENO, "\x1b[2J", 4);
-  write(STDOUT_FILENO, "\x1b[H", 3);
+  termWrite("\x1b[2J", 4);
+  termWrite("\x1b[H", 3);
   perror(s);
   exit(1);
 }
 
+/* The tty layer below is left out of headless builds (see bench/tibench.c),
+ * which provide their own termRead/termWrite/getWindowSize. */
+#ifndef TI_HEADLESS
+
 void disableRawMode() {
   if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1)
     die("tcsetattr");
@@ -320,27 +427,93 @@ void enableRawMode() {
     die("tcsetattr");
 }
 
+int termRead(char *c) {
+  // while a stream is read, more of it arriving also ends the wait for a key
+  if (S.fd != -1) {
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {S.fd, POLLIN, 0}};
+    if (poll(fds, 2, 100) <= 0 || !(fds[0].revents & POLLIN))
+      return 0;
+  }
+  return read(STDIN_FILENO, c, 1);
+}
+
+void termWrite(const char *s, int len) { write(STDOUT_FILENO, s, len); }
+
+int getCursorPosition(int *rows, int *cols) {
+  char buf[32];
+  unsigned int i = 0;
+
+  if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4)
+    return -1;
+  while (i < sizeof(buf) - 1) {
+    if (read(STDIN_FILENO, &buf[i], 1) != 1)
+      break;
+    if (buf[i] == 'R')
+      break;
+    i++;
+  }
+  buf[i] = '\0';
+
+  if (buf[0] != ESC || buf[1] != '[')
+    return -1;
+  if (sscanf(&buf[2], "%d;%d", rows, cols) != 2)
+    return -1;
+  return -1;
+}
+
+int getWindowSize(int *rows, int *cols) {
+  struct winsize ws;
+
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
+    if (write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12)
+      return -1;
+    return getCursorPosition(rows, cols);
+  } else {
+    *cols = ws.ws_col;
+    *rows = ws.ws_row;
+    return 0;
+  }
+}
+
+#endif /* TI_HEADLESS */
+
 int editorReadKey() {
 
   int nread;
   char c;
 
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
+  // a key run out of keys mid-macro (an unfinished prompt) is cancelled
+  if (E.replay)
+    return E.replaypos < E.replay->len ? E.replay->keys[E.replaypos++] : ESC;
+
+  while ((nread = termRead(&c)) != 1) {
     if (nread == -1 && errno != EAGAIN)
       die("read");
+    // nothing typed within VTIME, let background work update the screen
+    if (nread == 0 && editorIdle())
+      return IDLE_KEY;
   }
 
+  uint64_t start = STATS_BEGIN();
+  int key = editorDecodeKey(c);
+  STATS_END(STAGE_READ, start);
+  if (E.recording != -1)
+    editorMacroRecord(key);
+  return key;
+}
+
+int editorDecodeKey(char c) {
   if (c == ESC) {
     char seq[3];
 
-    if (read(STDIN_FILENO, &seq[0], 1) != 1)
+    if (termRead(&seq[0]) != 1)
       return ESC;
-    if (read(STDIN_FILENO, &seq[1], 1) != 1)
+    if (termRead(&seq[1]) != 1)
       return ESC;
 
     if (seq[0] == '[') {
       if (seq[1] >= '0' && seq[1] <= '9') {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1)
+        if (termRead(&seq[2]) != 1)
           return ESC;
         if (seq[2] == '~') {
           switch (seq[1]) {
@@ -391,531 +564,1335 @@ int editorReadKey() {
   }
 }
 
-int getCursorPosition(int *rows, int *cols) {
-  char buf[32];
-  unsigned int i = 0;
+/*~~~~~~~~~~~~~~~~~~~~ editor operations ~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
-  if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4)
-    return -1;
-  while (i < sizeof(buf) - 1) {
-    if (read(STDIN_FILENO, &buf[i], 1) != 1)
-      break;
-    if (buf[i] == 'R')
-      break;
-    i++;
+void editorDelRow(int at) {
+  tiDelRow(E.buf, at);
+  editorCursorsEdit(at, 0, at, 0, -1);
+  E.cx = 0;
+}
+
+void editorInsertChar(int c) {
+  if (E.cy == E.buf->numrows)
+    tiInsertRow(E.buf, E.buf->numrows, "", 0);
+
+  tiRowInsertChar(E.buf, &E.buf->row[E.cy], E.cx, c);
+  editorCursorsEdit(E.cy, E.cx, E.cy, 1, 0);
+  E.cx++;
+}
+
+void editorInsertNewline() {
+  if (E.cx == 0) {
+    tiInsertRow(E.buf, E.cy, "", 0);
+  } else {
+    erow *row = &E.buf->row[E.cy];
+    tiInsertRow(E.buf, E.cy + 1, tiRowChars(row) + E.cx, row->size - E.cx);
+    tiRowTruncate(E.buf, &E.buf->row[E.cy], E.cx);
   }
-  buf[i] = '\0';
+  editorCursorsEdit(E.cy, E.cx, E.cy + 1, -E.cx, 1);
 
-  if (buf[0] != ESC || buf[1] != '[')
-    return -1;
-  if (sscanf(&buf[2], "%d;%d", rows, cols) != 2)
-    return -1;
-  return -1;
+  E.cy++;
+  E.cx = 0;
 }
 
-int getWindowSize(int *rows, int *cols) {
-  struct winsize ws;
+void editorDelChar() {
+  if (E.cy == E.buf->numrows)
+    return;
+  if (E.cx == 0 && E.cy == 0)
+    return;
 
-  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
-    if (write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12)
-      return -1;
-    return getCursorPosition(rows, cols);
+  erow *row = &E.buf->row[E.cy];
+  if (E.cx > 0) {
+    tiRowDelChar(E.buf, row, E.cx - 1);
+    editorCursorsEdit(E.cy, E.cx, E.cy, -1, 0);
+    E.cx--;
   } else {
-    *cols = ws.ws_col;
-    *rows = ws.ws_row;
-    return 0;
+    int joined = E.buf->row[E.cy - 1].size;
+    tiRowAppendString(E.buf, &E.buf->row[E.cy - 1], tiRowChars(row),
+                      row->size);
+    tiDelRow(E.buf, E.cy);
+    editorCursorsEdit(E.cy, 0, E.cy - 1, joined, -1);
+    E.cy--;
+    E.cx = joined;
   }
 }
 
-/*~~~~~~~~~~~~~~~~~~~~ syntax highlighting ~~~~~~~~~~~~~~~~~~~~*/
+/*~~~~~~~~~~~~~~~~~~~~ file I/O ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
-int is_seperator(int c) {
-  return isspace(c) || c == '\0' || strchr(",.()+-/<>*~%[];", c) != NULL;
+// reads the file into the current buffer from the session saved when it
+// was last closed, if it is unchanged since. Returns 1 then with the view
+// it had, otherwise what tiOpen does
+int editorSessionOpen(const char *filename, struct tiSessionView *view) {
+  char *spath = E.session ? tiSessionPath(filename) : NULL;
+  int restored = spath && tiSessionOpen(E.buf, filename, spath, view);
+  free(spath);
+  return restored ? 1 : tiOpen(E.buf, filename);
 }
 
-void editorUpdateSyntax(erow *row) {
-  row->hl = realloc(row->hl, row->rsize);
-  memset(row->hl, HL_NORMAL, row->size);
+// puts the cursor back where a session left it, as far as the rows a
+// recovered journal changed since allow
+void editorSessionView(const struct tiSessionView *view) {
+  E.cy = view->cy < 0 ? 0 : view->cy;
+  if (E.cy > E.buf->numrows)
+    E.cy = E.buf->numrows;
+  int size = E.cy < E.buf->numrows ? E.buf->row[E.cy].size : 0;
+  E.cx = view->cx < 0 ? 0 : view->cx > size ? size : view->cx;
+  E.rowoff = view->rowoff < 0 || view->rowoff > E.cy ? E.cy : view->rowoff;
+  E.coloff = view->coloff < 0 ? 0 : view->coloff;
+}
 
-  if (E.syntax == NULL)
+// keeps how the buffer was opened and the view on it for the next time
+// the file is, while it matches the file
+void editorSessionSave(int i) {
+  struct editorBuffer *eb = &E.bufs[i];
+  tiBuffer *b = eb->buf;
+  if (!E.session || eb->path == NULL || eb->follow || b->dirty ||
+      eb->stale || eb->autosave || S.b == b || b->numrows == 0)
     return;
+  struct tiSessionView view = {eb->cx, eb->cy, eb->rowoff, eb->coloff};
+  if (i == E.curbuf)
+    view = (struct tiSessionView){E.cx, E.cy, E.rowoff, E.coloff};
+  char *spath = tiSessionPath(eb->path);
+  if (spath)
+    tiSessionSave(b, eb->path, spath, &eb->disk, &view);
+  free(spath);
+}
 
-  char **keywords = E.syntax->keywords;
-
-  char *scs = E.syntax->single_line_comment_start;
-  char *mcs = E.syntax->multi_line_comment_start;
-  char *mce = E.syntax->multi_line_comment_end;
-
-  int scs_len = scs ? strlen(scs) : 0;
-  int mcs_len = mcs ? strlen(mcs) : 0;
-  int mce_len = mce ? strlen(mce) : 0;
-
-  int prev_sep = 1;
-  int in_string = 0;
-  int in_comment = (row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
-
-  int i = 0;
-  while (i < row->rsize) {
-    char c = row->render[i];
-    unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
+void editorOpen(char *filename) {
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  editorJournalClose(eb);
+  free(eb->path);
+  eb->path = strdup(filename);
+  eb->busy = 0;
+  struct tiSessionView view;
+  int restored = editorSessionOpen(filename, &view) == 1;
+  editorDiskSync(eb);
+  editorWatchFile(eb);
+  editorJournalOpen(eb);
+  if (restored)
+    editorSessionView(&view);
+}
 
-    if (scs_len && !in_string && !in_comment) {
-      if (!strncmp(&row->render[i], scs, scs_len)) {
-        memset(&row->hl[i], HL_COMMENT, row->size - i);
-        break;
-      }
-    }
+// returns 0 once the buffer is on disk
+int editorSave(int force) {
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  editorAutosaveFinish(eb, 1);
+  int named = eb->path != NULL;
 
-    if (mcs_len && mce_len && !in_string) {
-      if (in_comment) {
-        row->hl[i] = HL_MLCOMMENT;
-        if (!strncmp(&row->render[i], mce, mce_len)) {
-          memset(&row->hl[i], HL_MLCOMMENT, mce_len);
-          i += mce_len;
-          in_comment = 0;
-          prev_sep = 1;
-          continue;
-        } else {
-          i++;
-          continue;
-        }
-      } else if (!strncmp(&row->render[i], mcs, mcs_len)) {
-        memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
-        i += mcs_len;
-        in_comment = 1;
-        continue;
-      }
+  if (E.newfile) {
+    E.newfile = 0;
+    char *tmpfilename = NULL;
+    tmpfilename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
+    if (tmpfilename == NULL || E.buf->filename == tmpfilename) {
+      editorSetStatusMessage("Save aborted");
+      free(tmpfilename);
+      return -1;
     }
     
-
-    if (E.syntax->flags & HL_HIGHLIGHT_STRINGS) {
-      if (in_string) {
-        row->hl[i] = HL_STRING;
-        if (c == '\\' && i + 1 < row->rsize) {
-          row->hl[i + 1] = HL_STRING;
-          i += 2;
-          continue;
-        }
-        if (c == in_string)
-          in_string = 0;
-        i++;
-        prev_sep = 1;
-        continue;
-      } else {
-        if (c == '"' || c == '\'') {
-          in_string = c;
-          row->hl[i] = HL_STRING;
-          i++;
-          continue;
-        }
-      }
+    if (E.buf->filename) {
+      editorSave(force);
     }
-
-    if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS) {
-      if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) ||
-          (c == '.' && prev_hl == HL_NUMBER)) {
-        row->hl[i] = HL_NUMBER;
-        i++;
-        prev_sep = 0;
-        continue;
-      }
+    editorOpen(tmpfilename);
+    return 0;
+  } else if (E.buf->filename == NULL) {
+    char *path = editorPrompt("Save as: %s (ESC to cancel)", NULL);
+    if (path == NULL) {
+      editorSetStatusMessage("Save aborted");
+      return -1;
     }
 
-    if (prev_sep) {
-      int j;
-      for (j = 0; keywords[j]; ++j) {
-        int klen = strlen(keywords[j]);
-        int kw2 = keywords[j][klen - 1] == '|';
-        int kw3 = keywords[j][klen - 1] == '|' && keywords[j][klen - 2] == '|';
-        int kw4 = keywords[j][klen - 1] == '&';
-        if (kw4)
-          klen--;
-        else if (kw3)
-          klen -= 2;
-        else if (kw2)
-          klen--;
-
-        if (!strncmp(&row->render[i], keywords[j], klen) &&
-            is_seperator(row->render[i + klen])) {
-
-          if (kw2 && !kw3)
-            memset(&row->hl[i], HL_KEYWORD2, klen);
-          else if (kw3)
-            memset(&row->hl[i], HL_KEYWORD3, klen);
-          else if (kw4)
-            memset(&row->hl[i], HL_KEYWORD4, klen);
-          else
-            memset(&row->hl[i], HL_KEYWORD1, klen);
-          
-          i += klen;
-          break;
-        }
-      }
-      if (keywords[j] != NULL) {
-        prev_sep = 0;
-        continue;
-      }
+    free(eb->path);
+    eb->path = path;
+    E.buf->filename = strdup(basename(path));
+    tiSelectSyntax(E.buf);
+  }
+
+  // don't clobber what someone else wrote since the file was read
+  if (!force && named) {
+    editorCheckDisk(eb);
+    if (eb->stale) {
+      editorSetStatusMessage("%s changed on disk, ':w!' overwrites it, "
+                             "':reload' loads it", E.buf->filename);
+      return -1;
     }
+  }
 
-    prev_sep = is_seperator(c);
-    i++;
+  ssize_t len = tiSave(E.buf, eb->path);
+  if (len != -1) {
+    editorDiskSync(eb);
+    editorWatchFile(eb);
+    // the file holds our edits now, a journal left by a crash is stale
+    eb->busy = 0;
+    if (E.buf->journal == NULL)
+      editorJournalOpen(eb);
+    editorSetStatusMessage("%zd bytes written to disk", len);
+    return 0;
   }
 
-  int changed = (row->hl_open_comment != in_comment);
-  row->hl_open_comment = in_comment;
-  if (changed && row->idx + 1 < E.numrows)
-    editorUpdateSyntax(&E.row[row->idx + 1]);
+  editorSetStatusMessage("Failed write to disk! I/O error: %s",
+                         strerror(errno));
+  return -1;
 }
 
-int editorSyntaxToColor(int hl) {
+/*~~~~~~~~~~~~~~~~~~~~ buffer list ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+int editorAddBuffer(tiBuffer *b) {
+  E.bufs = realloc(E.bufs, sizeof(struct editorBuffer) * (E.nbufs + 1));
+  struct editorBuffer *eb = &E.bufs[E.nbufs];
+  memset(eb, 0, sizeof(*eb));
+  eb->buf = b;
+  eb->fd = -1;
+  eb->wd = -1;
+  b->intern = E.intern;
+  return E.nbufs++;
+}
 
-  switch (hl) {
-  case HL_COMMENT:
-  case HL_MLCOMMENT:
-    return 35;
+// inactive buffers keep their rows, but give up the render and hl caches
+// (least recently used first) while the editor is over its memory budget.
+// Highlight results no row uses go before any of them
+void editorEnforceBudget() {
+  if (memTotal() > E.budget)
+    tiHlTrim();
+  while (memTotal() > E.budget) {
+    int victim = -1;
+    for (int i = 0; i < E.nbufs; ++i) {
+      if (i == E.curbuf || E.bufs[i].dropped)
+        continue;
+      int shown = 0;
+      for (int w = 0; w < E.nwins; ++w)
+        if (w != E.curwin && E.wins[w].buf == i)
+          shown = 1;
+      if (shown)
+        continue;
+      if (victim == -1 || E.bufs[i].used < E.bufs[victim].used)
+        victim = i;
+    }
+    if (victim == -1)
+      break;
+    tiBufferDropCaches(E.bufs[victim].buf);
+    E.bufs[victim].dropped = 1;
+  }
+}
 
-  case HL_KEYWORD1:
-    return 33;
+// rows further than this from the cursor are packed while compress is on
+#define COLD_WINDOW 2048
 
-  case HL_KEYWORD2:
-    return 32;
+// packs the rows of the current buffer away from the cursor, once it has
+// moved far enough from where that was last done. Returns rows packed
+int editorFreeze(int force) {
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  if (!E.compress || E.buf->numrows <= 2 * COLD_WINDOW)
+    return 0;
+  if (!force && eb->froze && abs(E.cy + 1 - eb->froze) < COLD_WINDOW / 2)
+    return 0;
+  eb->froze = E.cy + 1;
+  return tiBufferFreeze(E.buf, E.cy - COLD_WINDOW, E.cy + COLD_WINDOW);
+}
 
-  case HL_KEYWORD3:
-    return 93;
+void editorSwitchBuffer(int n) {
+  if (n < 0 || n >= E.nbufs)
+    return;
 
-  case HL_KEYWORD4:
-    return 92;
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  editorCursorsClear();
+  eb->cx = E.cx;
+  eb->cy = E.cy;
+  eb->rowoff = E.rowoff;
+  eb->coloff = E.coloff;
+  eb->used = ++E.tick;
+
+  eb = &E.bufs[n];
+  E.curbuf = n;
+  E.buf = eb->buf;
+  E.cx = eb->cx;
+  E.cy = eb->cy;
+  E.rowoff = eb->rowoff;
+  E.coloff = eb->coloff;
+  eb->used = ++E.tick;
+  eb->dropped = 0;
+  // an editor forked by the daemon journals the buffers it goes to
+  editorJournalOpen(eb);
+  editorEnforceBudget();
+}
 
-  case HL_STRING:
-    return 36;
+// the same file however it was named, or the same name if it doesn't
+// exist yet
+int editorSamePath(const char *a, const char *b) {
+  char *ra = realpath(a, NULL);
+  char *rb = ra ? realpath(b, NULL) : NULL;
+  int same = ra && rb ? !strcmp(ra, rb) : !strcmp(a, b);
+  free(ra);
+  free(rb);
+  return same;
+}
 
-  case HL_NUMBER:
-    return 31;
+void editorEditFile(char *filename) {
+  for (int i = 0; i < E.nbufs; ++i) {
+    if (E.bufs[i].path && editorSamePath(E.bufs[i].path, filename)) {
+      editorSwitchBuffer(i);
+      return;
+    }
+  }
 
-  case HL_MATCH:
-    return 34;
+  editorLoadFile(filename);
+}
 
-  default:
-    return 37;
+// opens filename in a buffer of its own, reusing an untouched scratch one
+void editorLoadFile(char *filename) {
+  const char *name = basename(filename);
+  if (E.buf->filename || E.buf->numrows || E.buf->dirty) {
+    tiBuffer *b = tiBufferNew();
+    if (b == NULL) {
+      editorSetStatusMessage("Can't open %s: %s", name, strerror(errno));
+      return;
+    }
+    editorSwitchBuffer(editorAddBuffer(b));
   }
+
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  free(eb->path);
+  eb->path = strdup(filename);
+  eb->busy = 0;
+  struct tiSessionView view;
+  int opened = editorSessionOpen(filename, &view);
+  if (opened == -1)
+    editorSetStatusMessage("\"%s\" [New File]", name);
+  else
+    editorSetStatusMessage("\"%s\" %d lines", name, E.buf->numrows);
+  editorDiskSync(eb);
+  editorWatchFile(eb);
+  editorJournalOpen(eb);
+  if (opened == 1)
+    editorSessionView(&view);
+  editorEnforceBudget();
 }
 
-void editorSelectSyntaxHighlighting() {
-  E.syntax = NULL;
-  if (E.filename == NULL)
-    return;
+void editorNextBuffer(int direction) {
+  editorSwitchBuffer((E.curbuf + direction + E.nbufs) % E.nbufs);
+}
 
-  char *ext = strchr(E.filename, '.');
-  if (!strcmp(E.setlang, "c") || !strcmp(E.setlang, "c++")) {
-    ext = ".c";
-  }
-  else if (!strcmp(E.setlang, "python")){
-    ext = ".py";
-  }
-  else if (!strcmp(E.setlang, "rust")) {
-    ext = ".rs";
-  }
-  else if (!strcmp(E.setlang, "js")) {
-    ext = ".js";
-  }
-  else if (!strcmp(E.setlang, "html")) {
-    ext = ".html";
-  }
-  else if (!strcmp(E.setlang, "go")) {
-    ext = ".go";
+void editorCloseBuffer(int force) {
+  if (E.buf->dirty && !force) {
+    editorSetStatusMessage("Unsaved changes, ':bd!' to discard them");
+    return;
   }
 
-  for (unsigned int j = 0; j < HLDB_ENTRIES; ++j) {
-    struct editorSyntax *s = &HLDB[j];
-    unsigned int i = 0;
-    while (s->filematch[i]) {
-      int is_ext = (s->filematch[i][0] == '.');
-      if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
-          (!is_ext && strstr(E.filename, s->filematch[i]))) {
-        E.syntax = s;
-
-        int filerow;
-        for (filerow = 0; filerow < E.numrows; ++filerow) {
-          editorUpdateSyntax(&E.row[filerow]);
-        }
-
-        return;
-      }
+  editorAutosaveFinish(&E.bufs[E.curbuf], 1);
+  editorSessionSave(E.curbuf);
+  editorStopFollow(&E.bufs[E.curbuf]);
+  editorJournalClose(&E.bufs[E.curbuf]);
+  if (S.b == E.buf)
+    editorStreamClose();
+  free(E.bufs[E.curbuf].path);
+  E.bufs[E.curbuf].path = NULL;
+  if (E.replaybuf == E.buf)
+    E.replaybuf = NULL;
+  if (F.b == E.buf)
+    editorFilterCancel("its buffer was closed");
+  tiBufferFree(E.buf);
+  if (E.nbufs == 1) {
+    E.bufs[0].buf = tiBufferNew();
+    E.buf = E.bufs[0].buf;
+    E.buf->intern = E.intern;
+    E.cx = E.cy = E.rowoff = E.coloff = 0;
+    return;
+  }
 
-      i++;
+  int closed = E.curbuf;
+  memmove(&E.bufs[closed], &E.bufs[closed + 1],
+          sizeof(struct editorBuffer) * (E.nbufs - closed - 1));
+  E.nbufs--;
+
+  // switch without saving the view of the slot that was just removed
+  E.curbuf = closed < E.nbufs ? closed : E.nbufs - 1;
+  for (int i = 0; i < E.nwins; ++i) {
+    struct editorWindow *w = &E.wins[i];
+    if (w->buf == closed) {
+      w->buf = E.curbuf;
+      w->cx = w->cy = w->rowoff = w->coloff = 0;
+    } else if (w->buf > closed) {
+      w->buf--;
     }
   }
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  E.buf = eb->buf;
+  E.cx = eb->cx;
+  E.cy = eb->cy;
+  E.rowoff = eb->rowoff;
+  E.coloff = eb->coloff;
+  eb->used = ++E.tick;
+  eb->dropped = 0;
 }
 
-/*~~~~~~~~~~~~~~~~~~~~ row operations ~~~~~~~~~~~~~~~~~~~~~~~~~*/
+int editorDirtyBuffers() {
+  int dirty = 0;
+  for (int i = 0; i < E.nbufs; ++i)
+    if (E.bufs[i].buf->dirty)
+      dirty++;
+  return dirty;
+}
 
-int editorRowCxToRx(erow *row, int cx) {
-  int rx = 0;
-  int j;
-  for (j = 0; j < cx; ++j) {
-    if (row->chars[j] == '\t')
-      rx += (TI_TAB_STOP - 1) - (rx % TI_TAB_STOP);
-    rx++;
+void editorListBuffers() {
+  char msg[80];
+  int len = 0;
+  for (int i = 0; i < E.nbufs && len < (int)sizeof(msg); ++i) {
+    tiBuffer *b = E.bufs[i].buf;
+    len += snprintf(msg + len, sizeof(msg) - len, "%s%s%d:%.20s%s%s",
+                    len ? " " : "", i == E.curbuf ? "[" : "", i + 1,
+                    b->filename ? b->filename : "[SCRATCH]",
+                    b->dirty ? "+" : "", i == E.curbuf ? "]" : "");
   }
-
-  return rx;
+  editorSetStatusMessage("%s", msg);
 }
 
-int editorRowRxToCx(erow *row, int rx) {
-  int cur_rx = 0;
-  int cx;
-  for (cx = 0; cx < row->size; ++cx) {
-    if (row->chars[cx] == '\t')
-      cur_rx += (TI_TAB_STOP - 1) - (cur_rx % TI_TAB_STOP);
-    cur_rx++;
-    if (cur_rx > rx)
-      return cx;
-  }
+/*~~~~~~~~~~~~~~~~~~~~ windows ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// E.cx, E.cy, ... are the live view of the current window; they are written
+// back before drawing or leaving it
+void editorSaveWindow() {
+  struct editorWindow *w = &E.wins[E.curwin];
+  w->buf = E.curbuf;
+  w->cx = E.cx;
+  w->cy = E.cy;
+  w->rx = E.rx;
+  w->rowoff = E.rowoff;
+  w->coloff = E.coloff;
+}
 
-  return cx;
+void editorLoadWindow(int n) {
+  struct editorWindow *w = &E.wins[n];
+  E.curwin = n;
+  E.curbuf = w->buf;
+  E.buf = E.bufs[w->buf].buf;
+  E.bufs[w->buf].used = ++E.tick;
+  E.bufs[w->buf].dropped = 0;
+
+  // another window may have deleted the rows this one was looking at
+  if (w->cy > E.buf->numrows)
+    w->cy = E.buf->numrows;
+  if (w->cy < E.buf->numrows && w->cx > E.buf->row[w->cy].size)
+    w->cx = E.buf->row[w->cy].size;
+  else if (w->cy == E.buf->numrows)
+    w->cx = 0;
+
+  E.cx = w->cx;
+  E.cy = w->cy;
+  E.rx = w->rx;
+  E.rowoff = w->rowoff;
+  E.coloff = w->coloff;
+  E.screenrows = w->rows;
+  E.screencols = w->cols;
 }
 
-void editorUpdateRow(erow *row) {
-  int tabs = 0;
-  int j;
+// the outer rectangle of a window includes its status line and, unless it
+// touches the right edge of the terminal, the separator column after it
+void editorWindowRect(struct editorWindow *w, int *x0, int *y0, int *x1,
+                      int *y1) {
+  *x0 = w->left;
+  *y0 = w->top;
+  *x1 = w->left + w->cols + (w->left + w->cols < E.termcols);
+  *y1 = w->top + w->rows + 1;
+}
 
-  for (j = 0; j < row->size; ++j)
-    if (row->chars[j] == '\t')
-      tabs++;
-  free(row->render);
+void editorWindowSetRect(struct editorWindow *w, int x0, int y0, int x1,
+                         int y1) {
+  w->left = x0;
+  w->top = y0;
+  w->cols = x1 - x0 - (x1 < E.termcols);
+  w->rows = y1 - y0 - 1;
+}
 
-  row->render = malloc(row->size + tabs * (TI_TAB_STOP - 1) + 1);
+void editorSplitWindow(int vertical) {
+  struct editorWindow *w = &E.wins[E.curwin];
+  if (vertical ? w->cols < 3 : w->rows < 3) {
+    editorSetStatusMessage("Not enough room");
+    return;
+  }
 
-  int idx = 0;
-  for (j = 0; j < row->size; ++j) {
-    if (row->chars[j] == '\t') {
-      row->render[idx++] = ' ';
-      while (idx % TI_TAB_STOP != 0)
-        row->render[idx++] = ' ';
-    } else {
-      row->render[idx++] = row->chars[j];
-    }
+  editorSaveWindow();
+  E.wins = realloc(E.wins, sizeof(struct editorWindow) * (E.nwins + 1));
+  w = &E.wins[E.curwin];
+  struct editorWindow *nw = &E.wins[E.nwins];
+  *nw = *w;
+
+  int x0, y0, x1, y1;
+  editorWindowRect(w, &x0, &y0, &x1, &y1);
+  if (vertical) {
+    int mid = x0 + (x1 - x0) / 2;
+    editorWindowSetRect(w, x0, y0, mid, y1);
+    editorWindowSetRect(nw, mid, y0, x1, y1);
+  } else {
+    int mid = y0 + (y1 - y0) / 2;
+    editorWindowSetRect(w, x0, y0, x1, mid);
+    editorWindowSetRect(nw, x0, mid, x1, y1);
   }
 
-  row->render[idx] = '\0';
-  row->rsize = idx;
-  editorUpdateSyntax(row);
+  editorLoadWindow(E.nwins++);
 }
 
-void editorInsertRow(int at, char *s, size_t len) {
-  if (at < 0 || at > E.numrows)
+// hands the space of the current window to the windows lining up exactly
+// along one of its sides, which always exist since every layout is built
+// by halving windows
+void editorCloseWindow() {
+  if (E.nwins == 1) {
+    editorSetStatusMessage("Cannot close last window");
     return;
+  }
 
-  E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));
-  memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numrows - at));
-  for (int j = at + 1; j <= E.numrows; ++j)
-    E.row[j].idx++;
-
-  E.row[at].idx = at;
+  int x0, y0, x1, y1;
+  editorWindowRect(&E.wins[E.curwin], &x0, &y0, &x1, &y1);
+  for (int side = 0; side < 4; ++side) {
+    int covered = 0;
+    for (int i = 0; i < E.nwins; ++i) {
+      int a0, b0, a1, b1;
+      editorWindowRect(&E.wins[i], &a0, &b0, &a1, &b1);
+      if (i == E.curwin)
+        continue;
+      if ((side == 0 && b1 == y0 && a0 >= x0 && a1 <= x1) ||
+          (side == 1 && b0 == y1 && a0 >= x0 && a1 <= x1))
+        covered += a1 - a0;
+      else if ((side == 2 && a1 == x0 && b0 >= y0 && b1 <= y1) ||
+               (side == 3 && a0 == x1 && b0 >= y0 && b1 <= y1))
+        covered += b1 - b0;
+    }
+    if (covered != (side < 2 ? x1 - x0 : y1 - y0))
+      continue;
 
-  E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));
-  E.row[at].size = len;
-  E.row[at].chars = malloc(len + 1);
-  memcpy(E.row[at].chars, s, len);
-  E.row[at].chars[len] = '\0';
-  E.row[at].rsize = 0;
-  E.row[at].render = NULL;
-  E.row[at].hl = NULL;
-  E.row[at].hl_open_comment = 0;
-  editorUpdateRow(&E.row[at]);
+    for (int i = 0; i < E.nwins; ++i) {
+      int a0, b0, a1, b1;
+      editorWindowRect(&E.wins[i], &a0, &b0, &a1, &b1);
+      if (i == E.curwin)
+        continue;
+      if (side == 0 && b1 == y0 && a0 >= x0 && a1 <= x1)
+        editorWindowSetRect(&E.wins[i], a0, b0, a1, y1);
+      else if (side == 1 && b0 == y1 && a0 >= x0 && a1 <= x1)
+        editorWindowSetRect(&E.wins[i], a0, y0, a1, b1);
+      else if (side == 2 && a1 == x0 && b0 >= y0 && b1 <= y1)
+        editorWindowSetRect(&E.wins[i], a0, b0, x1, b1);
+      else if (side == 3 && a0 == x1 && b0 >= y0 && b1 <= y1)
+        editorWindowSetRect(&E.wins[i], x0, b0, a1, b1);
+    }
+    break;
+  }
 
-  E.numrows++;
-  E.dirty++;
+  int closed = E.curwin;
+  memmove(&E.wins[closed], &E.wins[closed + 1],
+          sizeof(struct editorWindow) * (E.nwins - closed - 1));
+  E.nwins--;
+  editorLoadWindow(closed < E.nwins ? closed : E.nwins - 1);
 }
 
-void editorFreeRow(erow *row) {
-  free(row->render);
-  free(row->chars);
-  free(row->hl);
+void editorOnlyWindow() {
+  editorSaveWindow();
+  E.wins[0] = E.wins[E.curwin];
+  E.nwins = 1;
+  editorWindowSetRect(&E.wins[0], 0, 0, E.termcols, E.termrows - 1);
+  editorLoadWindow(0);
 }
 
-void editorDelRow(int at) {
-  if (at < 0 || at >= E.numrows)
-    return;
-  editorFreeRow(&E.row[at]);
-  memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.numrows - at - 1));
-  for (int j = at; j < E.numrows - 1; ++j)
-    E.row[j].idx--;
-  E.numrows--;
-  E.dirty++;
-  E.cx = 0;
+void editorNextWindow() {
+  editorSaveWindow();
+  editorLoadWindow((E.curwin + 1) % E.nwins);
 }
 
-void editorRowInsertChar(erow *row, int at, int c) {
-  if (at < 0 || at > row->size)
-    at = row->size;
+/*~~~~~~~~~~~~~~~~~~~~ follow ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
-  row->chars = realloc(row->chars, row->size + 2);
-  memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-  row->size++;
-  row->chars[at] = c;
-  editorUpdateRow(row);
-  E.dirty++;
+void editorStopFollow(struct editorBuffer *eb) {
+  if (eb->wd != -1)
+    inotify_rm_watch(E.inotify, eb->wd);
+  if (eb->fd != -1)
+    close(eb->fd);
+  eb->follow = 0;
+  eb->fd = -1;
+  eb->wd = -1;
 }
 
-void editorRowAppendString(erow *row, char *s, size_t len) {
-  row->chars = realloc(row->chars, row->size + len + 1);
-  memcpy(&row->chars[row->size], s, len);
-  row->size += len;
-  row->chars[row->size] = '\0';
-  editorUpdateRow(row);
-  E.dirty++;
+// without inotify, or while the file doesn't exist, every idle tick checks
+// it with stat instead
+int editorWatchFile(struct editorBuffer *eb) {
+  if (E.inotify == -1)
+    E.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (E.inotify != -1 && eb->wd == -1)
+    eb->wd = inotify_add_watch(E.inotify, eb->path,
+                               IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                                   IN_DELETE_SELF);
+  return eb->wd;
 }
 
-void editorRowDelChar(erow *row, int at) {
-  if (at < 0 || at >= row->size)
-    return;
-
-  memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
-  row->size--;
-  editorUpdateRow(row);
-  E.dirty++;
+int editorWatch(struct editorBuffer *eb) {
+  eb->fd = open(eb->path, O_RDONLY);
+  if (eb->fd == -1)
+    return -1;
+  editorWatchFile(eb);
+  eb->tail = 0;
+  eb->changed = 1;
+  return 0;
 }
 
-/*~~~~~~~~~~~~~~~~~~~~ editor operations ~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+// appends the complete lines written since the last read as new rows, only
+// those rows are rendered and highlighted. Returns the rows added
+int editorFollowRead(struct editorBuffer *eb) {
+  tiBuffer *b = eb->buf;
+  int before = b->numrows;
+  int dirty = b->dirty;
+  struct stat st;
 
-void editorInsertChar(int c) {
-  if (E.cy == E.numrows)
-    editorInsertRow(E.numrows, "", 0);
+  // waiting for a rotated file to show up again
+  if (eb->fd == -1 && editorWatch(eb) == -1)
+    return 0;
 
-  editorRowInsertChar(&E.row[E.cy], E.cx, c);
-  E.cx++;
-}
+  if (fstat(eb->fd, &st) == 0 && st.st_size < eb->tail) {
+    editorSetStatusMessage("%s: file truncated", b->filename);
+    eb->tail = 0;
+  }
 
-void editorInsertNewline() {
-  if (E.cx == 0) {
-    editorInsertRow(E.cy, "", 0);
-  } else {
-    erow *row = &E.row[E.cy];
-    editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-    row = &E.row[E.cy];
-    row->size = E.cx;
-    row->chars[row->size] = '\0';
-    editorUpdateRow(row);
+  char *buf = memAlloc(MEM_IO, TI_FOLLOW_CHUNK);
+  while (buf && eb->fd != -1) {
+    ssize_t n = pread(eb->fd, buf, TI_FOLLOW_CHUNK, eb->tail);
+    if (n <= 0)
+      break;
+    // a partial last line waits for the rest of it, unless it fills the
+    // whole chunk on its own
+    char *nl = memrchr(buf, '\n', n);
+    size_t len = nl ? (size_t)(nl - buf) + 1 : (size_t)n;
+    if (nl == NULL && n < TI_FOLLOW_CHUNK)
+      break;
+    tiAppendLines(b, buf, len);
+    eb->tail += len;
+  }
+  memFree(buf);
+  b->dirty = dirty;
+
+  // rotated: the old file has been read to its end, carry on with the new
+  // one as soon as it exists
+  struct stat now;
+  if (eb->wd == -1 && stat(eb->path, &now) == 0 && fstat(eb->fd, &st) == 0 &&
+      now.st_ino != st.st_ino) {
+    editorStopFollow(eb);
+    eb->follow = 1;
+    if (editorWatch(eb) == 0)
+      editorSetStatusMessage("%s: file rotated", b->filename);
+    return b->numrows - before + editorFollowRead(eb);
   }
 
-  E.cy++;
-  E.cx = 0;
+  int added = b->numrows - before;
+  if (added == 0)
+    return 0;
+
+  // windows sitting on the last row stay pinned to the end
+  for (int i = 0; i < E.nwins; ++i) {
+    struct editorWindow *w = &E.wins[i];
+    int cur = i == E.curwin;
+    if (E.bufs + (cur ? E.curbuf : w->buf) != eb)
+      continue;
+    int *cy = cur ? &E.cy : &w->cy;
+    if (*cy >= before - 1) {
+      *cy = b->numrows - 1;
+      if (cur)
+        E.cx = 0;
+      else
+        w->cx = 0;
+      if (!cur && w->rowoff < *cy - w->rows + 1)
+        w->rowoff = *cy - w->rows + 1;
+    }
+  }
+  return added;
 }
 
-void editorDelChar() {
-  if (E.cy == E.numrows)
+void editorFollow() {
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  if (eb->follow) {
+    editorStopFollow(eb);
+    editorDiskSync(eb);
+    editorWatchFile(eb);
+    editorJournalOpen(eb);
+    editorSetStatusMessage("follow off");
     return;
-  if (E.cx == 0 && E.cy == 0)
+  }
+  if (eb->path == NULL) {
+    editorSetStatusMessage("No file to follow");
+    return;
+  }
+  if (E.buf->dirty) {
+    editorSetStatusMessage("Unsaved changes, save before following");
     return;
+  }
 
-  erow *row = &E.row[E.cy];
-  if (E.cx > 0) {
-    editorRowDelChar(row, E.cx - 1);
-    E.cx--;
-  } else {
-    editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
-    editorDelRow(E.cy);
-    E.cy--;
-    E.cx = E.row[E.cy].size - row->size;
+  // reread from the start so the rows and the tail offset agree; what is
+  // appended is the file's, there is nothing to journal
+  editorAutosaveFinish(eb, 1);
+  editorJournalClose(eb);
+  tiBufferClear(E.buf);
+  E.cx = E.cy = E.rowoff = E.coloff = 0;
+  if (editorWatch(eb) == -1) {
+    editorSetStatusMessage("Can't follow %s: %s", eb->path, strerror(errno));
+    return;
   }
+  eb->follow = 1;
+  E.cy = -1;
+  editorFollowRead(eb);
+  if (E.cy < 0)
+    E.cy = 0;
+  editorSetStatusMessage("following %s", E.buf->filename);
 }
 
-/*~~~~~~~~~~~~~~~~~~~~ file I/O ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+// drains inotify, reads the followed buffers that grew and checks the others
+// against their file. Returns 1 if the screen is out of date
+int editorWatchPoll() {
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+  while (E.inotify != -1 && (n = read(E.inotify, events, sizeof(events))) > 0) {
+    for (char *p = events; p < events + n;) {
+      struct inotify_event *ev = (struct inotify_event *)p;
+      for (int i = 0; i < E.nbufs; ++i) {
+        if (E.bufs[i].wd != ev->wd)
+          continue;
+        E.bufs[i].changed = 1;
+        // moved or deleted: poll until a new file takes its name
+        if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+          inotify_rm_watch(E.inotify, ev->wd);
+          E.bufs[i].wd = -1;
+        }
+      }
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
 
-char *editorRowsToString(int *buflen) {
-  int total_len = 0;
-  int j;
-  for (j = 0; j < E.numrows; ++j)
-    total_len += E.row[j].size + 1;
+  int added = 0;
+  for (int i = 0; i < E.nbufs; ++i) {
+    struct editorBuffer *eb = &E.bufs[i];
+    if (eb->path == NULL || (!eb->changed && eb->wd != -1))
+      continue;
+    eb->changed = 0;
+    if (eb->follow)
+      added += editorFollowRead(eb);
+    else
+      added += editorCheckDisk(eb);
+  }
+  return added > 0;
+}
 
-  *buflen = total_len;
-  char *buf = malloc(total_len);
-  char *p = buf;
-  for (j = 0; j < E.numrows; ++j) {
-    memcpy(p, E.row[j].chars, E.row[j].size);
-    p += E.row[j].size;
-    *p = '\n';
-    p++;
+/*~~~~~~~~~~~~~~~~~~~~ external changes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void editorDiskSync(struct editorBuffer *eb) {
+  if (stat(eb->path, &eb->disk) == -1)
+    memset(&eb->disk, 0, sizeof(eb->disk));
+  eb->stale = 0;
+  eb->saved = statsNow();
+}
+
+// returns 1 if the file differs from what was last read or written
+int editorCheckDisk(struct editorBuffer *eb) {
+  // a background save is about to replace the file itself
+  if (eb->autosave)
+    return 0;
+  // replaced by renaming a new file over it: watch the new one
+  if (eb->wd == -1)
+    editorWatchFile(eb);
+
+  struct stat st;
+  if (stat(eb->path, &st) == -1)
+    memset(&st, 0, sizeof(st));
+  if (st.st_ino == eb->disk.st_ino && st.st_dev == eb->disk.st_dev &&
+      st.st_size == eb->disk.st_size &&
+      st.st_mtim.tv_sec == eb->disk.st_mtim.tv_sec &&
+      st.st_mtim.tv_nsec == eb->disk.st_mtim.tv_nsec)
+    return 0;
+
+  eb->disk = st;
+  const char *name = eb->buf->filename;
+  if (st.st_ino == 0) {
+    editorSetStatusMessage("%s deleted on disk", name);
+    return 1;
   }
+  eb->stale = 1;
+  editorSetStatusMessage("%s changed on disk, ':reload' to load it", name);
+  return 1;
+}
 
-  return buf;
+// views below the replaced rows move with them, views inside end up on the
+// last row that took their place
+void editorShiftView(int *cy, int *rowoff, int first, int removed, int added) {
+  if (*cy >= first + removed)
+    *cy += added - removed;
+  else if (*cy >= first + added)
+    *cy = added ? first + added - 1 : first;
+  if (*rowoff >= first + removed)
+    *rowoff += added - removed;
+  else if (*rowoff > *cy)
+    *rowoff = *cy;
 }
 
-void editorOpen(char *filename) {
+// shifts the views of b other than the current window past removed rows
+// at first replaced by added others
+void editorShiftViews(tiBuffer *b, int first, int removed, int added) {
+  for (int k = 0; k < E.nbufs; ++k) {
+    if (E.bufs[k].buf != b)
+      continue;
+    if (k != E.curbuf)
+      editorShiftView(&E.bufs[k].cy, &E.bufs[k].rowoff, first, removed,
+                      added);
+    for (int i = 0; i < E.nwins; ++i)
+      if (i != E.curwin && E.wins[i].buf == k)
+        editorShiftView(&E.wins[i].cy, &E.wins[i].rowoff, first, removed,
+                        added);
+  }
+}
 
-  if (E.filename != filename) {
-    free(E.filename);
-    E.filename = strdup(basename(filename));
+void editorReload(int force) {
+  struct editorBuffer *eb = &E.bufs[E.curbuf];
+  if (eb->path == NULL) {
+    editorSetStatusMessage("No file to reload");
+    return;
+  }
+  if (eb->follow) {
+    editorSetStatusMessage("Following %s already", E.buf->filename);
+    return;
+  }
+  if (E.buf->dirty && !force) {
+    editorSetStatusMessage("Unsaved changes, ':reload!' discards them");
+    return;
+  }
+
+  editorAutosaveFinish(eb, 1);
+  int first, removed, added;
+  if (tiReload(E.buf, eb->path, &first, &removed, &added) == -1) {
+    editorSetStatusMessage("Can't reload %s: %s", E.buf->filename,
+                           strerror(errno));
+    return;
+  }
+  editorDiskSync(eb);
+
+  for (int i = 0; i < E.nwins; ++i) {
+    struct editorWindow *w = &E.wins[i];
+    if (i == E.curwin)
+      editorShiftView(&E.cy, &E.rowoff, first, removed, added);
+    else if (w->buf == E.curbuf)
+      editorShiftView(&w->cy, &w->rowoff, first, removed, added);
   }
+  if (E.cy > E.buf->numrows)
+    E.cy = E.buf->numrows;
+  if (E.cy < E.buf->numrows && E.cx > E.buf->row[E.cy].size)
+    E.cx = E.buf->row[E.cy].size;
+
+  if (removed == 0 && added == 0)
+    editorSetStatusMessage("\"%s\" unchanged", E.buf->filename);
+  else
+    editorSetStatusMessage("\"%s\" reloaded, %d lines replaced by %d at %d",
+                           E.buf->filename, removed, added, first + 1);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ stream ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
-  editorSelectSyntaxHighlighting();
+void editorStreamOpen(int fd) {
+  if (fd == -1) {
+    editorSetStatusMessage("stdin is a terminal, nothing to read");
+    return;
+  }
+  S.buf = memAlloc(MEM_IO, TI_STREAM_CHUNK);
+  if (S.buf == NULL) {
+    editorSetStatusMessage("Can't read stdin: %s", strerror(errno));
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  S.fd = fd;
+  S.b = E.buf;
+  S.len = 0;
+  S.received = 0;
+}
 
-  FILE *fp = fopen(filename, "r");
-  if (!fp)
+void editorStreamClose() {
+  if (S.fd == -1)
     return;
+  close(S.fd);
+  memFree(S.buf);
+  S.fd = -1;
+  S.b = NULL;
+  S.buf = NULL;
+}
 
-  char *line = NULL;
-  size_t linecap = 0;
-  ssize_t linelen;
-  while ((linelen = getline(&line, &linecap, fp)) != -1) {
-    line[(linelen = strcspn(line, "\r\n"))] = 0;
+// appends the complete lines at the start of buf to b and moves the rest
+// to the front, returns how many bytes are left. A line longer than the
+// whole chunk is cut rather than waited for
+static size_t editorAppendChunk(tiBuffer *b, char *buf, size_t len) {
+  char *nl = memrchr(buf, '\n', len);
+  size_t take = nl ? (size_t)(nl - buf) + 1 : len;
+  if (nl == NULL && len < TI_STREAM_CHUNK)
+    return len;
+  tiAppendLines(b, buf, take);
+  memmove(buf, buf + take, len - take);
+  return len - take;
+}
 
-    editorInsertRow(E.numrows, line, linelen);
+// appends the complete lines that arrived since the last tick, reading for
+// at most TI_STREAM_SLICE. Returns 1 if anything arrived
+int editorStreamRead() {
+  if (S.fd == -1)
+    return 0;
+
+  tiBuffer *b = S.b;
+  int dirty = b->dirty;
+  int64_t before = S.received;
+  uint64_t start = statsNow();
+  while (statsNow() - start < TI_STREAM_SLICE) {
+    ssize_t n = read(S.fd, S.buf + S.len, TI_STREAM_CHUNK - S.len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == 0) {
+      tiAppendLines(b, S.buf, S.len);
+      editorSetStatusMessage("stdin: %lld bytes, %d lines",
+                             (long long)S.received, b->numrows);
+      editorStreamClose();
+      b->dirty = dirty;
+      return 1;
+    }
+    if (n == -1)
+      break;
+
+    S.received += n;
+    S.len = editorAppendChunk(b, S.buf, S.len + n);
   }
+  b->dirty = dirty;
+  return S.received != before;
+}
 
-  free(line);
-  fclose(fp);
-  E.dirty = 0;
+/*~~~~~~~~~~~~~~~~~~~~ filter ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// the lines a command starting with a range (%, A or A,B) applies to, the
+// cursor's line if it has none. Returns the rest
+char *editorParseRange(char *s, int *first, int *last) {
+  return tiParseRange(s, E.buf->numrows, E.cy, first, last);
 }
 
-void editorSave() {
+static void editorFilterClose() {
+  if (F.in != -1)
+    close(F.in);
+  if (F.out != -1)
+    close(F.out);
+  tiBufferFree(F.result);
+  memFree(F.buf);
+  free(F.cmd);
+  memset(&F, 0, sizeof(F));
+  F.in = F.out = -1;
+}
 
-  if (E.newfile) {
-    E.newfile = 0;
-    char *tmpfilename = NULL;
-    tmpfilename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
-    if (tmpfilename == NULL || E.filename == tmpfilename) {
-      editorSetStatusMessage("Save aborted");
-      free(tmpfilename);
-      return;
+// stops a filter still running, its lines are left as they were
+void editorFilterCancel(const char *why) {
+  if (F.b == NULL)
+    return;
+  kill(F.pid, SIGKILL);
+  waitpid(F.pid, NULL, 0);
+  editorSetStatusMessage("!%s cancelled, %s", F.cmd, why);
+  editorFilterClose();
+}
+
+// writes as much of the range as the pipe takes without blocking, straight
+// from the bytes of the rows
+static void editorFilterWrite() {
+  struct iovec iov[TI_FILTER_ROWS * 2];
+  int n = 0;
+  int end = F.first + F.count;
+  // the bytes of cold rows are in the block cache, which only holds the
+  // last TI_COLD_LRU blocks read
+  const struct tiColdBlock *cold = NULL;
+  int blocks = 0;
+  for (int j = F.next; j < end && n + 2 <= TI_FILTER_ROWS * 2; ++j) {
+    erow *row = &F.b->row[j];
+    if (row->cold && row->cold != cold) {
+      if (++blocks == TI_COLD_LRU)
+        break;
+      cold = row->cold;
     }
-    
-    if (E.filename) {
-      editorSave(E.filename);
+    const char *chars = tiRowChars(row);
+    if (chars == NULL)
+      break;
+    size_t skip = j == F.next ? F.off : 0;
+    if (skip < (size_t)row->size)
+      iov[n++] = (struct iovec){(char *)chars + skip, row->size - skip};
+    iov[n++] = (struct iovec){"\n", 1};
+  }
+
+  ssize_t written = n ? writev(F.in, iov, n) : 0;
+  if (written == -1 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if (written == -1) {
+    // the command stopped reading (EPIPE), what it wrote still counts
+    close(F.in);
+    F.in = -1;
+    return;
+  }
+  F.sent += written;
+  while (written > 0) {
+    size_t left = F.b->row[F.next].size + 1 - F.off;
+    if ((size_t)written < left) {
+      F.off += written;
+      break;
     }
-    editorOpen(tmpfilename);
+    written -= left;
+    F.next++;
+    F.off = 0;
+  }
+  if (F.next == end) {
+    close(F.in);
+    F.in = -1;
+  }
+}
+
+// the command's lines replace the range if it exited with 0
+static void editorFilterFinish(int status) {
+  if (F.len)
+    tiAppendLines(F.result, F.buf, F.len);
+  if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+    editorSetStatusMessage("!%s failed (%s %d), lines left as they were",
+                           F.cmd, WIFEXITED(status) ? "exit" : "signal",
+                           WIFEXITED(status) ? WEXITSTATUS(status)
+                                             : WTERMSIG(status));
+    editorFilterClose();
     return;
-  } else if (E.filename == NULL) {
-    E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
-    if (E.filename == NULL) {
-      editorSetStatusMessage("Save aborted");
-      return;
+  }
+
+  tiBuffer *b = F.b;
+  int first = F.first, removed = F.count, added = F.result->numrows;
+  tiReplaceRows(b, first, removed, F.result);
+  editorShiftViews(b, first, removed, added);
+  if (E.buf == b) {
+    editorCursorsClear();
+    E.cy = first < b->numrows ? first : b->numrows;
+    E.cx = 0;
+    if (E.rowoff > E.cy)
+      E.rowoff = E.cy;
+  }
+  editorSetStatusMessage("%d lines through !%s, %d now", removed, F.cmd,
+                         added);
+  editorFilterClose();
+}
+
+// finishes the filter once its command, whose output is all in, has
+// exited. It usually does as it closes its output, so that is waited for
+// up to wait ns; one that goes on running is checked again next tick.
+// Returns 1 if it finished
+static int editorFilterReap(uint64_t wait) {
+  uint64_t start = statsNow();
+  for (;;) {
+    int status;
+    pid_t pid = waitpid(F.pid, &status, WNOHANG);
+    if (pid == -1 && errno == EINTR)
+      continue;
+    if (pid != 0) {
+      editorFilterFinish(pid == F.pid ? status : 0);
+      return 1;
     }
+    if (statsNow() - start >= wait)
+      return 0;
+    usleep(1000);
+  }
+}
 
-    editorSelectSyntaxHighlighting();
+// moves a running filter along for at most TI_STREAM_SLICE, reading its
+// output as it writes it so neither side waits on a full pipe. Returns 1
+// if anything happened
+int editorFilterPump() {
+  if (F.b == NULL)
+    return 0;
+  if (F.b->edits != F.edits) {
+    editorFilterCancel("the lines changed");
+    return 1;
   }
 
-  int len;
-  char *buf = editorRowsToString(&len);
-  int fd = open(E.filename, O_RDWR | O_CREAT, 0644);
-  if (fd != -1) {
-    if (ftruncate(fd, len) != -1) {
-      if (write(fd, buf, len) == len) {
-        close(fd);
-        free(buf);
-        editorSetStatusMessage("%d bytes written to disk", len);
-        E.dirty = 0;
-        return;
-      }
+  if (F.out == -1)
+    return editorFilterReap(0);
+
+  int64_t before = F.sent + F.received;
+  uint64_t start = statsNow();
+  uint64_t spent;
+  while ((spent = statsNow() - start) < TI_STREAM_SLICE) {
+    struct pollfd fds[2] = {{F.out, POLLIN, 0}, {F.in, POLLOUT, 0}};
+    int ready = poll(fds, 2, (TI_STREAM_SLICE - spent) / 1000000);
+    if (ready == -1 && errno == EINTR)
+      continue;
+    if (ready <= 0)
+      break;
+    if (fds[1].revents)
+      editorFilterWrite();
+    if (!fds[0].revents)
+      continue;
+    ssize_t n = read(F.out, F.buf + F.len, TI_STREAM_CHUNK - F.len);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (n <= 0) {
+      // input it no longer answers is not sent, its EOF lets it exit
+      close(F.out);
+      F.out = -1;
+      if (F.in != -1)
+        close(F.in);
+      F.in = -1;
+      editorSetStatusMessage("!%s: waiting for it to exit", F.cmd);
+      editorFilterReap(TI_FILTER_REAP);
+      return 1;
     }
+    F.received += n;
+    F.len = editorAppendChunk(F.result, F.buf, F.len + n);
+  }
 
-    close(fd);
+  if (F.sent + F.received == before)
+    return 0;
+  char sent[16], received[16];
+  memFormat(sent, sizeof(sent), F.sent);
+  memFormat(received, sizeof(received), F.received);
+  editorSetStatusMessage("!%s: %s sent, %s back", F.cmd, sent, received);
+  return 1;
+}
+
+// runs lines first to last through a shell command, which replaces them
+// with what it prints. It runs in the background, see editorFilterPump
+void editorFilterStart(int first, int last, const char *cmd) {
+  while (*cmd == ' ')
+    cmd++;
+  if (*cmd == '\0') {
+    editorSetStatusMessage("[range]!command runs lines through command");
+    return;
+  }
+  if (F.b) {
+    editorSetStatusMessage("!%s is still running", F.cmd);
+    return;
   }
 
-  free(buf);
-  editorSetStatusMessage("Failed write to disk! I/O error: %s",
-                         strerror(errno));
+  int in[2], out[2];
+  if (pipe2(in, O_CLOEXEC) == -1) {
+    editorSetStatusMessage("Can't run %s: %s", cmd, strerror(errno));
+    return;
+  }
+  if (pipe2(out, O_CLOEXEC) == -1) {
+    editorSetStatusMessage("Can't run %s: %s", cmd, strerror(errno));
+    close(in[0]);
+    close(in[1]);
+    return;
+  }
+  // a command that exits before reading everything must not kill us
+  signal(SIGPIPE, SIG_IGN);
+  pid_t pid = fork();
+  if (pid == 0) {
+    signal(SIGPIPE, SIG_DFL);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(in[0], STDIN_FILENO);
+    dup2(out[1], STDOUT_FILENO);
+    if (null != -1)
+      dup2(null, STDERR_FILENO);
+    execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+    _exit(127);
+  }
+  close(in[0]);
+  close(out[1]);
+  if (pid == -1) {
+    editorSetStatusMessage("Can't run %s: %s", cmd, strerror(errno));
+    close(in[1]);
+    close(out[0]);
+    return;
+  }
+
+  fcntl(in[1], F_SETFL, fcntl(in[1], F_GETFL) | O_NONBLOCK);
+  fcntl(out[0], F_SETFL, fcntl(out[0], F_GETFL) | O_NONBLOCK);
+  F.pid = pid;
+  F.in = in[1];
+  F.out = out[0];
+  F.b = E.buf;
+  F.edits = E.buf->edits;
+  F.first = first;
+  F.count = last - first + 1;
+  F.next = first;
+  F.off = 0;
+  F.sent = F.received = 0;
+  F.len = 0;
+  F.cmd = strdup(cmd);
+  F.buf = memAlloc(MEM_IO, TI_STREAM_CHUNK);
+  // the output is collected unrendered, its rows are rendered and
+  // highlighted once they are in place
+  F.result = tiBufferNew();
+  if (F.cmd == NULL || F.buf == NULL || F.result == NULL) {
+    editorFilterCancel(strerror(ENOMEM));
+    return;
+  }
+  tiBufferBatchBegin(F.result);
+  if (F.count == 0) {
+    close(F.in);
+    F.in = -1;
+  }
+  editorFilterPump();
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ sort ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// :sort [n][u] and :uniq on lines first to last. Only the rows move, the
+// text stays where it is
+void editorSortCommand(int first, int last, int flags) {
+  int n = last - first + 1;
+  uint64_t start = statsNow();
+  int dropped = tiSortRows(E.buf, first, last, flags, 0);
+  if (dropped == -1) {
+    editorSetStatusMessage("Can't sort: %s", strerror(ENOMEM));
+    return;
+  }
+  uint64_t took = statsNow() - start;
+
+  editorShiftViews(E.buf, first + n - dropped, dropped, 0);
+  editorCursorsClear();
+  if (E.cy > last)
+    E.cy -= dropped;
+  else if (E.cy >= first + n - dropped)
+    E.cy = first + n - dropped - 1;
+  if (E.cy < 0)
+    E.cy = 0;
+  if (E.cy < E.buf->numrows && E.cx > E.buf->row[E.cy].size)
+    E.cx = E.buf->row[E.cy].size;
+  if (E.rowoff > E.cy)
+    E.rowoff = E.cy;
+
+  char time[16];
+  statsFormat(time, sizeof(time), took);
+  editorSetStatusMessage("%s %d lines, %d repeats dropped in %s",
+                         flags & TI_SORT_KEEP_ORDER ? "Checked" : "Sorted", n,
+                         dropped, time);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ journal ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// dir/.name.tij next to the file it belongs to
+char *editorJournalPath(const char *path) {
+  const char *name = strrchr(path, '/');
+  int dirlen = name ? name - path + 1 : 0;
+  name = name ? name + 1 : path;
+  char *jpath = malloc(dirlen + strlen(name) + 6);
+  if (jpath)
+    sprintf(jpath, "%.*s.%s.tij", dirlen, path, name);
+  return jpath;
+}
+
+// starts journaling the buffer, replaying what a crashed session left
+void editorJournalOpen(struct editorBuffer *eb) {
+  if (!E.journal || eb->path == NULL || eb->follow || eb->buf->journal ||
+      eb->busy)
+    return;
+  char *jpath = editorJournalPath(eb->path);
+  if (jpath == NULL)
+    return;
+
+  int replayed;
+  tiBuffer *b = eb->buf;
+  tiJournal *j = tiJournalOpen(b, jpath, &eb->disk, &replayed);
+  if (j == NULL && errno == ESTALE) {
+    // the file changed since those edits were made, keep them aside
+    char *old = malloc(strlen(jpath) + 2);
+    if (old) {
+      sprintf(old, "%s~", jpath);
+      rename(jpath, old);
+      editorSetStatusMessage("%s: journal of another version kept as %s",
+                             b->filename, old);
+      free(old);
+    }
+    j = tiJournalOpen(b, jpath, &eb->disk, &replayed);
+  }
+  if (j == NULL) {
+    int err = errno;
+    eb->busy = 1;
+    E.notice++;
+    // what it holds are the live edits of the other editor, not ours
+    if (err == EBUSY)
+      editorSetStatusMessage("%s is being edited elsewhere, edits here are "
+                             "not journaled", b->filename);
+    else
+      editorSetStatusMessage("Can't journal %s: %s, edits are not "
+                             "journaled until ':w'", b->filename,
+                             strerror(err));
+  }
+  if (replayed) {
+    E.notice++;
+    editorSetStatusMessage("%s: recovered %d edits from %s, ':w' keeps them",
+                           b->filename, replayed, jpath);
+  }
+  free(jpath);
+}
+
+// the buffer's edits are saved or discarded, its journal goes with them
+void editorJournalClose(struct editorBuffer *eb) {
+  tiJournalClose(eb->buf->journal, 0);
+  eb->buf->journal = NULL;
+}
+
+// a journal that lost a record has removed itself, the buffer goes on
+// without one until it is saved
+void editorJournalSync() {
+  for (int i = 0; i < E.nbufs; ++i) {
+    struct editorBuffer *eb = &E.bufs[i];
+    if (eb->buf->journal && tiJournalSync(eb->buf->journal, 0) == -1) {
+      editorSetStatusMessage("Journal of %s failed: %s, edits are not "
+                             "journaled until ':w'",
+                             eb->buf->filename, strerror(errno));
+      editorJournalClose(eb);
+      eb->busy = 1;
+    }
+  }
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ autosave ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// writes the buffer in the background from a snapshot of its rows, the
+// journal keeps recording what is typed meanwhile
+void editorAutosaveStart(struct editorBuffer *eb) {
+  tiBuffer *b = eb->buf;
+  eb->mark = b->journal ? tiJournalMark(b->journal) : -1;
+  eb->autosave = tiSnapshotSave(b, eb->path);
+  eb->saved = statsNow();
+  if (eb->autosave == NULL)
+    editorSetStatusMessage("Can't autosave %s: %s", b->filename,
+                           strerror(errno));
+}
+
+// reports a background save that finished (or waits for it), returns 1 if
+// there was one
+int editorAutosaveFinish(struct editorBuffer *eb, int wait) {
+  ssize_t written;
+  int err;
+  if (eb->autosave == NULL || !tiSnapshotDone(eb->autosave, wait, &written, &err))
+    return 0;
+
+  tiBuffer *b = eb->buf;
+  double secs = (statsNow() - eb->saved) / 1e9;
+  if (written != -1) {
+    // edits made while it was written keep the buffer dirty
+    if (b->dirty == tiSnapshotDirty(eb->autosave))
+      b->dirty = 0;
+    editorDiskSync(eb);
+    if (b->journal)
+      tiJournalRebase(b->journal, eb->mark, &eb->disk);
+    editorSetStatusMessage("%s autosaved, %zd bytes in %.1fs", b->filename,
+                           written, secs);
+  } else {
+    editorSetStatusMessage("Autosave of %s failed: %s", b->filename,
+                           strerror(err));
+  }
+  tiSnapshotRelease(b, eb->autosave);
+  eb->autosave = NULL;
+  eb->saved = statsNow();
+  return 1;
+}
+
+// reports finished saves and starts new ones for buffers left dirty for
+// the autosave interval. Returns 1 if the screen is out of date
+int editorAutosavePoll() {
+  int changed = 0;
+  uint64_t now = statsNow();
+  for (int i = 0; i < E.nbufs; ++i) {
+    struct editorBuffer *eb = &E.bufs[i];
+    changed |= editorAutosaveFinish(eb, 0);
+    if (E.autosave == 0 || eb->autosave || eb->path == NULL || eb->follow ||
+        !eb->buf->dirty || now - eb->saved < E.autosave * 1000000000ULL)
+      continue;
+    // never over what someone else wrote
+    changed |= editorCheckDisk(eb);
+    if (!eb->stale)
+      editorAutosaveStart(eb);
+  }
+  return changed;
 }
 
 /*~~~~~~~~~~~~~~~~~~~~ find / search ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
@@ -923,13 +1900,7 @@ void editorSave() {
 void editorSearchCallback(char *query, int key) {
   static int last_match = -1;
   static int direction = 1;
-  static int saved_hl_line;
-  static char *saved_hl = NULL;
-  if (saved_hl) {
-    memcpy(E.row[saved_hl_line].hl, saved_hl, E.row[saved_hl_line].rsize);
-    free(saved_hl);
-    saved_hl = NULL;
-  }
+  E.matchbuf = NULL;
 
   if (key == '\r' || key == ESC) {
     last_match = -1;
@@ -947,29 +1918,18 @@ void editorSearchCallback(char *query, int key) {
   if (last_match == -1)
     direction = 1;
 
-  int current = last_match;
-  int i;
-  for (i = 0; i < E.numrows; ++i) {
-    current += direction;
-
-    if (current == -1)
-      current = E.numrows - 1;
-    else if (current == E.numrows)
-      current = 0;
-
-    erow *row = &E.row[current];
-    char *match = strstr(row->render, query);
-    if (match) {
-      last_match = current;
-      E.cy = current;
-      E.cx = editorRowRxToCx(row, match - row->render);
-      E.rowoff = E.numrows;
-      saved_hl_line = current;
-      saved_hl = malloc(row->rsize);
-      memcpy(saved_hl, row->hl, row->rsize);
-      memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
-      break;
-    }
+  int rx;
+  int current = tiFind(E.buf, query, last_match, direction, &rx);
+  if (current != -1) {
+    erow *row = &E.buf->row[current];
+    last_match = current;
+    E.cy = current;
+    E.cx = tiRowRxToCx(row, rx);
+    E.rowoff = E.buf->numrows;
+    E.matchbuf = E.buf;
+    E.matchrow = current;
+    E.matchrx = rx;
+    E.matchlen = strlen(query);
   }
 }
 
@@ -982,7 +1942,8 @@ void editorSearch() {
       editorPrompt("Search: %s (ESC/Arrows/Enter)", editorSearchCallback);
 
   if (query) {
-    free(query);
+    free(E.query);
+    E.query = query;
   } else {
     E.cx = saved_cx;
     E.cy = saved_cy;
@@ -991,6 +1952,360 @@ void editorSearch() {
   }
 }
 
+/*~~~~~~~~~~~~~~~~~~~~ cursors ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int editorCursorCmp(const void *a, const void *b) {
+  const struct editorCursor *x = a, *y = b;
+  if (x->cy != y->cy)
+    return x->cy < y->cy ? -1 : 1;
+  return (x->cx > y->cx) - (x->cx < y->cx);
+}
+
+void editorCursorsClear() { E.ncursors = 0; }
+
+static struct editorCursor *editorCursorsGrow(int n) {
+  if (n > E.cursorcap) {
+    int cap = E.cursorcap ? E.cursorcap : 64;
+    while (cap < n)
+      cap *= 2;
+    struct editorCursor *grown =
+        realloc(E.cursors, sizeof(struct editorCursor) * cap);
+    if (grown == NULL)
+      return NULL;
+    E.cursors = grown;
+    E.cursorcap = cap;
+  }
+  return E.cursors;
+}
+
+// sorts the cursors into document order and merges those that met, or
+// that sit on the main one
+static void editorCursorsSort() {
+  qsort(E.cursors, E.ncursors, sizeof(struct editorCursor), editorCursorCmp);
+  int n = 0;
+  for (int i = 0; i < E.ncursors; ++i) {
+    struct editorCursor *k = &E.cursors[i];
+    if ((k->cy == E.cy && k->cx == E.cx) ||
+        (n && !editorCursorCmp(&E.cursors[n - 1], k)))
+      continue;
+    E.cursors[n++] = *k;
+  }
+  E.ncursors = n;
+}
+
+// adds cursors at column cx of lines first to last, or on those at hand
+int editorCursorsAddRange(int first, int last, int cx) {
+  if (first < 0)
+    first = 0;
+  if (last >= E.buf->numrows)
+    last = E.buf->numrows - 1;
+  if (last < first || !editorCursorsGrow(E.ncursors + last - first + 1))
+    return 0;
+  for (int y = first; y <= last; ++y) {
+    int size = E.buf->row[y].size;
+    E.cursors[E.ncursors++] = (struct editorCursor){cx < size ? cx : size, y, 0};
+  }
+  editorCursorsSort();
+  return last - first + 1;
+}
+
+// adds a cursor at the next match of the last search after the last cursor
+void editorCursorsAddMatch() {
+  if (E.query == NULL || E.buf->numrows == 0) {
+    editorSetStatusMessage("Search with '/' first, ^N adds a cursor on the "
+                           "next match");
+    return;
+  }
+  int cy = E.cy, cx = E.cx;
+  if (E.ncursors && editorCursorCmp(&E.cursors[E.ncursors - 1],
+                                    &(struct editorCursor){cx, cy, 0}) > 0) {
+    cy = E.cursors[E.ncursors - 1].cy;
+    cx = E.cursors[E.ncursors - 1].cx;
+  }
+
+  int rx = -1;
+  if (cy < E.buf->numrows) {
+    erow *row = tiRowEnsure(E.buf, &E.buf->row[cy]);
+    int from = tiRowCxToRx(row, cx) + 1;
+    char *match = from <= row->rsize ? strstr(&row->render[from], E.query)
+                                     : NULL;
+    if (match)
+      rx = match - row->render;
+  }
+  if (rx == -1)
+    cy = tiFind(E.buf, E.query, cy, 1, &rx);
+  if (cy == -1 || !editorCursorsGrow(E.ncursors + 1)) {
+    editorSetStatusMessage("No match for %s", E.query);
+    return;
+  }
+
+  int n = E.ncursors;
+  E.cursors[E.ncursors++] =
+      (struct editorCursor){tiRowRxToCx(&E.buf->row[cy], rx), cy, 0};
+  editorCursorsSort();
+  if (E.ncursors == n)
+    editorSetStatusMessage("Every match of %s has a cursor", E.query);
+  else
+    editorSetStatusMessage("%d cursors", E.ncursors + 1);
+}
+
+// keys that act at every cursor rather than once
+int editorCursorsKey(int c) {
+  switch (c) {
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+  case ARROW_UP:
+  case ARROW_DOWN:
+  case HOME_KEY:
+  case END_KEY:
+    return 1;
+  }
+  if (E.modal)
+    return c == 'h' || c == 'j' || c == 'k' || c == 'l' || c == 'w' ||
+           c == 'W' || c == 'x' || (c == 'd' && E.delete);
+  return c == '\r' || c == '\t' || c == BACKSPACE || c == CTRL_KEY('h') ||
+         c == DEL_KEY || (!iscntrl(c) && c < 128);
+}
+
+// called by the editing functions when a cursor changes the text at (r, c)
+// and everything after it on row r moves to newr, dcol columns over, while
+// the rows below move by drows. Only the cursors after the current one can
+// be after the edit; those below r are shifted lazily, through cursorshift
+void editorCursorsEdit(int r, int c, int newr, int dcol, int drows) {
+  if (E.curcursor < 0)
+    return;
+  int shift = E.cursorshift;
+  E.cursorshift += drows;
+  for (int k = E.curcursor + 1;
+       k <= E.ncursors && E.cursors[k].cy + shift <= r; ++k) {
+    struct editorCursor *o = &E.cursors[k];
+    int row = o->cy + shift;
+    if (row == r && o->cx >= c) {
+      row = newr;
+      o->cx += dcol;
+    }
+    o->cy = row - E.cursorshift;
+  }
+}
+
+// takes the main cursor of the n being walked back into E.cx/E.cy
+static void editorCursorsMain(int n) {
+  int m = 0;
+  while (!E.cursors[m].main)
+    m++;
+  E.cx = E.cursors[m].cx;
+  E.cy = E.cursors[m].cy;
+  memmove(&E.cursors[m], &E.cursors[m + 1],
+          sizeof(struct editorCursor) * (n - m - 1));
+  E.ncursors = n - 1;
+  editorCursorsSort();
+}
+
+// splitting, joining and deleting lines at every cursor each move all the
+// rows below, so they are done in one pass instead of once per cursor.
+// Returns 0 if c isn't one of those at every cursor
+static int editorCursorsBulk(int c, int n) {
+  struct editorCursor *k = E.cursors;
+  int split = !E.modal && c == '\r';
+  int join = !E.modal && (c == BACKSPACE || c == CTRL_KEY('h'));
+  int del = E.modal && c == 'd' && E.delete;
+  for (int i = 0; i < n && (split || join || del); ++i) {
+    if (k[i].cy >= E.buf->numrows || (join && k[i].cx))
+      split = join = del = 0;
+  }
+  if (!split && !join && !del)
+    return 0;
+
+  int *rows = malloc(sizeof(int) * n * 2);
+  if (rows == NULL)
+    return 0;
+  int *cols = rows + n;
+  int m = 0;
+  for (int i = 0; i < n; ++i) {
+    // backspace does nothing at the very start
+    if (join && k[i].cy == 0)
+      continue;
+    int size = E.buf->row[k[i].cy].size;
+    if (del && m && rows[m - 1] == k[i].cy) {
+      k[i].cy -= m - 1;
+      k[i].cx = 0;
+      continue;
+    }
+    rows[m] = k[i].cy;
+    cols[m] = k[i].cx < size ? k[i].cx : size;
+    if (split) {
+      k[i].cy += m + 1;
+      k[i].cx = 0;
+    } else if (join) {
+      int prev = E.buf->row[k[i].cy - 1].size;
+      k[i].cx = (m && rows[m - 1] == k[i].cy - 1) ? k[i - 1].cx + prev : prev;
+      k[i].cy -= m + 1;
+    } else {
+      k[i].cy -= m;
+      k[i].cx = 0;
+    }
+    m++;
+  }
+
+  if (split)
+    tiSplitRows(E.buf, rows, cols, m);
+  else if (join)
+    tiJoinRows(E.buf, rows, m);
+  else
+    tiDelRows(E.buf, rows, m);
+  free(rows);
+  E.delete = 0;
+  for (int i = 0; i < n; ++i)
+    if (k[i].cy >= E.buf->numrows)
+      k[i].cy = E.buf->numrows;
+  return 1;
+}
+
+// runs key c at each cursor in document order, as one batch of row updates
+void editorCursorsApply(int c) {
+  if (!editorCursorsGrow(E.ncursors + 1)) {
+    editorHandleKey(c);
+    return;
+  }
+  E.cursors[E.ncursors] = (struct editorCursor){E.cx, E.cy, 1};
+  int n = E.ncursors + 1;
+  qsort(E.cursors, n, sizeof(struct editorCursor), editorCursorCmp);
+  if (editorCursorsBulk(c, n)) {
+    editorCursorsMain(n);
+    return;
+  }
+
+  int delete = E.delete;
+  tiBufferBatchBegin(E.buf);
+  E.cursorshift = 0;
+  for (E.curcursor = 0; E.curcursor < n; ++E.curcursor) {
+    struct editorCursor *k = &E.cursors[E.curcursor];
+    E.cy = k->cy + E.cursorshift;
+    if (E.cy > E.buf->numrows)
+      E.cy = E.buf->numrows;
+    int size = E.cy < E.buf->numrows ? E.buf->row[E.cy].size : 0;
+    E.cx = k->cx < size ? k->cx : size;
+    E.delete = delete;
+    editorHandleKey(c);
+    k->cx = E.cx;
+    k->cy = E.cy;
+  }
+  E.curcursor = -1;
+  tiBufferBatchEnd(E.buf);
+  editorCursorsMain(n);
+}
+
+// column in render of cursor k if it is on row y, -1 if not
+static int editorCursorRx(erow *row, int k, int y) {
+  if (k >= E.ncursors || E.cursors[k].cy != y)
+    return -1;
+  return tiRowCxToRx(row, E.cursors[k].cx);
+}
+
+// first cursor at or after row y
+static int editorCursorsFrom(int y) {
+  int lo = 0, hi = E.ncursors;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (E.cursors[mid].cy < y)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ macros ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void editorMacroRecord(int c) {
+  struct editorMacro *m = &E.macros[E.recording];
+  if (m->len == m->cap) {
+    int cap = m->cap ? m->cap * 2 : 64;
+    int *grown = realloc(m->keys, sizeof(int) * cap);
+    if (grown == NULL)
+      return;
+    m->keys = grown;
+    m->cap = cap;
+  }
+  m->keys[m->len++] = c;
+}
+
+// the register named by the next key typed, -1 if it isn't one
+static int editorMacroRegister() {
+  int c;
+  while ((c = editorReadKey()) == IDLE_KEY)
+    ;
+  if (c == '@' && E.lastmacro != -1)
+    return E.lastmacro;
+  return c >= 'a' && c <= 'z' ? c - 'a' : -1;
+}
+
+// q{a-z} starts recording the keys typed into a register, q again stops
+void editorMacroToggle() {
+  if (E.replay)
+    return;
+  if (E.recording != -1) {
+    struct editorMacro *m = &E.macros[E.recording];
+    // drop the q that stopped it
+    if (m->len)
+      m->len--;
+    editorSetStatusMessage("@%c: %d keys", 'a' + E.recording, m->len);
+    E.recording = -1;
+    return;
+  }
+
+  int reg = editorMacroRegister();
+  if (reg == -1) {
+    editorSetStatusMessage("q{a-z} records into a register");
+    return;
+  }
+  E.macros[reg].len = 0;
+  E.recording = reg;
+}
+
+// replays a register count times through the key handling as if typed,
+// without drawing until the end. Rows it changes are marked as it goes
+// and rendered and highlighted once when it is done, see
+// tiBufferBatchBegin
+void editorMacroPlay(int count) {
+  int reg = editorMacroRegister();
+  // an @ inside a macro would replay forever
+  if (E.replay)
+    return;
+  if (reg == -1) {
+    editorSetStatusMessage("@{a-z} replays a register, @@ the last one");
+    return;
+  }
+  const struct editorMacro *m = &E.macros[reg];
+  if (m->len == 0) {
+    editorSetStatusMessage("@%c is empty, q%c records it", 'a' + reg,
+                           'a' + reg);
+    return;
+  }
+
+  E.lastmacro = reg;
+  E.replay = m;
+  E.replaybuf = E.buf;
+  tiBufferBatchBegin(E.buf);
+  for (int n = 0; n < count; ++n) {
+    E.replaypos = 0;
+    while (E.replaypos < m->len) {
+      editorDispatchKey(editorReadKey());
+      // a buffer switched to is batched from there on
+      if (E.replaybuf != E.buf) {
+        if (E.replaybuf)
+          tiBufferBatchEnd(E.replaybuf);
+        E.replaybuf = E.buf;
+        tiBufferBatchBegin(E.buf);
+      }
+    }
+  }
+  if (E.replaybuf)
+    tiBufferBatchEnd(E.replaybuf);
+  E.replay = NULL;
+  E.replaybuf = NULL;
+}
+
 /*~~~~~~~~~~~~~~~~~~~~ append buffer ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
 struct append_buf {
@@ -1002,7 +2317,7 @@ struct append_buf {
   { NULL, 0 }
 
 void abAppend(struct append_buf *ab, const char *s, int len) {
-  char *new_append = realloc(ab->b, ab->len + len);
+  char *new_append = memRealloc(MEM_FRAME, ab->b, ab->len + len);
   if (new_append == NULL)
     return;
 
@@ -1011,15 +2326,15 @@ void abAppend(struct append_buf *ab, const char *s, int len) {
   ab->len += len;
 }
 
-void abFree(struct append_buf *ab) { free(ab->b); }
+void abFree(struct append_buf *ab) { memFree(ab->b); }
 
 /*~~~~~~~~~~~~~~~~~~~~ output ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
 void editorScroll() {
   E.rx = 0;
 
-  if (E.cy < E.numrows)
-    E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+  if (E.cy < E.buf->numrows)
+    E.rx = tiRowCxToRx(&E.buf->row[E.cy], E.cx);
 
   if (E.cy < E.rowoff)
     E.rowoff = E.cy;
@@ -1034,22 +2349,31 @@ void editorScroll() {
     E.coloff = E.rx - E.screencols + 1;
 }
 
-void editorDrawRows(struct append_buf *ab) {
+void editorDrawRows(struct append_buf *ab, struct editorWindow *w) {
+  tiBuffer *b = E.bufs[w->buf].buf;
+  int edge = w->left + w->cols == E.termcols;
   int y;
-  for (y = 0; y < E.screenrows; ++y) {
-    int filerow = y + E.rowoff;
-    if (filerow >= E.numrows) {
+  for (y = 0; y < w->rows; ++y) {
+    char pos[32];
+    int poslen =
+        snprintf(pos, sizeof(pos), "\x1b[%d;%dH", w->top + y + 1, w->left + 1);
+    abAppend(ab, pos, poslen);
+
+    int drawn = 1;
+    int filerow = y + w->rowoff;
+    if (filerow >= b->numrows) {
       char buf[16];
       int colorlen = snprintf(buf, sizeof(buf), "\x1b[%dm", E.theme);
-      if (E.numrows == 0 && y == E.screenrows / 4) {
+      if (b->numrows == 0 && y == w->rows / 4) {
         char welcome[80];
         int welcomelen =
             snprintf(welcome, sizeof(welcome), "Ti -- version %s", TI_VERSION);
 
-        if (welcomelen > E.screencols)
-          welcomelen = E.screencols;
+        if (welcomelen > w->cols)
+          welcomelen = w->cols;
 
-        int padding = (E.screencols - welcomelen) / 2;
+        int padding = (w->cols - welcomelen) / 2;
+        drawn = padding + welcomelen;
         if (padding) {
           abAppend(ab, buf, colorlen);
           abAppend(ab, "~", 1);
@@ -1063,18 +2387,38 @@ void editorDrawRows(struct append_buf *ab) {
         abAppend(ab, "~", 1);
       }
     } else {
-      int len = E.row[filerow].rsize - E.coloff;
+      erow *row = tiRowEnsure(b, &b->row[filerow]);
+      int len = row->rsize - w->coloff;
       if (len < 0)
         len = 0;
 
-      if (len > E.screencols)
-        len = E.screencols;
-
-      char *c = &E.row[filerow].render[E.coloff];
-      unsigned char *hl = &E.row[filerow].hl[E.coloff];
+      if (len > w->cols)
+        len = w->cols;
+      drawn = len;
+
+      char *c = &row->render[w->coloff];
+      const unsigned char *hl = &row->hl[w->coloff];
+      int match = E.matchbuf == b && E.matchrow == filerow;
+      // the cursors besides the terminal's own are drawn in reverse video
+      int k = b == E.buf ? editorCursorsFrom(filerow) : E.ncursors;
+      int crx = editorCursorRx(row, k, filerow);
+      while (crx != -1 && crx < w->coloff)
+        crx = editorCursorRx(row, ++k, filerow);
       int current_color = -1;
       int j;
       for (j = 0; j < len; ++j) {
+        if (j + w->coloff == crx) {
+          char ch = iscntrl(c[j]) ? '?' : c[j];
+          abAppend(ab, "\x1b[7m", 4);
+          abAppend(ab, &ch, 1);
+          abAppend(ab, "\x1b[27m", 5);
+          crx = editorCursorRx(row, ++k, filerow);
+          continue;
+        }
+        int h = hl[j];
+        if (match && j + w->coloff >= E.matchrx &&
+            j + w->coloff < E.matchrx + E.matchlen)
+          h = HL_MATCH;
         if (iscntrl(c[j])) {
           char sym = (c[j] <= 26) ? '@' + c[j] : '?';
           abAppend(ab, "\x1b[7m", 4);
@@ -1085,14 +2429,14 @@ void editorDrawRows(struct append_buf *ab) {
             int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
             abAppend(ab, buf, clen);
           }
-        } else if (hl[j] == HL_NORMAL) {
+        } else if (h == HL_NORMAL) {
           if (current_color != -1) {
             abAppend(ab, "\x1b[39m", 5);
             current_color = -1;
           }
           abAppend(ab, &c[j], 1);
         } else {
-          int color = editorSyntaxToColor(hl[j]);
+          int color = tiSyntaxToColor(h);
           if (color != current_color) {
             current_color = color;
             char buf[16];
@@ -1103,40 +2447,68 @@ void editorDrawRows(struct append_buf *ab) {
           abAppend(ab, &c[j], 1);
         }
       }
+      if (crx == row->rsize && drawn < w->cols) {
+        abAppend(ab, "\x1b[7m \x1b[27m", 9);
+        drawn++;
+      }
 
       abAppend(ab, "\x1b[39m", 5);
     }
 
-    abAppend(ab, "\x1b[K", 3);
-    abAppend(ab, "\r\n", 2);
+    if (edge) {
+      abAppend(ab, "\x1b[K", 3);
+    } else {
+      while (drawn++ < w->cols)
+        abAppend(ab, " ", 1);
+      abAppend(ab, "|", 1);
+    }
   }
 }
 
-void editorDrawStatusBar(struct append_buf *ab) {
+void editorDrawStatusBar(struct append_buf *ab, struct editorWindow *w) {
+  tiBuffer *b = E.bufs[w->buf].buf;
+  int width = w->cols + (w->left + w->cols < E.termcols);
+  char pos[32];
+  int poslen = snprintf(pos, sizeof(pos), "\x1b[%d;%dH", w->top + w->rows + 1,
+                        w->left + 1);
+  abAppend(ab, pos, poslen);
+
   char buf[16];
   int colorlen = snprintf(buf, sizeof(buf), "\x1b[%dm", E.theme);
   abAppend(ab, buf, colorlen);
   abAppend(ab, "\x1b[7m", 4);
   char status[80], rstatus[80];
-  int len = snprintf(status, sizeof(status), "%.20s - %d Lines %s",
-                     E.filename ? E.filename : "[SCRATCH]", E.numrows,
-                     E.dirty ? "(+)" : "");
-  float perc = ((float)E.cy + 1) / ((float)E.numrows) * 100;
+  char stream[32] = "";
+  if (S.fd != -1 && S.b == b) {
+    char received[16];
+    memFormat(received, sizeof(received), S.received);
+    snprintf(stream, sizeof(stream), "[stdin %s]", received);
+  }
+  char recording[16] = "";
+  if (E.recording != -1 && w == &E.wins[E.curwin])
+    snprintf(recording, sizeof(recording), "[recording @%c]",
+             'a' + E.recording);
+  int len = snprintf(status, sizeof(status), "%.20s - %d Lines %s%s%s%s",
+                     b->filename ? b->filename : "[SCRATCH]", b->numrows,
+                     b->dirty ? "(+)" : "",
+                     E.bufs[w->buf].follow ? "[follow]" : "", stream,
+                     recording);
+  float perc = ((float)w->cy + 1) / ((float)b->numrows) * 100;
   int rlen =
       snprintf(rstatus, sizeof(rstatus), "%s | L %d:%d %.0f%%",
-               E.syntax ? E.syntax->filetype : "filetype syntax unavailable",
-               E.cy + 1 >= E.numrows ? E.numrows : E.cy + 1, E.cx + 1,
+               b->syntax ? b->syntax->filetype : "filetype syntax unavailable",
+               w->cy + 1 >= b->numrows ? b->numrows : w->cy + 1, w->cx + 1,
                perc > 0 || perc <= 100 ? perc : 0);
-  if (E.cy + 1 > E.numrows) {
+  if (w->cy + 1 > b->numrows) {
     rlen = snprintf(rstatus, sizeof(rstatus), "L %s", "EOF");
   }
 
-  if (len > E.screencols)
-    len = E.screencols;
+  if (len > width)
+    len = width;
 
   abAppend(ab, status, len);
-  while (len < E.screencols) {
-    if (E.screencols - len == rlen) {
+  while (len < width) {
+    if (width - len == rlen) {
       abAppend(ab, rstatus, rlen);
       break;
     } else {
@@ -1146,33 +2518,47 @@ void editorDrawStatusBar(struct append_buf *ab) {
   }
 
   abAppend(ab, "\x1b[m", 3);
-  abAppend(ab, "\r\n", 2);
 }
 
 void editorDrawMessageBar(struct append_buf *ab) {
-  abAppend(ab, "\x1b[K", 3);
+  char pos[32];
+  int poslen = snprintf(pos, sizeof(pos), "\x1b[%d;1H\x1b[K", E.termrows);
+  abAppend(ab, pos, poslen);
   int msglen = strlen(E.statusmsg);
-  if (msglen > E.screencols)
-    msglen = E.screencols;
+  if (msglen > E.termcols)
+    msglen = E.termcols;
 
   if (msglen && time(NULL) - E.statusmsg_time < 5)
     abAppend(ab, E.statusmsg, msglen);
 }
 
 void editorRefreshScreen() {
+  if (P.p) {
+    editorPagerRefresh();
+    return;
+  }
   editorScroll();
   struct append_buf ab = APPEND_BUF_INIT;
+  editorSaveWindow();
   abAppend(&ab, "\x1b[?25l", 6);
-  abAppend(&ab, "\x1b[H", 3);
-  editorDrawRows(&ab);
-  editorDrawStatusBar(&ab);
+  // every window goes into the same frame and reaches the terminal in one
+  // write; windows on one buffer reuse its cached render and hl rows
+  uint64_t start = STATS_BEGIN();
+  for (int i = 0; i < E.nwins; ++i) {
+    editorDrawRows(&ab, &E.wins[i]);
+    editorDrawStatusBar(&ab, &E.wins[i]);
+  }
+  STATS_END(STAGE_DRAW, start);
   editorDrawMessageBar(&ab);
+  struct editorWindow *w = &E.wins[E.curwin];
   char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1,
-           (E.rx - E.coloff) + 1);
+  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", w->top + (E.cy - E.rowoff) + 1,
+           w->left + (E.rx - E.coloff) + 1);
   abAppend(&ab, buf, strlen(buf));
   abAppend(&ab, "\x1b[?25h", 6);
-  write(STDOUT_FILENO, ab.b, ab.len);
+  start = STATS_BEGIN();
+  termWrite(ab.b, ab.len);
+  STATS_END(STAGE_WRITE, start);
   abFree(&ab);
 }
 
@@ -1188,17 +2574,19 @@ void editorSetStatusMessage(const char *fmt, ...) {
 
 char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
   size_t bufsize = 128;
-  char *buf = malloc(bufsize);
+  char *buf = memAlloc(MEM_PROMPT, bufsize);
   if(!buf) {
-    free(buf);
     return 0;
   }
   size_t buflen = 0;
   buf[0] = '\0';
   while (1) {
     editorSetStatusMessage(prompt, buf);
-    editorRefreshScreen();
+    if (!E.replay)
+      editorRefreshScreen();
     int c = editorReadKey();
+    if (c == IDLE_KEY)
+      continue;
     if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
       if (buflen != 0)
         buf[--buflen] = '\0';
@@ -1206,21 +2594,24 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
       editorSetStatusMessage("");
       if (callback)
         callback(buf, c);
-      free(buf);
+      memFree(buf);
       return NULL;
     } else if (c == '\r') {
+      char *line = NULL;
       if (buflen != 0) {
         editorSetStatusMessage("");
         if (callback)
           callback(buf, c);
-        return buf;
+        // callers own the result and release it with free()
+        line = strdup(buf);
       }
 
-      return NULL;
+      memFree(buf);
+      return line;
     } else if (!iscntrl(c) && c < 128) {
       if (buflen == bufsize - 1) {
         bufsize *= 2;
-        buf = realloc(buf, bufsize);
+        buf = memRealloc(MEM_PROMPT, buf, bufsize);
       }
 
       buf[buflen++] = c;
@@ -1233,14 +2624,15 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
 }
 
 void editorMoveCursor(int key) {
-  erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+  erow *row =
+      (E.cy >= E.buf->numrows) ? NULL : tiRowEnsure(E.buf, &E.buf->row[E.cy]);
   switch (key) {
   case ARROW_LEFT:
     if (E.cx != 0) {
       E.cx--;
     } else if (E.cy > 0) {
       E.cy--;
-      E.cx = E.row[E.cy].size;
+      E.cx = E.buf->row[E.cy].size;
     }
     break;
   case ARROW_RIGHT:
@@ -1304,7 +2696,7 @@ void editorMoveCursor(int key) {
       }
     } else if (E.cy > 0) {
       E.cy--;
-      E.cx = E.row[E.cy].size;
+      E.cx = E.buf->row[E.cy].size;
     }
     break;
   case ARROW_UP:
@@ -1313,7 +2705,7 @@ void editorMoveCursor(int key) {
     }
     break;
   case ARROW_DOWN:
-    if (E.cy < E.numrows) {
+    if (E.cy < E.buf->numrows) {
       E.cy++;
     }
     break;
@@ -1327,7 +2719,7 @@ void editorMoveCursor(int key) {
     break;
   }
 
-  row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+  row = (E.cy >= E.buf->numrows) ? NULL : &E.buf->row[E.cy];
   int rowlen = row ? row->size : 0;
   if (E.cx > rowlen) {
     E.cx = rowlen;
@@ -1335,15 +2727,25 @@ void editorMoveCursor(int key) {
 }
 
 void editorExit() {
-  write(STDOUT_FILENO, "\x1b[2J", 4);
-  write(STDOUT_FILENO, "\x1b[H", 3);
+  editorFilterCancel("quitting");
+  for (int i = 0; i < E.nbufs; ++i) {
+    editorAutosaveFinish(&E.bufs[i], 1);
+    editorSessionSave(i);
+    editorJournalClose(&E.bufs[i]);
+  }
+  termWrite("\x1b[2J", 4);
+  termWrite("\x1b[H", 3);
   exit(0);
   return;
 }
 
-void editorProcessKeypress() {
-  static int quit_times = TI_QUIT_TIMES;
-  int c = editorReadKey();
+static int quit_times = TI_QUIT_TIMES;
+
+void editorHandleKey(int c) {
+  if (c == IDLE_KEY)
+    return;
+  int count = E.count;
+  E.count = 0;
   if (E.delete &&!(c == 'x' || c == 'd' || c == 'w' || c == 'W')) {
     editorSetStatusMessage("deletetion cancelled");
     E.delete = 0;
@@ -1357,7 +2759,7 @@ void editorProcessKeypress() {
     editorInsertNewline();
     break;
   case CTRL_KEY('q'):
-    if (E.dirty) {
+    if (editorDirtyBuffers()) {
       editorSetStatusMessage("!UNSAVED CHANGES! Press <ENTER> to confirm");
       if (quit_times)
         quit_times--;
@@ -1366,7 +2768,10 @@ void editorProcessKeypress() {
     editorExit();
     break;
   case CTRL_KEY('s'):
-    editorSave();
+    editorSave(0);
+    break;
+  case CTRL_KEY('w'):
+    editorNextWindow();
     break;
   case HOME_KEY:
     editorMoveCursor(c);
@@ -1393,11 +2798,17 @@ void editorProcessKeypress() {
   case ARROW_RIGHT:
     editorMoveCursor(c);
     break;
+  case CTRL_KEY('n'):
+    editorCursorsAddMatch();
+    break;
   case CTRL_KEY('l'):
   case ESC:
     if (!E.modal) {
       E.modal = 1;
       editorSetStatusMessage("NORMAL MODE");
+    } else if (E.ncursors) {
+      editorCursorsClear();
+      editorSetStatusMessage("1 cursor");
     }
     break;
   default:
@@ -1408,6 +2819,25 @@ void editorProcessKeypress() {
         E.modal = 0;
         editorSetStatusMessage("INSERT MODE");
         break;
+      case '0':
+      case '1':
+      case '2':
+      case '3':
+      case '4':
+      case '5':
+      case '6':
+      case '7':
+      case '8':
+      case '9':
+        if (c != '0' || count)
+          E.count = count < TI_MAX_COUNT / 10 ? count * 10 + c - '0' : count;
+        break;
+      case 'q':
+        editorMacroToggle();
+        break;
+      case '@':
+        editorMacroPlay(count ? count : 1);
+        break;
       case '/':
         editorSearch();
         break;
@@ -1461,8 +2891,10 @@ void editorProcessKeypress() {
           free(command);
           break;
         }
+        int first, last;
+        char *rest = editorParseRange(command, &first, &last);
         if (!strcmp(command, "q") || !strcmp(command, "quit")) {
-          if (E.dirty) {
+          if (editorDirtyBuffers()) {
             free(command);
             editorSetStatusMessage("!UNSAVED CHANGES! Press <ENTER> to "
                                    "confirm, ANY other key to cancel");
@@ -1476,19 +2908,42 @@ void editorProcessKeypress() {
         } else if (!strcmp(command, "!q") || !strcmp(command, "!quit")) {
           free(command);
           editorExit();
-        } else if (!strcmp(command, "w") || !strcmp(command, "write")) {
-          editorSave();
+        } else if (*rest == '!') {
+          editorFilterStart(first, last, rest + 1);
+        } else if ((!strncmp(rest, "sort", 4) &&
+                    strspn(rest + 4, " nu") == strlen(rest + 4)) ||
+                   !strcmp(rest, "uniq")) {
+          // the whole buffer without a range
+          if (rest == command) {
+            first = 0;
+            last = E.buf->numrows - 1;
+          }
+          int flags = rest[0] == 'u' ? TI_SORT_UNIQUE | TI_SORT_KEEP_ORDER
+                                     : 0;
+          if (rest[0] == 's') {
+            flags |= strchr(rest + 4, 'n') ? TI_SORT_NUMERIC : 0;
+            flags |= strchr(rest + 4, 'u') ? TI_SORT_UNIQUE : 0;
+          }
+          editorSortCommand(first, last, flags);
+        } else if (!strcmp(command, "w") || !strcmp(command, "write") ||
+                   !strcmp(command, "w!") || !strcmp(command, "write!")) {
+          editorSave(command[strlen(command) - 1] == '!');
         } else if (!strcmp(command, "w new") || !strcmp(command, "write new")) {
           E.newfile = 1;
-          editorSave();
+          editorSave(0);
         } else if (!strcmp(command, "help") || !strcmp(command, "h")) {
           editorSetStatusMessage("'w'/'write', '!q'/'!quit', 'wq'/'done', "
-                                 "'themes', 'set theme +color'");
+                                 "'themes', 'set theme +color', 'langs', "
+                                 "'set lang +language', 'e file', "
+                                 "'ls', 'bn', 'bp', 'bd', 'sp', 'vs', 'close', "
+                                 "'reload', '[range]!cmd', '[range]sort [n][u]', "
+                                 "'uniq'");
         } else if (!strcmp(command, "wq") || !strcmp(command, "done")) {
-          editorSave();
-          free(command);
-          editorExit();
-          break;
+          if (editorSave(0) == 0) {
+            free(command);
+            editorExit();
+            break;
+          }
         } else if (strstr(command, "set theme")) { 
           char *colors[7] = {"red", "green", "yellow", "blue", "magenta", "cyan", "default"};
           for (int i = 0; i < 7; ++i) {
@@ -1499,16 +2954,90 @@ void editorProcessKeypress() {
         } else if (!strcmp(command, "themes")) {
           editorSetStatusMessage("set theme <color>: blue, red, green, yellow, "
                                  "magenta, cyan, default");
-        } else if (strstr(command, "set lang")) { 
-          char *langs[6] = {"c", "c++", "rust", "js", "go", "html"};
-          for (int i = 0; i < 6; ++i) {
-                if(strstr(command, langs[i])) {
-                  memset(E.setlang, '\0', 10);
-                  strcpy(E.setlang, langs[i]);
-                  editorSelectSyntaxHighlighting();
-                }
+        } else if (!strcmp(command, "langs")) {
+          char langs[256];
+          tiSyntaxList(langs, sizeof(langs));
+          editorSetStatusMessage("set lang <language>: %s", langs);
+        } else if (!strncmp(command, "set lang", 8)) {
+          char *lang = command + 8;
+          while (*lang == ' ')
+            lang++;
+          if (*lang == '\0' || strlen(lang) >= sizeof(E.buf->setlang)) {
+            editorSetStatusMessage("set lang <language>, see :langs");
+          } else if (tiSyntaxFind(lang) == NULL) {
+            editorSetStatusMessage("Unknown language: %s", lang);
+          } else {
+            strcpy(E.buf->setlang, lang);
+            tiSelectSyntax(E.buf);
+            editorSetStatusMessage("Language: %s", E.buf->syntax->filetype);
+          }
+        } else if (!strncmp(command, "set autosave", 12)) {
+          E.autosave = atoi(command + 12);
+          if (E.autosave < 0)
+            E.autosave = 0;
+          editorSetStatusMessage(E.autosave ? "autosave every %ds"
+                                            : "autosave off", E.autosave);
+        } else if (!strncmp(command, "set budget", 10)) {
+          int mb = atoi(command + 10);
+          if (mb > 0) {
+            E.budget = (size_t)mb << 20;
+            editorEnforceBudget();
           }
-        
+          editorSetStatusMessage("budget %zuMB", E.budget >> 20);
+        } else if (!strncmp(command, "e ", 2) && command[2]) {
+          editorEditFile(command + 2);
+        } else if (!strcmp(command, "bn") || !strcmp(command, "bnext")) {
+          editorNextBuffer(1);
+        } else if (!strcmp(command, "bp") || !strcmp(command, "bprev")) {
+          editorNextBuffer(-1);
+        } else if (!strncmp(command, "b ", 2)) {
+          editorSwitchBuffer(atoi(command + 2) - 1);
+        } else if (!strcmp(command, "bd") || !strcmp(command, "bd!")) {
+          editorCloseBuffer(command[2] == '!');
+        } else if (!strcmp(command, "follow")) {
+          editorFollow();
+        } else if (!strcmp(command, "reload") || !strcmp(command, "reload!")) {
+          editorReload(command[6] == '!');
+        } else if (!strcmp(command, "ls")) {
+          editorListBuffers();
+        } else if (!strncmp(command, "sp", 2) || !strncmp(command, "vs", 2)) {
+          char *arg = strchr(command, ' ');
+          editorSplitWindow(command[0] == 'v');
+          if (arg && arg[1])
+            editorEditFile(arg + 1);
+        } else if (!strcmp(command, "close") || !strcmp(command, "clo")) {
+          editorCloseWindow();
+        } else if (!strcmp(command, "only") || !strcmp(command, "on")) {
+          editorOnlyWindow();
+        } else if (!strncmp(command, "stats", 5)) {
+          editorStatsCommand(command + 5);
+        } else if (!strcmp(command, "intern")) {
+          editorInternCommand();
+        } else if (!strncmp(command, "set intern", 10)) {
+          E.intern = !strstr(command + 10, "off");
+          for (int i = 0; i < E.nbufs; ++i)
+            tiBufferIntern(E.bufs[i].buf, E.intern);
+          editorInternCommand();
+        } else if (!strncmp(command, "cursors", 7)) {
+          int first, last;
+          if (sscanf(command + 7, "%d,%d", &first, &last) == 2)
+            editorCursorsAddRange(first - 1, last - 1, E.cx);
+          else if (strstr(command + 7, "off"))
+            editorCursorsClear();
+          editorSetStatusMessage("%d cursors", E.ncursors + 1);
+        } else if (!strcmp(command, "compress")) {
+          editorCompressCommand();
+        } else if (!strncmp(command, "set compress", 12)) {
+          E.compress = !strstr(command + 12, "off");
+          editorFreeze(1);
+          editorCompressCommand();
+        } else if (!strncmp(command, "set session", 11)) {
+          E.session = !strstr(command + 11, "off");
+          editorSetStatusMessage("Sessions %s", E.session ? "on" : "off");
+        } else if (!strcmp(command, "hlcache")) {
+          editorHlCacheCommand();
+        } else if (!strncmp(command, "mem", 3)) {
+          editorMemCommand(command + 3);
         }
             
         free(command);
@@ -1527,8 +3056,249 @@ void editorProcessKeypress() {
   quit_times = TI_QUIT_TIMES;
 }
 
+// runs key c, at every cursor if it is one that acts at each
+void editorDispatchKey(int c) {
+  if (P.p)
+    editorPagerHandleKey(c);
+  else if (E.ncursors && editorCursorsKey(c))
+    editorCursorsApply(c);
+  else
+    editorHandleKey(c);
+}
+
+void editorProcessKeypress() {
+  int c = editorReadKey();
+  uint64_t start = STATS_BEGIN();
+  editorDispatchKey(c);
+  STATS_END(STAGE_PROCESS, start);
+  editorJournalSync();
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ pager ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+int editorPagerOpen(char *filename) {
+  P.p = tiPagerOpen(filename);
+  if (P.p == NULL)
+    return -1;
+  P.top = 0;
+  P.line = 0;
+  P.exact = 1;
+  P.coloff = 0;
+  P.indexed = 0;
+  E.screenrows = E.termrows - 2;
+  E.screencols = E.termcols;
+  return 0;
+}
+
+void editorPagerClose() {
+  tiPagerClose(P.p);
+  P.p = NULL;
+}
+
+// rows on screen are cached, so moving down reuses the next offset of the
+// row rather than scanning for it again
+void editorPagerScroll(int64_t n) {
+  int64_t next;
+  for (; n > 0; --n) {
+    if (tiPagerRow(P.p, P.top, &next) == NULL || next >= tiPagerSize(P.p))
+      break;
+    P.top = next;
+    P.line++;
+  }
+  for (; n < 0 && P.top > 0; ++n) {
+    P.top = tiPagerPrevLine(P.p, P.top);
+    P.line--;
+  }
+}
+
+void editorPagerGoto(int64_t line) {
+  P.exact = !tiPagerSeekLine(P.p, line, &P.top);
+  P.line = line;
+}
+
+void editorPagerEnd() {
+  int64_t size = tiPagerSize(P.p);
+  int64_t lines;
+  int done = tiPagerProgress(P.p, &P.indexed, &lines);
+
+  P.top = tiPagerPrevLine(P.p, size);
+  P.exact = done;
+  if (done) {
+    P.line = lines - 1;
+  } else {
+    double avg = lines ? (double)P.indexed / lines : 80;
+    P.line = lines + (int64_t)((size - P.indexed) / avg);
+  }
+  editorPagerScroll(-(E.screenrows - 1));
+}
+
+// estimated line numbers become exact once the indexer passes them
+void editorPagerSync() {
+  int64_t line;
+  if (!P.exact && tiPagerLineOf(P.p, P.top, &line) == 0) {
+    P.line = line;
+    P.exact = 1;
+  }
+}
+
+void editorPagerRefresh() {
+  editorPagerSync();
+  struct append_buf ab = APPEND_BUF_INIT;
+  abAppend(&ab, "\x1b[?25l", 6);
+  abAppend(&ab, "\x1b[H", 3);
+
+  uint64_t start = STATS_BEGIN();
+  int64_t off = P.top;
+  for (int y = 0; y < E.screenrows; ++y) {
+    erow *row = tiPagerRow(P.p, off, &off);
+    if (row == NULL) {
+      char buf[16];
+      int colorlen = snprintf(buf, sizeof(buf), "\x1b[%dm~\x1b[39m", E.theme);
+      abAppend(&ab, buf, colorlen);
+    } else {
+      int len = row->rsize - P.coloff;
+      if (len > E.screencols)
+        len = E.screencols;
+      char *c = &row->render[P.coloff];
+      for (int j = 0; j < len; ++j) {
+        if (iscntrl(c[j])) {
+          char sym = (c[j] <= 26) ? '@' + c[j] : '?';
+          abAppend(&ab, "\x1b[7m", 4);
+          abAppend(&ab, &sym, 1);
+          abAppend(&ab, "\x1b[m", 3);
+        } else {
+          abAppend(&ab, &c[j], 1);
+        }
+      }
+    }
+    abAppend(&ab, "\x1b[K\r\n", 5);
+  }
+
+  int64_t lines;
+  int done = tiPagerProgress(P.p, &P.indexed, &lines);
+  int64_t size = tiPagerSize(P.p);
+  char status[80], rstatus[80];
+  int len;
+  if (done)
+    len = snprintf(status, sizeof(status), "%.20s - %lld Lines [view]",
+                   tiPagerName(P.p), (long long)lines);
+  else
+    len = snprintf(status, sizeof(status),
+                   "%.20s - ~%lld Lines [view] indexing %d%%",
+                   tiPagerName(P.p),
+                   (long long)(P.indexed ? size * (double)lines / P.indexed
+                                         : 0),
+                   (int)(size ? P.indexed * 100 / size : 100));
+  int rlen = snprintf(rstatus, sizeof(rstatus), "L %s%lld %d%%",
+                      P.exact ? "" : "~", (long long)P.line + 1,
+                      (int)(size ? P.top * 100 / size : 100));
+  if (len > E.screencols)
+    len = E.screencols;
+
+  char buf[32];
+  int colorlen = snprintf(buf, sizeof(buf), "\x1b[%dm\x1b[7m", E.theme);
+  abAppend(&ab, buf, colorlen);
+  abAppend(&ab, status, len);
+  for (; len < E.screencols; ++len) {
+    if (E.screencols - len == rlen) {
+      abAppend(&ab, rstatus, rlen);
+      break;
+    }
+    abAppend(&ab, " ", 1);
+  }
+  abAppend(&ab, "\x1b[m\r\n", 5);
+  STATS_END(STAGE_DRAW, start);
+
+  abAppend(&ab, "\x1b[K", 3);
+  int msglen = strlen(E.statusmsg);
+  if (msglen > E.screencols)
+    msglen = E.screencols;
+  if (msglen && time(NULL) - E.statusmsg_time < 5)
+    abAppend(&ab, E.statusmsg, msglen);
+
+  start = STATS_BEGIN();
+  termWrite(ab.b, ab.len);
+  STATS_END(STAGE_WRITE, start);
+  abFree(&ab);
+}
+
+void editorPagerHandleKey(int c) {
+  switch (c) {
+  case IDLE_KEY:
+    break;
+  case 'q':
+  case CTRL_KEY('q'):
+    editorPagerClose();
+    editorExit();
+    break;
+  case 'j':
+  case '\r':
+  case ARROW_DOWN:
+    editorPagerScroll(1);
+    break;
+  case 'k':
+  case ARROW_UP:
+    editorPagerScroll(-1);
+    break;
+  case ' ':
+  case PAGE_DOWN:
+    editorPagerScroll(E.screenrows);
+    break;
+  case 'b':
+  case PAGE_UP:
+    editorPagerScroll(-E.screenrows);
+    break;
+  case 'l':
+  case ARROW_RIGHT:
+    P.coloff += 8;
+    break;
+  case 'h':
+  case ARROW_LEFT:
+    P.coloff = P.coloff > 8 ? P.coloff - 8 : 0;
+    break;
+  case 'g':
+  case HOME_KEY:
+    editorPagerGoto(0);
+    P.coloff = 0;
+    break;
+  case 'G':
+  case END_KEY:
+    editorPagerEnd();
+    break;
+  case ':': {
+    char *line = editorPrompt("line: %s", NULL);
+    if (line) {
+      long long n = atoll(line);
+      if (n > 0)
+        editorPagerGoto(n - 1);
+      free(line);
+    }
+  } break;
+  }
+}
+
+// runs when no key arrived within the read timeout, returns 1 if the screen
+// is out of date
+int editorIdle() {
+  if (P.p) {
+    int64_t indexed, lines;
+    int done = tiPagerProgress(P.p, &indexed, &lines);
+    if (indexed != P.indexed || (done && !P.exact))
+      return 1;
+    return 0;
+  }
+  int stream = editorStreamRead();
+  int filter = editorFilterPump();
+  editorJournalSync();
+  int saved = editorAutosavePoll();
+  editorFreeze(0);
+  return editorWatchPoll() | stream | filter | saved;
+}
+
 /*~~~~~~~~~~~~~~~~~~~~ cli-flag options ~~~~~~~~~~~~~~~~~~*/
 
+#ifndef TI_HEADLESS
+
 void editorFlags(char flag) {
   printf("\n\r");
   for (int i = 0; i < 80; i++) {
@@ -1539,7 +3309,7 @@ void editorFlags(char flag) {
   case 'h':
     printf("\n\r"
            "\033[0;32m"
-           "usage: ti [options]/[filename]\n\r"
+           "usage: ti [options]/[filename...]\n\r"
            "\033[0m"
            "\n\r"
            "\033[0;34m"
@@ -1559,6 +3329,40 @@ void editorFlags(char flag) {
            "\n\r"
            "  -h: help\n\r"
            "\n\r"
+           "  --stats: time each stage of the main loop, see ':stats'\n\r"
+           "\n\r"
+           "  --trace FILE: like --stats, and write a Chrome trace-event\n\r"
+           "                JSON file of every timed stage to FILE\n\r"
+           "\n\r"
+           "  --mem: print memory use per subsystem on exit, see ':mem'\n\r"
+           "\n\r"
+           "  --intern: share the bytes of identical lines between rows,\n\r"
+           "            see ':intern'\n\r"
+           "\n\r"
+           "  --compress: keep the rows of large files away from the cursor\n\r"
+           "              compressed in memory, see ':compress'\n\r"
+           "\n\r"
+           "  -f FILE: follow FILE as it grows, see ':follow'\n\r"
+           "\n\r"
+           "  -: read piped stdin into a buffer as it arrives, as does a\n\r"
+           "     bare 'ti' at the end of a pipe\n\r"
+           "\n\r"
+           "  -R FILE: page through FILE read-only, for files of any size;\n\r"
+           "           j/k, space/b, g/G, ':N' goes to line N, q quits\n\r"
+           "\n\r"
+           "  -c CMD FILE...: apply the ex command CMD (s/re/rep/g, g/re/d,\n\r"
+           "                  d, sort, uniq, w) to each FILE, -c may repeat\n\r"
+           "\n\r"
+           "  --cat FILE...: print the FILEs highlighted and exit\n\r"
+           "\n\r"
+           "  --html FILE...: write the FILEs highlighted as an HTML page\n\r"
+           "\n\r"
+           "  --daemon [FILE...]: keep FILEs loaded in the background; a\n\r"
+           "                      plain 'ti' is then run by it, starting\n\r"
+           "                      at once\n\r"
+           "\n\r"
+           "  --stop: end the daemon\n\r"
+           "\n\r"
            "\033[0;34m"
            "Modes:\n\r"
            "\033[m"
@@ -1581,14 +3385,88 @@ void editorFlags(char flag) {
            "yellow, default\n\r"
            "\n\r"
            "\033[0;34m"
+           "Languages:\n\r"
+           "\033[0m"
+           "\n\r"
+           "  command-mode -> set lang <language>, 'langs' lists them\n\r"
+           "\n\r"
+           "  more are read from ~/.config/ti/syntax/*.syn, see README\n\r"
+           "\n\r"
+           "\033[0;34m"
            "Save:\n\r"
            "\033[0m"
            "\n\r"
            "  'w' or 'write' in command mode to save file\n\r"
            "\n\r"
+           "  'w!' saves over a file that changed on disk, 'reload' rereads\n\r"
+           "  it instead, replacing only the lines that differ\n\r"
+           "\n\r"
+           "  unsaved edits are journaled to .name.tij and recovered when\n\r"
+           "  the file is opened after a crash\n\r"
+           "\n\r"
+           "  'set autosave N' saves modified buffers in the background\n\r"
+           "  every N seconds while idle, 0 turns it off\n\r"
+           "\n\r"
+           "  files closed unmodified reopen where they were left, from\n\r"
+           "  ~/.cache/ti/sessions while unchanged; 'set session off' stops it\n\r"
+           "\n\r"
            "  'wq' or 'done' save and exit\n\r"
            "\n\r"
            "\033[0;34m"
+           "Buffers:\n\r"
+           "\033[0m"
+           "\n\r"
+           "  'e file' opens file in a new buffer, 'ls' lists buffers\n\r"
+           "\n\r"
+           "  'bn'/'bp' next/previous buffer, 'b N' buffer N\n\r"
+           "\n\r"
+           "  'bd' closes the current buffer, 'bd!' discards its changes\n\r"
+           "\n\r"
+           "  'follow' appends whatever is written to the file, staying at\n\r"
+           "  the end unless you scroll away\n\r"
+           "\n\r"
+           "  'set budget N' caps memory at N MB, inactive buffers\n\r"
+           "  give up their render and highlight caches first\n\r"
+           "\n\r"
+           "\033[0;34m"
+           "Windows:\n\r"
+           "\033[0m"
+           "\n\r"
+           "  'sp [file]'/'vs [file]' split the window horizontally/vertically\n\r"
+           "\n\r"
+           "  'close' closes the window, 'only' closes all others\n\r"
+           "\n\r"
+           "  <C-w> moves to the next window\n\r"
+           "\n\r"
+           "\033[0;34m"
+           "Cursors:\n\r"
+           "\033[0m"
+           "\n\r"
+           "  <C-n> adds a cursor on the next match of the last search\n\r"
+           "\n\r"
+           "  'cursors A,B' adds one on each of lines A to B\n\r"
+           "\n\r"
+           "  keys that type, delete or move act at every cursor, <esc> in\n\r"
+           "  normal mode leaves one\n\r"
+           "\n\r"
+           "\033[0;34m"
+           "Macros:\n\r"
+           "\033[0m"
+           "\n\r"
+           "  q{a-z} records keys into a register until q, @{a-z} replays it\n\r"
+           "\n\r"
+           "  a count replays it that many times (100@a), @@ the last one\n\r"
+           "\n\r"
+           "\033[0;34m"
+           "Filters:\n\r"
+           "\033[0m"
+           "\n\r"
+           "  '%%!sort', '10,$!cmd' replace lines with what a command prints\n\r"
+           "  for them, running in the background\n\r"
+           "  'sort', '10,20sort nu' sort lines, by number (n), dropping repeats (u)\n\r"
+           "  'uniq' drops lines equal to the one above\n\r"
+           "\n\r"
+           "\033[0;34m"
            "Exit:\n\r"
            "\033[0m"
            "\n\r"
@@ -1609,6 +3487,8 @@ void editorFlags(char flag) {
   printf("\n\r");
 }
 
+#endif /* TI_HEADLESS */
+
 /*~~~~~~~~~~~~~~~~~~~~ init ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
 void initEditor() {
@@ -1617,44 +3497,572 @@ void initEditor() {
   E.rx = 0;
   E.rowoff = 0;
   E.coloff = 0;
-  E.numrows = 0;
-  E.row = NULL;
-  E.dirty = 0;
+  E.buf = tiBufferNew();
+  if (E.buf == NULL)
+    die("tiBufferNew");
+  E.bufs = NULL;
+  E.nbufs = 0;
+  E.curbuf = editorAddBuffer(E.buf);
+  E.tick = 0;
+  E.budget = TI_MEM_BUDGET;
+  E.inotify = -1;
+  S.fd = -1;
+  F.in = F.out = -1;
   E.modal = 1;
   E.newfile = 0;
   E.delete = 0;
-  E.filename = NULL;
-  E.setlang[0] = '\0';
+  E.curcursor = -1;
+  E.recording = -1;
+  E.lastmacro = -1;
   E.theme = 37;
   E.statusmsg[0] = '\0';
   E.statusmsg_time = 0;
-  E.syntax = NULL;
+}
 
-  if (getWindowSize(&E.screenrows, &E.screencols) == -1)
+// one window the size of the terminal, on the current buffer and view
+void editorInitWindows() {
+  if (getWindowSize(&E.termrows, &E.termcols) == -1)
     die("getWindowSize");
-  E.screenrows -= 2;
+  free(E.wins);
+  E.wins = calloc(1, sizeof(struct editorWindow));
+  if (E.wins == NULL)
+    die("calloc");
+  E.nwins = 1;
+  E.curwin = 0;
+  struct editorWindow *w = &E.wins[0];
+  editorWindowSetRect(w, 0, 0, E.termcols, E.termrows - 1);
+  w->buf = E.curbuf;
+  w->cx = E.cx;
+  w->cy = E.cy;
+  w->rowoff = E.rowoff;
+  w->coloff = E.coloff;
+  editorLoadWindow(0);
+}
+
+#ifndef TI_HEADLESS
+
+/*~~~~~~~~~~~~~~~~~~~~ export ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// ti --cat|--html file...: the files highlighted to stdout, no editor
+int editorExport(int format, int nfiles, char **files) {
+  if (nfiles == 0) {
+    fprintf(stderr, "ti: %s needs a file\n",
+            format == TI_EXPORT_HTML ? "--html" : "--cat");
+    return 1;
+  }
+  int *errs = malloc(sizeof(int) * nfiles);
+  if (errs == NULL) {
+    perror("ti");
+    return 1;
+  }
+  int failed = tiExport(files, nfiles, format, STDOUT_FILENO, 0, errs);
+  for (int i = 0; i < nfiles; ++i)
+    if (errs[i])
+      fprintf(stderr, "ti: %s: %s\n", files[i], strerror(errs[i]));
+  free(errs);
+  return failed != 0;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ scripts ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// ti -c CMD [-c CMD...] file...: the commands applied to each file, no
+// editor. Prints what happened to each file and how long it took
+int editorScript(char **cmds, int ncmds, char **files, int nfiles) {
+  char err[256];
+  int bad;
+  if (nfiles == 0) {
+    fprintf(stderr, "ti: -c needs a file\n");
+    return 1;
+  }
+  tiScript *sc = tiScriptNew(cmds, ncmds, &bad, err, sizeof(err));
+  if (sc == NULL) {
+    fprintf(stderr, "ti: -c '%s': %s\n", cmds[bad], err);
+    return 1;
+  }
+  struct tiScriptResult *res = malloc(sizeof(*res) * nfiles);
+  if (res == NULL) {
+    perror("ti");
+    tiScriptFree(sc);
+    return 1;
+  }
+
+  uint64_t start = statsNow();
+  int failed = tiScriptRun(sc, files, nfiles, 0, res);
+  uint64_t took = statsNow() - start;
+  int modified = 0, saved = 0;
+  for (int i = 0; i < nfiles; ++i) {
+    char time[16];
+    statsFormat(time, sizeof(time), res[i].ns);
+    if (res[i].err) {
+      fprintf(stderr, "ti: %s: %s\n", files[i], strerror(res[i].err));
+      continue;
+    }
+    modified += res[i].modified;
+    saved += res[i].saved;
+    printf("%s: %d substituted, %d deleted, %s in %s\n", files[i],
+           res[i].subs, res[i].deleted,
+           res[i].saved      ? "saved"
+           : res[i].modified ? "modified, not saved"
+                             : "unchanged",
+           time);
+  }
+  char time[16];
+  statsFormat(time, sizeof(time), took);
+  printf("%d files, %d modified, %d saved, %d failed in %s\n", nfiles,
+         modified, saved, failed, time);
+  free(res);
+  tiScriptFree(sc);
+  return failed != 0;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~ daemon ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// ti --daemon keeps buffers loaded and forks an editor on them for each ti
+// that connects, which hands it the terminal to run on
+struct editorDaemon {
+
+  int listen;
+  struct sockaddr_un addr;
+};
+
+struct editorDaemon D = {.listen = -1};
+
+// $XDG_RUNTIME_DIR/ti.sock, or ti.sock in a /tmp directory only the user
+// can enter, made by the daemon
+int editorSocketPath(struct sockaddr_un *addr, int create) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  const char *run = getenv("XDG_RUNTIME_DIR");
+  char dir[64];
+  if (run == NULL || *run == '\0') {
+    snprintf(dir, sizeof(dir), "/tmp/ti-%u", (unsigned)getuid());
+    struct stat st;
+    if (create && mkdir(dir, 0700) == -1 && errno != EEXIST)
+      return -1;
+    if (lstat(dir, &st) == -1 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != getuid() || (st.st_mode & 077)) {
+      errno = EACCES;
+      return -1;
+    }
+    run = dir;
+  }
+  if (snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/ti.sock", run) >=
+      (int)sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return 0;
+}
+
+int editorConnect() {
+  struct sockaddr_un addr;
+  if (editorSocketPath(&addr, 0) == -1)
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd != -1 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// one request with nfds descriptors passed along
+int editorSendRequest(int fd, const char *msg, size_t len, const int *fds,
+                      int nfds) {
+  union {
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } ctl;
+  struct iovec iov = {(char *)msg, len};
+  struct msghdr mh = {0};
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  if (nfds) {
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+  }
+  return sendmsg(fd, &mh, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+// the request and up to 3 descriptors passed with it into fds, returns its
+// length
+ssize_t editorRecvRequest(int fd, char *msg, size_t size, int *fds) {
+  union {
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } ctl;
+  struct iovec iov = {msg, size};
+  struct msghdr mh = {0};
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = ctl.buf;
+  mh.msg_controllen = sizeof(ctl.buf);
+  ssize_t len = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); len != -1 && cm;
+       cm = CMSG_NXTHDR(&mh, cm)) {
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+      continue;
+    int n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (int k = 0; k < n; ++k) {
+      int passed;
+      memcpy(&passed, CMSG_DATA(cm) + k * sizeof(int), sizeof(int));
+      if (k < 3)
+        fds[k] = passed;
+      else
+        close(passed);
+    }
+  }
+  // a request cut short is not one
+  if (mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+    return -1;
+  return len;
+}
+
+// filename against the current directory, the daemon runs in another
+char *editorAbsPath(const char *filename) {
+  char *real = realpath(filename, NULL);
+  if (real || errno != ENOENT)
+    return real;
+  char cwd[4096];
+  if (filename[0] != '/' && getcwd(cwd, sizeof(cwd)) == NULL)
+    return NULL;
+  char *abs = malloc(strlen(cwd) + strlen(filename) + 2);
+  if (abs && filename[0] == '/')
+    strcpy(abs, filename);
+  else if (abs)
+    sprintf(abs, "%s/%s", cwd, filename);
+  return abs;
+}
+
+// asks a running daemon to edit files on this terminal, and waits until
+// the editor it forks quits. -1 if there is no daemon to do it, the
+// terminal is left alone then
+int editorClient(int nfiles, char **files) {
+  char *msg = malloc(TI_DAEMON_MSG);
+  if (msg == NULL)
+    return -1;
+  size_t len = 0;
+  msg[len++] = 'a';
+  int ok = getcwd(msg + len, TI_DAEMON_MSG - len) != NULL;
+  len += ok ? strlen(msg + len) + 1 : 0;
+  for (int i = 0; ok && i < nfiles; ++i) {
+    char *abs = editorAbsPath(files[i]);
+    ok = abs && len + strlen(abs) + 1 <= TI_DAEMON_MSG;
+    if (ok) {
+      memcpy(msg + len, abs, strlen(abs) + 1);
+      len += strlen(abs) + 1;
+    }
+    free(abs);
+  }
+  int fd = ok ? editorConnect() : -1;
+  struct termios saved;
+  int tty = tcgetattr(STDIN_FILENO, &saved) == 0;
+  const int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  if (fd != -1 && editorSendRequest(fd, msg, len, fds, 3) == -1) {
+    close(fd);
+    fd = -1;
+  }
+  free(msg);
+  if (fd == -1)
+    return -1;
+
+  // the editor says once it has the terminal, and holds on to the socket
+  // until it exits
+  char c;
+  ssize_t n;
+  while ((n = read(fd, &c, 1)) == -1 && errno == EINTR)
+    ;
+  int attached = n == 1;
+  while (attached &&
+         ((n = read(fd, &c, 1)) > 0 || (n == -1 && errno == EINTR)))
+    ;
+  close(fd);
+  // whatever way it ended, the terminal is given back as it was
+  if (attached && tty)
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+  return attached ? 0 : -1;
+}
+
+int editorDaemonStop() {
+  int fd = editorConnect();
+  if (fd == -1 || editorSendRequest(fd, "s", 1, NULL, 0) == -1) {
+    fprintf(stderr, "ti: no daemon running\n");
+    return 1;
+  }
+  char c;
+  ssize_t n;
+  while ((n = read(fd, &c, 1)) > 0 || (n == -1 && errno == EINTR))
+    ;
+  close(fd);
+  return 0;
+}
+
+// the resident buffer of the file at path, loaded now if there is none
+int editorDaemonBuffer(char *path) {
+  for (int i = 0; i < E.nbufs; ++i)
+    if (E.bufs[i].path && !strcmp(E.bufs[i].path, path))
+      return i;
+  editorLoadFile(path);
+  return E.curbuf;
+}
+
+// files saved by the editors forked off, or changed by anything else, are
+// read again so the next editor starts from what is on disk
+void editorDaemonReload() {
+  for (int i = 0; i < E.nbufs; ++i) {
+    struct editorBuffer *eb = &E.bufs[i];
+    int first, removed, added;
+    if (!eb->stale || eb->buf->dirty ||
+        tiReload(eb->buf, eb->path, &first, &removed, &added) == -1)
+      continue;
+    editorDiskSync(eb);
+    editorShiftViews(eb->buf, first, removed, added);
+    if (i == E.curbuf)
+      editorShiftView(&E.cy, &E.rowoff, first, removed, added);
+  }
+}
+
+// in the forked editor: takes over the client's terminal and directory and
+// edits buffer buf, -1 for a new scratch one
+void editorDaemonAttach(int cfd, const int *fds, const char *cwd, int buf) {
+  close(D.listen);
+  for (int k = 0; k < 3; ++k) {
+    dup2(fds[k], k);
+    close(fds[k]);
+  }
+  if (chdir(cwd) == -1)
+    editorSetStatusMessage("Can't enter %s: %s", cwd, strerror(errno));
+
+  // the daemon's inotify instance would share its events with this one
+  close(E.inotify);
+  E.inotify = -1;
+  for (int i = 0; i < E.nbufs; ++i) {
+    E.bufs[i].wd = -1;
+    if (E.bufs[i].path)
+      editorWatchFile(&E.bufs[i]);
+  }
+  E.journal = 1;
+  if (buf == -1) {
+    buf = E.curbuf;
+    if (E.buf->filename || E.buf->numrows)
+      buf = editorAddBuffer(tiBufferNew());
+  }
+  editorSwitchBuffer(buf);
+  enableRawMode();
+  editorInitWindows();
+  if (write(cfd, "k", 1) != 1)
+    exit(1);
+
+  if (!E.notice)
+    editorSetStatusMessage(
+        "<C-q>/:q = Quit  |  <C-s>/:w = Save | ESC = NORMAL | i = INSERT | :help for more");
+  while (1) {
+    editorRefreshScreen();
+    editorProcessKeypress();
+  }
+}
+
+void editorDaemonAccept() {
+  int cfd = accept4(D.listen, NULL, NULL, SOCK_CLOEXEC);
+  if (cfd == -1)
+    return;
+  struct ucred cred;
+  socklen_t clen = sizeof(cred);
+  char *msg = malloc(TI_DAEMON_MSG + 1);
+  int fds[3] = {-1, -1, -1};
+  ssize_t len = -1;
+  if (msg && getsockopt(cfd, SOL_SOCKET, SO_PEERCRED, &cred, &clen) == 0 &&
+      cred.uid == getuid())
+    len = editorRecvRequest(cfd, msg, TI_DAEMON_MSG, fds);
+
+  if (len == 1 && msg[0] == 's') {
+    unlink(D.addr.sun_path);
+    editorExit();
+  }
+  // 'a', the client's directory and the files, each NUL terminated
+  if (len > 2 && msg[0] == 'a' && msg[len - 1] == '\0' && fds[2] != -1) {
+    // files are loaded here rather than in the fork, to stay for the next
+    const char *cwd = msg + 1;
+    int buf = -1;
+    for (char *file = msg + 1 + strlen(cwd) + 1; file < msg + len;
+         file += strlen(file) + 1) {
+      int n = editorDaemonBuffer(file);
+      if (buf == -1)
+        buf = n;
+    }
+    if (fork() == 0)
+      editorDaemonAttach(cfd, fds, cwd, buf);
+  }
+  for (int k = 0; k < 3; ++k)
+    if (fds[k] != -1)
+      close(fds[k]);
+  close(cfd);
+  free(msg);
+}
+
+// ti --daemon [file...]: loads the files and goes on in the background
+int editorDaemonStart(int nfiles, char **files) {
+  if (editorSocketPath(&D.addr, 1) == -1) {
+    perror("ti: socket");
+    return 1;
+  }
+  int running = editorConnect();
+  if (running != -1) {
+    fprintf(stderr, "ti: a daemon is running already on %s\n",
+            D.addr.sun_path);
+    return 1;
+  }
+  // left behind by a daemon that was killed
+  unlink(D.addr.sun_path);
+  D.listen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (D.listen == -1 ||
+      bind(D.listen, (struct sockaddr *)&D.addr, sizeof(D.addr)) == -1 ||
+      listen(D.listen, 16) == -1) {
+    perror(D.addr.sun_path);
+    return 1;
+  }
+
+  initEditor();
+  E.session = 1;
+  for (int i = 0; i < nfiles; ++i) {
+    char *abs = editorAbsPath(files[i]);
+    if (abs)
+      editorDaemonBuffer(abs);
+    free(abs);
+  }
+
+  pid_t pid = fork();
+  if (pid != 0) {
+    if (pid == -1)
+      perror("ti: fork");
+    else
+      printf("ti: daemon %d on %s, %d files loaded\n", (int)pid,
+             D.addr.sun_path, nfiles);
+    return pid == -1;
+  }
+  setsid();
+  if (chdir("/") == -1)
+    exit(1);
+  int null = open("/dev/null", O_RDWR);
+  for (int k = 0; null != -1 && k < 3; ++k)
+    dup2(null, k);
+  if (null > 2)
+    close(null);
+
+  while (1) {
+    struct pollfd fds[2] = {{D.listen, POLLIN, 0}, {E.inotify, POLLIN, 0}};
+    poll(fds, 2, TI_DAEMON_POLL);
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+      ;
+    editorWatchPoll();
+    editorDaemonReload();
+    if (fds[0].revents & POLLIN)
+      editorDaemonAccept();
+  }
 }
 
 int main(int argc, char *argv[]) {
+  if (argc > 2 && !strcmp(argv[1], "-c")) {
+    // the commands are gathered in place, ahead of the files
+    int ncmds = 0, i = 1;
+    for (; i + 1 < argc && !strcmp(argv[i], "-c"); i += 2)
+      argv[1 + ncmds++] = argv[i + 1];
+    return editorScript(argv + 1, ncmds, argv + i, argc - i);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--cat"))
+    return editorExport(TI_EXPORT_ANSI, argc - 2, argv + 2);
+  if (argc > 1 && !strcmp(argv[1], "--html"))
+    return editorExport(TI_EXPORT_HTML, argc - 2, argv + 2);
+  if (argc > 1 && !strcmp(argv[1], "--daemon"))
+    return editorDaemonStart(argc - 2, argv + 2);
+  if (argc > 1 && !strcmp(argv[1], "--stop"))
+    return editorDaemonStop();
+  // with a daemon running, plain `ti [file...]` on a terminal is run by it
+  int plain = isatty(STDIN_FILENO);
+  for (int i = 1; i < argc; ++i)
+    plain &= argv[i][0] != '-';
+  if (plain && editorClient(argc - 1, argv + 1) == 0)
+    return 0;
+
+  // text piped in is read while the editor runs, keys come from the terminal
+  int stream = -1;
+  if (!isatty(STDIN_FILENO)) {
+    int tty = open("/dev/tty", O_RDWR);
+    stream = dup(STDIN_FILENO);
+    if (tty == -1 || stream == -1 || dup2(tty, STDIN_FILENO) == -1)
+      die("/dev/tty");
+    close(tty);
+  }
   enableRawMode();
   initEditor();
-  if (argc >= 2) {
-    if (argv[1][0] == '-') {
-      int i = 1;
-      while (i < argc && argv[i][0] == '-') {
-        editorFlags(argv[i][1]);
-        i++;
-      }
-      if (i == argc)
-        return 0;
-      
-      editorOpen(argv[i]);
+  editorInitWindows();
+  E.journal = 1;
+  E.session = 1;
+
+  int i = 1;
+  int printed = 0;
+  int view = 0;
+  int follow = 0;
+  while (i < argc && argv[i][0] == '-' && argv[i][1]) {
+    if (!strcmp(argv[i], "--stats")) {
+      tiStats.enabled = 1;
+    } else if (!strcmp(argv[i], "--mem")) {
+      atexit(memReport);
+    } else if (!strcmp(argv[i], "--intern")) {
+      E.intern = 1;
+      E.buf->intern = 1;
+    } else if (!strcmp(argv[i], "--compress")) {
+      E.compress = 1;
+    } else if (!strcmp(argv[i], "-R") || !strcmp(argv[i], "--view")) {
+      view = 1;
+    } else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--follow")) {
+      follow = 1;
+    } else if (!strcmp(argv[i], "--trace")) {
+      if (i + 1 == argc || statsOpenTrace(argv[i + 1]) == -1)
+        die("--trace");
+      i++;
+    } else {
+      editorFlags(argv[i][1] == '-' ? argv[i][2] : argv[i][1]);
+      printed = 1;
     }
-    editorOpen(argv[1]);
+    i++;
   }
 
-  editorSetStatusMessage(
-      "<C-q>/:q = Quit  |  <C-s>/:w = Save | ESC = NORMAL | i = INSERT | :help for more");
+  if (view && i < argc && strcmp(argv[i], "-")) {
+    if (editorPagerOpen(argv[i]) == -1)
+      die(argv[i]);
+    editorSetStatusMessage(
+        "q = Quit | j/k, space/b = Scroll | g/G = Top/End | :N = Line N");
+  } else {
+    if (i < argc && follow) {
+      // the file is read by editorFollow, only name the buffer here
+      E.bufs[0].path = strdup(argv[i]);
+      E.buf->filename = strdup(basename(argv[i++]));
+      tiSelectSyntax(E.buf);
+      editorFollow();
+    } else if (i < argc && strcmp(argv[i], "-")) {
+      editorOpen(argv[i++]);
+    } else if (i < argc || (stream != -1 && !printed)) {
+      i += i < argc;
+      editorStreamOpen(stream);
+    } else if (printed) {
+      return 0;
+    }
+    if (stream != -1 && S.fd != stream)
+      close(stream);
+    for (; i < argc; ++i)
+      editorEditFile(argv[i]);
+    editorSwitchBuffer(0);
+
+    if (!E.notice)
+      editorSetStatusMessage(
+          "<C-q>/:q = Quit  |  <C-s>/:w = Save | ESC = NORMAL | i = INSERT | :help for more");
+  }
   while (1) {
     editorRefreshScreen();
     editorProcessKeypress();
@@ -1663,6 +4071,8 @@ int main(int argc, char *argv[]) {
   return 0;
 }
 
+#endif /* TI_HEADLESS */
+
 /*~~~~~~~~ FOOTNOTES - CONTRIBUTERS - ETC ~~~~~~~~~*/
 /*
 
@@ -0,0 +1,688 @@
+/*~~~~~~~~~~~~~~~~~~~~ libti ~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * Public interface of libti, the editor core: buffers of rows, row
+ * operations, syntax highlighting, search and file I/O. Nothing in here
+ * touches the terminal; every function works on an explicit tiBuffer so
+ * several independent buffers can live in one process. The TUI in ti.c is
+ * one consumer of this API, bench/tibench.c is another.
+ */
+
+#ifndef TI_H
+#define TI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*~~~~~~~~~~~~~~~~~~~~ version ~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define TI_VERSION "0.0.6"
+
+/*~~~~~~~~~~~~~~~~~~~~ defines ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define TI_TAB_STOP 4
+
+enum editorHighlight {
+
+  HL_NORMAL = 0,
+  HL_COMMENT,
+  HL_MLCOMMENT,
+  HL_KEYWORD1,
+  HL_KEYWORD2,
+  HL_KEYWORD3,
+  HL_KEYWORD4,
+  HL_STRING,
+  HL_NUMBER,
+  HL_MATCH
+
+};
+
+#define HL_HIGHLIGHT_NUMBERS (1 << 10)
+#define HL_HIGHLIGHT_STRINGS (1 << 1)
+
+enum editorStage {
+
+  STAGE_READ = 0,
+  STAGE_PROCESS,
+  STAGE_SYNTAX,
+  STAGE_DRAW,
+  STAGE_WRITE,
+  STAGE_COUNT
+
+};
+
+enum editorMemCategory {
+
+  MEM_ROWS = 0,
+  MEM_CHARS,
+  MEM_RENDER,
+  MEM_HL,
+  MEM_SEARCH,
+  MEM_FRAME,
+  MEM_PROMPT,
+  MEM_IO,
+  MEM_INDEX,
+  MEM_SYNTAX,
+  MEM_COLD,
+  MEM_COUNT
+
+};
+
+// log-linear histogram: 2^STATS_SUB_BITS linear buckets per power of two ns
+#define STATS_SUB_BITS 3
+#define STATS_BUCKETS (64 << STATS_SUB_BITS)
+
+/*~~~~~~~~~~~~~~~~~~~~ data ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// a language as written in HLDB or a .syn file, see tiSyntaxParse
+struct tiSyntaxDef {
+
+  char *filetype;
+  char **filematch;
+  char **keywords;
+  char *single_line_comment_start;
+  char *multi_line_comment_start;
+  char *multi_line_comment_end;
+  int flags;
+  // characters ending a keyword besides whitespace, NULL for is_seperator's
+  char *separators;
+};
+
+struct tiKeyword {
+
+  uint32_t word;
+  uint16_t len;
+  uint16_t type;
+};
+
+// a compiled language, pointing into the image it was loaded from
+struct editorSyntax {
+
+  const char *filetype;
+  const char *single_line_comment_start;
+  const char *multi_line_comment_start;
+  const char *multi_line_comment_end;
+  int flags;
+  // open addressed on the keyword bytes, words are offsets into words
+  const char *words;
+  const struct tiKeyword *keywords;
+  uint32_t kwmask;
+  // distinct keyword lengths, longest first
+  const unsigned char *lens;
+  int nlens;
+  const unsigned char *separators;
+};
+
+typedef struct erow {
+
+  int idx;
+  int size;
+  int rsize;
+  // snapshot generation chars was allocated in, see tiSnapshotSave
+  unsigned gen;
+  char *chars;
+  char *render;
+  // shared with identical rows, see tiHlAcquire
+  const unsigned char *hl;
+  // chars is NULL while the bytes are packed at coldoff in cold, see
+  // tiBufferFreeze; read them with tiRowChars
+  struct tiColdBlock *cold;
+  unsigned coldoff;
+  unsigned char hl_open_comment;
+  // chars is shared through the intern pool and must not be changed
+  unsigned char interned;
+  // changed inside a batch, see tiBufferBatchBegin
+  unsigned char stale;
+
+} erow;
+
+typedef struct tiBuffer {
+
+  int numrows;
+  int rowcap;
+  erow *row;
+  int dirty;
+  // bumped by every change to the rows, never reset like dirty is
+  unsigned edits;
+  char *filename;
+  char setlang[32];
+  struct editorSyntax *syntax;
+  // edits are recorded here while set, see tiJournalOpen
+  struct tiJournal *journal;
+  // a snapshot being written shares the bytes of rows older than snapgen
+  struct tiSnapshot *snapshot;
+  unsigned snapgen;
+  // rows added while set share their bytes with identical lines, see
+  // tiBufferIntern
+  int intern;
+  // nesting depth of batches, and the range of rows changed in them
+  int batch;
+  int batchlo, batchhi;
+
+} tiBuffer;
+
+struct stageStats {
+
+  uint64_t count;
+  uint64_t total;
+  uint64_t max;
+  uint64_t hist[STATS_BUCKETS];
+};
+
+struct editorStats {
+
+  int enabled;
+  FILE *trace;
+  int trace_events;
+  uint64_t epoch;
+  struct stageStats stage[STAGE_COUNT];
+};
+
+struct memCategory {
+
+  size_t live;
+  size_t peak;
+  size_t allocs;
+  size_t live_allocs;
+};
+
+struct editorMem {
+
+  struct memCategory cat[MEM_COUNT];
+};
+
+extern struct editorStats tiStats;
+extern struct editorMem tiMem;
+extern const char *stageNames[STAGE_COUNT];
+extern const char *memNames[MEM_COUNT];
+
+/*~~~~~~~~~~~~~~~~~~~~ buffers ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+tiBuffer *tiBufferNew(void);
+void tiBufferClear(tiBuffer *b);
+// frees the render and hl caches of every row, returns the bytes released
+size_t tiBufferDropCaches(tiBuffer *b);
+// sets whether rows added to b are interned. Turning it on also moves the
+// rows already there into the pool, returns how many were moved
+size_t tiBufferIntern(tiBuffer *b, int on);
+// packs the rows outside [from, to) into compressed blocks and drops their
+// render and hl, returns how many rows were packed. Rows are unpacked again
+// as they are read or changed
+size_t tiBufferFreeze(tiBuffer *b, int from, int to);
+void tiBufferFree(tiBuffer *b);
+// row operations between these leave the rows they change to be rendered
+// and highlighted once, when the outermost batch ends
+void tiBufferBatchBegin(tiBuffer *b);
+void tiBufferBatchEnd(tiBuffer *b);
+
+/*~~~~~~~~~~~~~~~~~~~~ row operations ~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// the bytes of a row, NUL terminated. Those of a cold row live in the block
+// cache and stay valid until TI_COLD_LRU - 1 other blocks have been read
+const char *tiRowChars(erow *row);
+int tiRowCxToRx(erow *row, int cx);
+int tiRowRxToCx(erow *row, int rx);
+void tiRenderRow(erow *row);
+void tiUpdateRow(tiBuffer *b, erow *row);
+// rebuilds render and hl of a row whose caches were dropped
+erow *tiRowEnsure(tiBuffer *b, erow *row);
+void tiInsertRow(tiBuffer *b, int at, const char *s, size_t len);
+void tiFreeRow(erow *row);
+void tiDelRow(tiBuffer *b, int at);
+void tiRowInsertChar(tiBuffer *b, erow *row, int at, int c);
+void tiRowAppendString(tiBuffer *b, erow *row, const char *s, size_t len);
+void tiRowDelChar(tiBuffer *b, erow *row, int at);
+void tiRowTruncate(tiBuffer *b, erow *row, int len);
+// the same as the row operations one at a time, in one pass over the rows.
+// Splits rows[i] at column cols[i], cuts sorted by row then column
+void tiSplitRows(tiBuffer *b, const int *rows, const int *cols, int n);
+// appends each of rows, ascending and distinct, to the row before it
+void tiJoinRows(tiBuffer *b, const int *rows, int n);
+// removes rows, ascending and distinct
+void tiDelRows(tiBuffer *b, const int *rows, int n);
+// replaces rows [at, at + n) with the rows of src, which are moved rather
+// than copied and leave src empty
+void tiReplaceRows(tiBuffer *b, int at, int n, tiBuffer *src);
+// reorders rows first to last as tiSortOrder does (TI_SORT_* flags).
+// Only the rows are moved; those whose comment state coming in changed
+// are highlighted again. Returns how many rows were dropped as repeats, -1
+// if out of memory
+int tiSortRows(tiBuffer *b, int first, int last, int flags, int threads);
+
+/*~~~~~~~~~~~~~~~~~~~~ syntax highlighting ~~~~~~~~~~~~~~~~~~~~*/
+
+int is_seperator(int c);
+int tiHighlightInto(const struct editorSyntax *syn, const char *render,
+                    int len, int in_comment, unsigned char *hl);
+int tiHighlightRow(tiBuffer *b, erow *row);
+void tiUpdateSyntax(tiBuffer *b, erow *row);
+int tiSyntaxToColor(int hl);
+void tiSelectSyntax(tiBuffer *b);
+
+/*~~~~~~~~~~~~~~~~~~~~ hash tables ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// 64-bit hash of len bytes at s, 8 at a time, seeded with what else a
+// lookup depends on
+uint64_t tiHash(uint64_t seed, const char *s, size_t len);
+
+// the first member of every entry of a chained table, slot hash & (n - 1)
+struct tiHashLink {
+
+  struct tiHashLink *next;
+  uint64_t hash;
+};
+
+// doubles the n slots of a table (from 4096 while it has none), moving its
+// entries over. -1 if out of memory, the table is left as it was
+int tiHashGrow(struct tiHashLink ***slots, size_t *n);
+
+/*~~~~~~~~~~~~~~~~~~~~ highlight cache ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// bytes of hl arrays no row uses that are kept around for reuse
+#define TI_HLCACHE_IDLE (4 << 20)
+
+struct tiHlStats {
+
+  uint64_t lookups;
+  uint64_t hits;
+  uint64_t evictions;
+  size_t entries;
+  // hl bytes kept for reuse, and bytes rows share instead of owning
+  size_t idle;
+  size_t shared;
+};
+
+extern struct tiHlStats tiHl;
+
+// the hl array for a render in the given incoming comment state, shared
+// with every other row that has it. It must not be written to; release it
+// with tiHlRelease. NULL if out of memory
+const unsigned char *tiHlAcquire(const struct editorSyntax *syntax,
+                                 const char *render, int len, int in_comment,
+                                 int *open_comment);
+void tiHlRelease(const unsigned char *hl);
+// frees every hl array no row uses, returns the bytes released
+size_t tiHlTrim(void);
+
+/*~~~~~~~~~~~~~~~~~~~~ intern pool ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+struct tiInternStats {
+
+  uint64_t lookups;
+  uint64_t hits;
+  size_t entries;
+  // bytes of the distinct lines and of the pool's own bookkeeping
+  size_t bytes;
+  size_t overhead;
+  // bytes rows would own on their own beyond those in the pool
+  size_t saved;
+};
+
+extern struct tiInternStats tiIntern;
+
+// a shared, NUL terminated copy of the len bytes at s, deduplicated with
+// every other acquired copy. Must not be changed; NULL if out of memory
+char *tiInternAcquire(const char *s, size_t len);
+void tiInternRetain(const char *chars);
+void tiInternRelease(const char *chars);
+
+/*~~~~~~~~~~~~~~~~~~~~ cold rows ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// rows and unpacked bytes at most in one block
+#define TI_COLD_ROWS 256
+#define TI_COLD_BLOCK (64 << 10)
+// unpacked blocks kept, least recently read go first
+#define TI_COLD_LRU 8
+
+typedef struct tiColdBlock tiColdBlock;
+
+struct tiColdStats {
+
+  uint64_t reads;
+  uint64_t hits;
+  size_t blocks;
+  // unpacked bytes of the live blocks and what they take packed
+  size_t raw;
+  size_t packed;
+};
+
+extern struct tiColdStats tiCold;
+
+// packs len bytes holding nrows rows, referenced once by each of them.
+// NULL if out of memory
+tiColdBlock *tiColdPack(const char *raw, size_t len, int nrows);
+// the unpacked bytes through the block cache, NULL if out of memory
+const char *tiColdRead(tiColdBlock *c);
+// unpacks into out, which holds tiColdSize bytes, without the cache, so it
+// may be called from any thread holding a reference. -1 if corrupt
+int tiColdUnpack(const tiColdBlock *c, char *out);
+size_t tiColdSize(const tiColdBlock *c);
+void tiColdRetain(tiColdBlock *c);
+void tiColdRelease(tiColdBlock *c);
+// whether most of the rows packed in c have been unpacked since
+int tiColdSparse(const tiColdBlock *c);
+
+/*~~~~~~~~~~~~~~~~~~~~ syntax database ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+extern struct tiSyntaxDef HLDB[];
+extern const int HLDB_ENTRIES;
+
+// compiles the built-in languages and those in the .syn files of dir, which
+// are kept compiled in cache and mapped from there while it is up to date.
+// NULL for both uses $XDG_CONFIG_HOME/ti/syntax and
+// $XDG_CACHE_HOME/ti/syntax.cache. Done on first use if never called.
+// Returns the number of languages, -1 if dir could not be compiled
+int tiSyntaxLoad(const char *dir, const char *cache);
+// reads a .syn definition; free its strings and arrays when done
+int tiSyntaxParse(struct tiSyntaxDef *def, const char *name, const char *text,
+                  size_t len);
+// language for a file by extension or, failing that, by whole name
+struct editorSyntax *tiSyntaxMatch(const char *filename);
+// language by filetype (any case) or by one of its extensions without dot
+struct editorSyntax *tiSyntaxFind(const char *lang);
+// comma separated filetypes into buf, returns the length written
+int tiSyntaxList(char *buf, size_t size);
+// HL_KEYWORD1..4 if the len bytes at p are a keyword, HL_NORMAL otherwise
+int tiSyntaxKeyword(const struct editorSyntax *s, const char *p, int len);
+
+/*~~~~~~~~~~~~~~~~~~~~ line index ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define TI_INDEX_THREADS 16
+// bytes below which another indexing thread is not worth starting
+#define TI_INDEX_SPLIT (8 << 20)
+
+// offsets of every '\n' in buf, in order. Large inputs are split across up
+// to `threads` threads (0 for one per CPU). Returns a MEM_INDEX array of
+// *count entries to be released with memFree, NULL if out of memory
+size_t *tiIndexNewlines(const char *buf, size_t len, size_t *count,
+                        int threads);
+
+/*~~~~~~~~~~~~~~~~~~~~ sorting ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define TI_SORT_THREADS 16
+// rows below which another sorting thread is not worth starting
+#define TI_SORT_SPLIT (64 << 10)
+
+enum tiSortFlags {
+
+  // by the first decimal number in each row (rows without one first)
+  // rather than by their bytes
+  TI_SORT_NUMERIC = 1,
+  // only the first of rows that compare equal is kept
+  TI_SORT_UNIQUE = 2,
+  // left in their order, with TI_SORT_UNIQUE only repeats of the row
+  // before are dropped
+  TI_SORT_KEEP_ORDER = 4
+
+};
+
+// the rows of rows[0..n) in order, stable, as a MEM_ROWS array of *kept
+// pointers into rows to be released with memFree; NULL if out of memory.
+// The rows are compared in their chars, which must not be cold. Large
+// ranges are sorted across up to `threads` threads (0 for one per CPU)
+erow **tiSortOrder(erow *rows, int n, int flags, int threads, int *kept);
+
+/*~~~~~~~~~~~~~~~~~~~~ export ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define TI_EXPORT_THREADS 16
+// bytes read from a file, and buffered for output, at a time
+#define TI_EXPORT_BUF (256 << 10)
+
+enum tiExportFormat {
+
+  // colored with terminal escape sequences, as the editor draws them
+  TI_EXPORT_ANSI,
+  // one HTML page, each file a <pre> of spans classed by highlight
+  TI_EXPORT_HTML
+
+};
+
+// highlights files[0..n) a line at a time as the editor would and writes
+// them to fd in order, memory growing only with the longest line. Files
+// are spread over up to `threads` threads (0 for one per CPU), each
+// buffering one file until the ones before it are written. Returns how
+// many files failed, errs[i] holding the errno of file i or 0
+int tiExport(char **files, int n, int format, int fd, int threads,
+             int *errs);
+
+/*~~~~~~~~~~~~~~~~~~~~ scripts ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#define TI_SCRIPT_THREADS 16
+
+// ex commands compiled once and applied to many files without a terminal
+typedef struct tiScript tiScript;
+
+struct tiScriptResult {
+
+  // errno of the file, 0 if the script ran through
+  int err;
+  // substitutions made, and lines deleted or dropped as repeats
+  int subs, deleted;
+  // whether the script changed the file, and wrote it
+  int modified, saved;
+  uint64_t ns;
+};
+
+// the lines a command starting with a range (%, A or A,B) applies to, line
+// cur if it has none, clamped to numrows. An address is N, . (cur) or $
+// followed by any +N or -N. Returns the rest of s
+char *tiParseRange(char *s, int numrows, int cur, int *first, int *last);
+// compiles each of cmds: [range]s/re/rep/[gi], [range]g/re/d, [range]v/re/d,
+// [range]d, [range]sort [n][u], [range]uniq, w, wq, q. Patterns are POSIX
+// extended regular expressions. NULL with err set and *bad the index of
+// the command at fault if one is not understood
+tiScript *tiScriptNew(char **cmds, int n, int *bad, char *err, size_t errlen);
+void tiScriptFree(tiScript *sc);
+// runs the script over each of files[0..n) on up to `threads` threads (0
+// for one per CPU). Rows are never rendered or highlighted; commands
+// without a range apply to every line. Returns how many files failed
+int tiScriptRun(const tiScript *sc, char **files, int n, int threads,
+                struct tiScriptResult *res);
+
+/*~~~~~~~~~~~~~~~~~~~~ file I/O ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// appends every line of buf to b, including a last one without a newline
+void tiAppendLines(tiBuffer *b, const char *buf, size_t len);
+// the same with the '\n's of buf already found, at nl[0..count). With open
+// set the rows are left to be rendered and highlighted as they are read,
+// row j (from the first appended) leaving a comment open if bit j of open
+// is set
+void tiAppendIndexed(tiBuffer *b, const char *buf, size_t len,
+                     const size_t *nl, size_t count,
+                     const unsigned char *open);
+// appends the lines of filename to b and names b after it, -1 if the file
+// could not be read
+int tiOpen(tiBuffer *b, const char *filename);
+// rereads filename into b, replacing only the rows between the lines both
+// versions share at the start and at the end; the kept rows keep their
+// caches. Reports the replaced range, -1 if the file could not be read
+int tiReload(tiBuffer *b, const char *filename, int *first, int *removed,
+             int *added);
+char *tiRowsToString(tiBuffer *b, size_t *buflen);
+// writes b to path, the file it was read from and not b->filename, which
+// is only its name. Returns the bytes written or -1 with errno set
+ssize_t tiSave(tiBuffer *b, const char *path);
+
+/*~~~~~~~~~~~~~~~~~~~~ find / search ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// searches the rendered rows after (or before, direction -1) row `from`,
+// wrapping around. Returns the matching row and sets *rx, or -1
+int tiFind(tiBuffer *b, const char *query, int from, int direction, int *rx);
+
+/*~~~~~~~~~~~~~~~~~~~~ pager ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * Read-only view of a file of any size. Rows are addressed by 64-bit byte
+ * offset and read on demand into a bounded cache; a background thread
+ * builds a sparse index of line starts for line numbers and goto.
+ */
+
+// the index keeps the offset of every TI_PAGER_STRIDE-th line
+#define TI_PAGER_STRIDE 1024
+// materialized rows, a power of two
+#define TI_PAGER_CACHE 1024
+// longer lines are cut when materialized
+#define TI_PAGER_LINE_MAX (64 << 10)
+
+typedef struct tiPager tiPager;
+
+tiPager *tiPagerOpen(const char *filename);
+void tiPagerClose(tiPager *p);
+const char *tiPagerName(tiPager *p);
+int64_t tiPagerSize(tiPager *p);
+// bytes and lines indexed so far, returns 1 once the whole file is indexed
+int tiPagerProgress(tiPager *p, int64_t *indexed, int64_t *lines);
+// the line starting at off and the offset of the line after it, NULL at EOF
+erow *tiPagerRow(tiPager *p, int64_t off, int64_t *next);
+int64_t tiPagerNextLine(tiPager *p, int64_t off);
+int64_t tiPagerPrevLine(tiPager *p, int64_t off);
+// line number of the line starting at off, -1 if not indexed that far yet
+int tiPagerLineOf(tiPager *p, int64_t off, int64_t *line);
+// offset of line, returns 1 if it had to be estimated past the index
+int tiPagerSeekLine(tiPager *p, int64_t line, int64_t *off);
+
+/*~~~~~~~~~~~~~~~~~~~~ journal ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * Append-only record of the edits made to a buffer since it last matched
+ * its file. Records are batched in memory and fsync'd at most every
+ * TI_JOURNAL_INTERVAL, so keeping them durable costs in proportion to the
+ * edits, not the file; replaying the journal over the file after a crash
+ * restores the buffer.
+ */
+
+// ns between fsyncs of a journal with unsynced records
+#define TI_JOURNAL_INTERVAL (1000 * 1000000ULL)
+// pending bytes handed to the kernel without waiting for the timer
+#define TI_JOURNAL_BATCH (64 << 10)
+
+enum tiJournalOp {
+
+  TI_JOURNAL_INSERT_ROW = 1,
+  TI_JOURNAL_DEL_ROW,
+  TI_JOURNAL_INSERT_CHAR,
+  TI_JOURNAL_APPEND,
+  TI_JOURNAL_DEL_CHAR,
+  TI_JOURNAL_TRUNCATE,
+  // rows row to at sorted again by tiSortRows, the flags as the text
+  TI_JOURNAL_SORT,
+  // at rows from row on replaced by the lines of the text
+  TI_JOURNAL_REPLACE_ROWS
+
+};
+
+typedef struct tiJournal tiJournal;
+struct stat;
+
+// journals the edits of b to path. Edits left in it by an earlier session
+// are replayed first (*replayed of them) if they were made against base,
+// the file b was read from; otherwise NULL with errno ESTALE. The journal
+// is locked while open, NULL with errno EBUSY if another editor holds it
+tiJournal *tiJournalOpen(tiBuffer *b, const char *path,
+                         const struct stat *base, int *replayed);
+void tiJournalRecord(tiJournal *j, int op, int row, int at, const char *s,
+                     size_t len);
+// rows [at, at + n) replaced by the m of rows, in as few records as the
+// length of their text allows
+void tiJournalRecordRows(tiJournal *j, int at, int n, erow *rows, int m);
+// empties the journal once its buffer matches base again
+int tiJournalReset(tiJournal *j, const struct stat *base);
+// writes and fsyncs pending records once the interval has passed (or if
+// force is set), returns 1 if it synced. Once a record could not be kept
+// (out of memory, a failed write) the journal is removed and records
+// nothing more; this returns -1 from then on with errno set to why
+int tiJournalSync(tiJournal *j, int force);
+// the file is kept for recovery if keep is set, removed otherwise
+void tiJournalClose(tiJournal *j, int keep);
+// position after the last record so far
+off_t tiJournalMark(tiJournal *j);
+// keeps only the records after mark, once the edits before it are in base
+int tiJournalRebase(tiJournal *j, off_t mark, const struct stat *base);
+
+/*~~~~~~~~~~~~~~~~~~~~ snapshots ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * Background saves. A snapshot copies only the row pointers of a buffer and
+ * a thread writes them to a temporary file renamed over the target, while
+ * the buffer stays editable: row operations give a row fresh bytes before
+ * changing or freeing bytes the snapshot still reads.
+ */
+
+typedef struct tiSnapshot tiSnapshot;
+
+// starts writing b as it is now to path, NULL with errno EBUSY if b already
+// has a snapshot being written
+tiSnapshot *tiSnapshotSave(tiBuffer *b, const char *path);
+// 1 once the write is over (waiting for it if wait is set), with the bytes
+// written or -1 and an errno
+int tiSnapshotDone(tiSnapshot *s, int wait, ssize_t *written, int *err);
+// b->dirty when the snapshot was taken
+int tiSnapshotDirty(tiSnapshot *s);
+// hands row bytes the buffer no longer uses to the snapshot to free
+void tiSnapshotRetire(tiSnapshot *s, char *chars);
+// waits for the write and frees the snapshot with the bytes retired to it
+void tiSnapshotRelease(tiBuffer *b, tiSnapshot *s);
+
+/*~~~~~~~~~~~~~~~~~~~~ sessions ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/*
+ * What opening a file worked out, kept to open it again without redoing
+ * it: where its lines end, the comment state each row leaves and the view
+ * on it. A session is an image used in place once mapped, trusted only for
+ * the path, size, mtime and bytes it was saved from.
+ */
+
+// sessions kept in a directory, the least recently saved go first
+#define TI_SESSION_KEEP 64
+
+struct tiSessionView {
+
+  int cx, cy;
+  int rowoff, coloff;
+};
+
+// $XDG_CACHE_HOME/ti/sessions/<hash of the absolute path of filename>, or
+// under ~/.cache; NULL if filename doesn't exist or there is neither
+char *tiSessionPath(const char *filename);
+// appends the lines of filename to b from the session saved at path if it
+// is the file as it is now and b's language gives the same comment states.
+// The rows are rendered and highlighted only as they are read. Returns 1
+// with the view saved, 0 if there is no such session (tiOpen it then)
+int tiSessionOpen(tiBuffer *b, const char *filename, const char *path,
+                  struct tiSessionView *view);
+// saves b, read from filename when it was as base describes it, to path
+// with view. Only the view is written if the session there is up to date.
+// -1 with errno EBUSY if b has unsaved changes, ESTALE if the file changed
+int tiSessionSave(tiBuffer *b, const char *filename, const char *path,
+                  const struct stat *base, const struct tiSessionView *view);
+
+/*~~~~~~~~~~~~~~~~~~~~ instrumentation ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+uint64_t statsNow(void);
+void statsRecord(int stage, uint64_t start);
+uint64_t statsPercentile(struct stageStats *st, double p);
+int statsFormat(char *buf, size_t size, uint64_t ns);
+void statsReset(void);
+int statsOpenTrace(const char *filename);
+
+// stages are only timed while tiStats.enabled is set, otherwise each probe
+// is a single well predicted branch
+#define STATS_BEGIN() (tiStats.enabled ? statsNow() : 0)
+#define STATS_END(stage, start)                                                \
+  do {                                                                         \
+    if (tiStats.enabled)                                                       \
+      statsRecord(stage, start);                                               \
+  } while (0)
+
+/*~~~~~~~~~~~~~~~~~~~~ memory accounting ~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void *memAlloc(int cat, size_t size);
+void *memRealloc(int cat, void *p, size_t size);
+void memFree(void *p);
+int memFormat(char *buf, size_t size, size_t bytes);
+size_t memTotal(void);
+void memReport(void);
+
+#endif /* TI_H */